@@ -0,0 +1,13 @@
+#pragma once
+#include "../stdafx.hpp"
+
+namespace bench {
+	// The sample at `rank`, from 0 to 1, of the sorted samples. NaN if there are none, so a
+	// run that measured nothing prints as such instead of reading out of bounds.
+	inline double percentile(std::vector<double>& samples, double rank) {
+		if (samples.empty()) return std::numeric_limits<double>::quiet_NaN();
+
+		std::sort(samples.begin(), samples.end());
+		return samples[static_cast<std::size_t>(std::clamp(rank, 0.0, 1.0) * (samples.size() - 1))];
+	}
+}
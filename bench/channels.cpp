@@ -0,0 +1,124 @@
+#include "../stdafx.hpp"
+
+using namespace ve;
+
+namespace {
+	constexpr std::size_t messages = 200'000;
+	constexpr std::size_t round_trips = 50'000;
+	constexpr std::size_t stack_size = 32 * 1024;
+
+	enum class placement {
+		// Both fibers on the thread calling initialize().
+		inline_thread,
+		// Both fibers pinned to worker 0.
+		same_worker,
+		// One fiber on worker 0, the other on worker 1.
+		cross_worker,
+	};
+
+	const char* to_string(placement where) {
+		switch (where) {
+		case placement::inline_thread: return "same thread (no workers)";
+		case placement::same_worker: return "same worker";
+		case placement::cross_worker: return "cross worker";
+		}
+		return "";
+	}
+
+	// Runs `first` and `second` on two fibers placed as asked and returns the wall time
+	// until both are done.
+	template <typename First, typename Second>
+	double run_pair(placement where, First first, Second second) {
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		std::atomic<int> finished{ 0 };
+
+		auto wrap = [&finished](auto body) {
+			return [body, &finished] {
+				body();
+				finished.fetch_add(1, std::memory_order_release);
+				fiber::current()->terminate();
+				};
+		};
+		auto a = manager.add(std::make_unique<fiber>("bench_first", wrap(first), stack_size));
+		auto b = manager.add(std::make_unique<fiber>("bench_second", wrap(second), stack_size));
+
+		auto start = std::chrono::steady_clock::now();
+		if (where == placement::inline_thread) {
+			while (finished.load(std::memory_order_acquire) < 2) {
+				manager.initialize();
+			}
+		}
+		else {
+			manager.pin(a, 0);
+			manager.pin(b, where == placement::same_worker ? 0 : 1);
+			manager.start(2);
+			while (finished.load(std::memory_order_acquire) < 2) {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		manager.cleanup();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	void bench_throughput(const char* label, placement where, std::size_t capacity, channel_mode mode) {
+		channel<std::unique_ptr<std::size_t>> messages_channel(capacity, mode);
+		std::size_t received = 0;
+
+		auto ms = run_pair(where,
+			[&] {
+				for (std::size_t i = 0; i < messages; ++i) {
+					messages_channel.send(std::make_unique<std::size_t>(i));
+				}
+				messages_channel.close();
+			},
+			[&] {
+				while (messages_channel.receive()) {
+					++received;
+				}
+			});
+
+		std::cout << "[Bench] throughput " << label << ", " << to_string(where)
+			<< ": " << static_cast<double>(received) / ms * 1000.0 << " msgs/s ("
+			<< ms * 1e6 / static_cast<double>(received) << " ns/msg)\n";
+	}
+
+	void bench_ping_pong(placement where, channel_mode mode) {
+		channel<std::size_t> ping(1, mode);
+		channel<std::size_t> pong(1, mode);
+
+		auto ms = run_pair(where,
+			[&] {
+				for (std::size_t i = 0; i < round_trips; ++i) {
+					ping.send(i);
+					pong.receive();
+				}
+				ping.close();
+			},
+			[&] {
+				while (auto value = ping.receive()) {
+					pong.send(*value);
+				}
+			});
+
+		std::cout << "[Bench] ping-pong " << (mode == channel_mode::single ? "single" : "multi")
+			<< ", " << to_string(where) << ": " << ms * 1e6 / static_cast<double>(round_trips) << " ns/round trip\n";
+	}
+}
+
+int main() {
+	const placement placements[] = { placement::inline_thread, placement::same_worker, placement::cross_worker };
+
+	std::cout << "[Bench] messages=" << messages << " round_trips=" << round_trips << "\n";
+	for (auto where : placements) {
+		bench_throughput("bounded(64)", where, 64, channel_mode::multi);
+		bench_throughput("bounded(64) single", where, 64, channel_mode::single);
+		bench_throughput("unbounded", where, channel<std::unique_ptr<std::size_t>>::unbounded, channel_mode::multi);
+	}
+	for (auto where : placements) {
+		bench_ping_pong(where, channel_mode::multi);
+		bench_ping_pong(where, channel_mode::single);
+	}
+}
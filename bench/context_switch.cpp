@@ -0,0 +1,74 @@
+#include "../stdafx.hpp"
+
+using namespace ve;
+
+namespace {
+	constexpr std::size_t iterations = 5'000'000;
+
+	template <typename Context>
+	struct ping_pong {
+		Context main;
+		Context child;
+	};
+
+	template <typename Context>
+	double measure_backend() {
+		static ping_pong<Context> state;
+		auto stack = allocate_stack(64 * 1024);
+		state.child.create(stack.base, stack.size, [](void* param) {
+			auto* self = static_cast<ping_pong<Context>*>(param);
+			while (true) {
+				self->child.switch_to(self->main);
+			}
+			}, &state);
+
+		for (std::size_t i = 0; i < 1000; ++i) {
+			state.main.switch_to(state.child);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < iterations; ++i) {
+			state.main.switch_to(state.child);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		release_stack(stack);
+		return std::chrono::duration<double, std::nano>(end - start).count() / (iterations * 2);
+	}
+
+	double measure_fiber() {
+		fiber script("bench", [] {
+			while (true) {
+				fiber::current()->sleep();
+			}
+			}, 64 * 1024);
+
+		for (std::size_t i = 0; i < 1000; ++i) {
+			script.tick();
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < iterations; ++i) {
+			script.tick();
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		return std::chrono::duration<double, std::nano>(end - start).count() / (iterations * 2);
+	}
+
+	void report(const char* backend, double ns) {
+		std::cout << "[Bench] " << backend << ": " << ns << " ns/switch\n";
+	}
+}
+
+int main() {
+#if defined(VE_CONTEXT_HAS_ASM)
+	report(asm_context::backend_name, measure_backend<asm_context>());
+#endif
+#if !defined(_WIN32)
+	report(ucontext_context::backend_name, measure_backend<ucontext_context>());
+#else
+	report(winfiber_context::backend_name, measure_backend<winfiber_context>());
+#endif
+	report("fiber::tick/sleep", measure_fiber());
+}
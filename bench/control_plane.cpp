@@ -0,0 +1,77 @@
+#include "../stdafx.hpp"
+#include "bench.hpp"
+
+using namespace ve;
+using bench::percentile;
+
+namespace {
+	constexpr std::size_t busy_fibers = 8;
+	// Each busy fiber spins this long per slice, so a pass takes about busy_fibers times it.
+	constexpr auto slice = std::chrono::microseconds(250);
+	constexpr std::size_t rounds = 2'000;
+
+	void spin(std::chrono::steady_clock::duration length) {
+		auto end = std::chrono::steady_clock::now() + length;
+		while (std::chrono::steady_clock::now() < end) {}
+	}
+}
+
+int main() {
+	fiber_manager manager;
+	manager.set_verbosity(false);
+	std::cout.setstate(std::ios::badbit);
+
+	for (std::size_t i = 0; i < busy_fibers; ++i) {
+		manager.add(std::make_unique<fiber>("Busy_" + std::to_string(i), [] {
+			while (true) {
+				spin(slice);
+				fiber::current()->sleep();
+			}
+			}, 32 * 1024));
+	}
+	auto target = manager.add(std::make_unique<fiber>("Target", [] {
+		while (true) {
+			fiber::current()->sleep();
+		}
+		}, 32 * 1024));
+
+	// How long control calls and registry reads from another thread take while the calling
+	// thread keeps running passes of busy fibers.
+	std::atomic<bool> done{ false };
+	std::vector<double> control_us, read_us;
+	control_us.reserve(rounds);
+	read_us.reserve(rounds);
+	std::thread controller([&] {
+		for (std::size_t i = 0; i < rounds; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			manager.suspend(target);
+			manager.resume(target);
+			auto mid = std::chrono::steady_clock::now();
+			auto runtimes = manager.runtime_snapshot();
+			auto end = std::chrono::steady_clock::now();
+			if (runtimes.empty()) std::abort();
+
+			control_us.push_back(std::chrono::duration<double, std::micro>(mid - start).count());
+			read_us.push_back(std::chrono::duration<double, std::micro>(end - mid).count());
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+		done = true;
+		});
+
+	std::size_t passes = 0;
+	auto start = std::chrono::steady_clock::now();
+	while (!done) {
+		manager.initialize();
+		++passes;
+	}
+	auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	controller.join();
+
+	std::cout.clear();
+	std::cout << "[Bench] pass=" << elapsed / passes << "us"
+		<< " suspend+resume p50=" << percentile(control_us, 0.5) << "us p99=" << percentile(control_us, 0.99) << "us"
+		<< " runtime_snapshot p50=" << percentile(read_us, 0.5) << "us p99=" << percentile(read_us, 0.99) << "us\n";
+
+	std::cout.setstate(std::ios::badbit);
+	manager.cleanup();
+}
@@ -0,0 +1,116 @@
+#include "../stdafx.hpp"
+
+using namespace ve;
+
+namespace {
+	constexpr std::size_t task_count = 1'000'000;
+	constexpr std::size_t fiber_count = 100'000;
+	constexpr std::size_t resumes = 200'000;
+
+	// Resident set size from /proc, 0 where that is not available.
+	std::size_t resident_bytes() {
+#if defined(_WIN32)
+		return 0;
+#else
+		std::ifstream statm("/proc/self/statm");
+		std::size_t size = 0, resident = 0;
+		if (!(statm >> size >> resident)) return 0;
+		return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	template <typename Done>
+	void drive(fiber_manager& manager, Done done) {
+		while (!done()) manager.initialize();
+	}
+
+	task<> sleeper(std::atomic<std::size_t>& arrived, job_counter& finished) {
+		arrived.fetch_add(1, std::memory_order_relaxed);
+		co_await sleep_for(std::chrono::milliseconds(500));
+		finished.decrement();
+	}
+
+	void memory_tasks(fiber_manager& manager, fiber_pool& pool) {
+		std::atomic<std::size_t> arrived{ 0 };
+		job_counter finished(task_count);
+
+		auto before = resident_bytes();
+		for (std::size_t i = 0; i < task_count; ++i) {
+			pool.add_task(sleeper(arrived, finished));
+		}
+		drive(manager, [&] { return arrived.load(std::memory_order_relaxed) == task_count; });
+		auto during = resident_bytes();
+		drive(manager, [&] { return finished.value() == 0; });
+
+		std::cout << "[Bench] " << task_count << " suspended tasks: "
+			<< (during - before) / task_count << " bytes/task, "
+			<< (during - before) / (1024 * 1024) << " MiB per million\n";
+	}
+
+	void memory_fibers(fiber_manager& manager) {
+		std::atomic<std::size_t> arrived{ 0 };
+		std::atomic<std::size_t> finished{ 0 };
+
+		auto before = resident_bytes();
+		for (std::size_t i = 0; i < fiber_count; ++i) {
+			manager.add(std::make_unique<fiber>("sleeper", [&] {
+				arrived.fetch_add(1, std::memory_order_relaxed);
+				fiber::current()->sleep(std::chrono::milliseconds(500));
+				finished.fetch_add(1, std::memory_order_relaxed);
+				fiber::current()->terminate();
+				}, stack_pool::min_class_size));
+		}
+		drive(manager, [&] { return arrived.load(std::memory_order_relaxed) == fiber_count; });
+		auto during = resident_bytes();
+		auto mapped = stack_pool::instance().get_stats().mapped_bytes;
+		drive(manager, [&] { return finished.load(std::memory_order_relaxed) == fiber_count; });
+
+		auto per_fiber = (during - before) / fiber_count;
+		std::cout << "[Bench] " << fiber_count << " sleeping fibers (" << stack_pool::min_class_size / 1024 << " KiB stacks): "
+			<< per_fiber << " bytes/fiber resident, " << mapped / fiber_count << " bytes/fiber mapped, "
+			<< per_fiber * task_count / (1024 * 1024) << " MiB resident per million\n";
+	}
+
+	// One coroutine bouncing through the pool queue versus one fiber yielding to the manager.
+	void resume_latency(fiber_manager& manager, fiber_pool& pool) {
+		job_counter done(1);
+		auto start = std::chrono::steady_clock::now();
+		pool.add_task([](fiber_pool& pool, job_counter& done) -> task<> {
+			for (std::size_t i = 0; i < resumes; ++i) {
+				co_await pool.schedule();
+			}
+			done.decrement();
+			}(pool, done));
+		drive(manager, [&] { return done.value() == 0; });
+		auto task_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / resumes;
+
+		std::atomic<bool> finished{ false };
+		start = std::chrono::steady_clock::now();
+		manager.add(std::make_unique<fiber>("yielder", [&] {
+			for (std::size_t i = 0; i < resumes; ++i) {
+				fiber::current()->sleep();
+			}
+			finished.store(true, std::memory_order_relaxed);
+			fiber::current()->terminate();
+			}));
+		drive(manager, [&] { return finished.load(std::memory_order_relaxed); });
+		auto fiber_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / resumes;
+
+		std::cout << "[Bench] resume: task via pool.schedule() " << task_ns << " ns, fiber yield " << fiber_ns << " ns\n";
+	}
+}
+
+int main() {
+	auto manager = get_fiber_manager();
+	auto pool = get_fiber_pool();
+	manager->set_verbosity(false);
+	pool->set_verbosity(false);
+	pool->initialize(4);
+
+	resume_latency(*manager, *pool);
+	memory_tasks(*manager, *pool);
+	memory_fibers(*manager);
+
+	pool->cleanup();
+	manager->cleanup();
+}
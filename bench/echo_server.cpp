@@ -0,0 +1,168 @@
+#include "../stdafx.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+
+using namespace ve;
+
+namespace {
+	constexpr std::size_t target_connections = 10'000;
+	constexpr std::size_t round_trips = 20;
+	constexpr std::size_t message_size = 64;
+	constexpr std::size_t connect_concurrency = 256;
+	constexpr std::size_t stack_size = 32 * 1024;
+
+	// Every connection needs a descriptor on both ends.
+	std::size_t connection_limit() {
+		rlimit limit{};
+		::getrlimit(RLIMIT_NOFILE, &limit);
+		limit.rlim_cur = limit.rlim_max;
+		::setrlimit(RLIMIT_NOFILE, &limit);
+		::getrlimit(RLIMIT_NOFILE, &limit);
+		return std::min<std::size_t>(target_connections, (limit.rlim_cur - 64) / 2);
+	}
+
+	bool read_exact(int fd, char* buffer, std::size_t size) {
+		for (std::size_t done = 0; done < size;) {
+			auto n = io_read(fd, buffer + done, size - done);
+			if (n <= 0) return false;
+			done += static_cast<std::size_t>(n);
+		}
+		return true;
+	}
+
+	bool write_exact(int fd, const char* buffer, std::size_t size) {
+		for (std::size_t done = 0; done < size;) {
+			auto n = io_write(fd, buffer + done, size - done);
+			if (n <= 0) return false;
+			done += static_cast<std::size_t>(n);
+		}
+		return true;
+	}
+
+	// One fiber per connection on each side. All connections are established (and held open
+	// by a barrier) before the echo traffic starts.
+	void run(reactor_backend backend, std::size_t workers, std::size_t connections) {
+		reactor::instance().set_backend(backend);
+
+		int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		int reuse = 1;
+		::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(address);
+		if (::bind(listener, reinterpret_cast<sockaddr*>(&address), length) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+			throw std::runtime_error("Failed to open the listening socket.");
+		}
+		::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		std::vector<int> accepted(connections, -1);
+		std::vector<std::unique_ptr<fiber_semaphore>> handoff;
+		for (std::size_t i = 0; i < connections; ++i) handoff.push_back(std::make_unique<fiber_semaphore>(0));
+		fiber_semaphore connecting(connect_concurrency);
+		fiber_barrier established(connections);
+		std::atomic<std::size_t> finished{ 0 };
+		std::atomic<std::size_t> closed{ 0 };
+		std::atomic<std::size_t> failures{ 0 };
+		std::atomic<std::int64_t> echo_start{ 0 };
+
+		manager.add(std::make_unique<fiber>("acceptor", [&] {
+			for (std::size_t i = 0; i < connections; ++i) {
+				accepted[i] = io_accept(listener, nullptr, nullptr, SOCK_NONBLOCK);
+				if (accepted[i] < 0) failures.fetch_add(1, std::memory_order_relaxed);
+				handoff[i]->release();
+			}
+			fiber::current()->terminate();
+			}, stack_size));
+
+		for (std::size_t i = 0; i < connections; ++i) {
+			manager.add(std::make_unique<fiber>("server_" + std::to_string(i), [&, i] {
+				handoff[i]->acquire();
+				auto fd = accepted[i];
+				char buffer[message_size];
+				ssize_t n;
+				while (fd >= 0 && (n = io_read(fd, buffer, sizeof(buffer))) > 0) {
+					if (!write_exact(fd, buffer, static_cast<std::size_t>(n))) break;
+				}
+				if (fd >= 0) ::close(fd);
+				closed.fetch_add(1, std::memory_order_release);
+				fiber::current()->terminate();
+				}, stack_size));
+
+			manager.add(std::make_unique<fiber>("client_" + std::to_string(i), [&] {
+				int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+				int nodelay = 1;
+				::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+				// Keeps the listen backlog from overflowing into SYN retransmits.
+				connecting.acquire();
+				auto connected = io_connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+				connecting.release();
+
+				established.arrive_and_wait();
+				std::int64_t expected = 0;
+				echo_start.compare_exchange_strong(expected, std::chrono::steady_clock::now().time_since_epoch().count());
+
+				char out[message_size] = "ping";
+				char in[message_size];
+				for (std::size_t r = 0; connected && r < round_trips; ++r) {
+					if (!write_exact(fd, out, sizeof(out)) || !read_exact(fd, in, sizeof(in))) {
+						connected = false;
+					}
+				}
+				if (!connected) failures.fetch_add(1, std::memory_order_relaxed);
+				::close(fd);
+				finished.fetch_add(1, std::memory_order_release);
+				fiber::current()->terminate();
+				}, stack_size));
+		}
+
+		// Server fibers see EOF once their client closed; they must be done before the next
+		// run may switch the backend.
+		auto drive = [&](auto done) {
+			if (workers > 0) {
+				while (!done()) std::this_thread::sleep_for(std::chrono::microseconds(200));
+			}
+			else {
+				while (!done()) manager.initialize();
+			}
+		};
+
+		auto start = std::chrono::steady_clock::now();
+		if (workers > 0) manager.start(workers);
+		drive([&] { return finished.load(std::memory_order_acquire) == connections; });
+		auto end = std::chrono::steady_clock::now();
+		drive([&] { return closed.load(std::memory_order_acquire) == connections; });
+		manager.cleanup();
+		::close(listener);
+
+		auto echo_begin = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(echo_start.load()));
+		auto setup_ms = std::chrono::duration<double, std::milli>(echo_begin - start).count();
+		auto echo_s = std::chrono::duration<double>(end - echo_begin).count();
+		std::cout << "[Bench] backend=" << (backend == reactor_backend::io_uring ? "io_uring" : "epoll")
+			<< " workers=" << workers
+			<< " connections=" << connections
+			<< " connect=" << setup_ms << "ms"
+			<< " round_trips/s=" << static_cast<std::size_t>(connections * round_trips / echo_s)
+			<< " failures=" << failures.load() << std::endl;
+	}
+}
+
+int main() {
+	auto connections = connection_limit();
+	std::size_t workers = std::max(1u, std::thread::hardware_concurrency());
+
+	for (auto backend : { reactor_backend::io_uring, reactor_backend::epoll }) {
+		if (!reactor::is_available(backend)) {
+			std::cout << "[Bench] io_uring is not available, skipped\n";
+			continue;
+		}
+		run(backend, 0, connections);
+		run(backend, workers, connections);
+	}
+}
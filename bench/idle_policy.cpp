@@ -0,0 +1,84 @@
+#include "../stdafx.hpp"
+#include "bench.hpp"
+
+#include <ctime>
+
+using namespace ve;
+using bench::percentile;
+
+namespace {
+	constexpr std::size_t rounds = 500;
+	// Gap between submissions, long enough for the driver to reach its parked state.
+	constexpr auto gap = std::chrono::milliseconds(2);
+
+	double cpu_seconds() {
+		return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+	}
+
+	// Submits one pool job at a time from this thread while `driver` runs the fibers, and
+	// reports how long each took to start and how much CPU the process burnt meanwhile.
+	void run(const char* label, fiber_pool& pool) {
+		std::vector<double> latency_us;
+		latency_us.reserve(rounds);
+
+		auto cpu_start = cpu_seconds();
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < rounds; ++i) {
+			std::this_thread::sleep_for(gap);
+
+			std::atomic<bool> done{ false };
+			std::chrono::steady_clock::time_point started;
+			auto submitted = std::chrono::steady_clock::now();
+			pool.add([&] {
+				started = std::chrono::steady_clock::now();
+				done.store(true, std::memory_order_release);
+				}, 0);
+			while (!done.load(std::memory_order_acquire)) std::this_thread::yield();
+			latency_us.push_back(std::chrono::duration<double, std::micro>(started - submitted).count());
+		}
+		auto wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto cpu = cpu_seconds() - cpu_start;
+
+		std::cout.clear();
+		std::cout << "[Bench] " << label << " wake p50=" << percentile(latency_us, 0.5) << "us p99=" << percentile(latency_us, 0.99) << "us"
+			<< " cpu=" << 100.0 * cpu / wall << "% of a core\n";
+		std::cout.setstate(std::ios::badbit);
+	}
+}
+
+int main() {
+	auto manager = get_fiber_manager();
+	auto pool = get_fiber_pool();
+	manager->set_verbosity(false);
+	pool->set_verbosity(false);
+	std::cout.setstate(std::ios::badbit);
+	pool->initialize(2);
+
+	// The driver loop of main.cpp, with and without waiting between passes.
+	std::atomic<bool> waits{ false };
+	std::atomic<bool> running{ true };
+	std::thread driver([&] {
+		while (running.load(std::memory_order_relaxed)) {
+			manager->initialize();
+			pool->tick();
+			if (waits.load(std::memory_order_relaxed)) manager->wait_for_work();
+		}
+		});
+
+	run("busy loop           ", *pool);
+	waits = true;
+	manager->set_idle_policy(idle_policy::latency());
+	run("idle_policy latency ", *pool);
+	manager->set_idle_policy(idle_policy::balanced());
+	run("idle_policy balanced", *pool);
+	manager->set_idle_policy(idle_policy::power());
+	run("idle_policy power   ", *pool);
+
+	running = false;
+	// Wakes the parked driver so it sees `running`.
+	pool->add([] {}, 0);
+	driver.join();
+
+	pool->cleanup();
+	manager->cleanup();
+}
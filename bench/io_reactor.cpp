@@ -0,0 +1,326 @@
+#include "../stdafx.hpp"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+
+using namespace ve;
+
+namespace {
+	// Larger than a pipe's or a loopback socket's buffer, so writers have to wait too.
+	constexpr std::size_t transfer_size = 1024 * 1024;
+	constexpr std::size_t chunk_size = 16 * 1024;
+
+	std::size_t g_checks = 0;
+	std::size_t g_failures = 0;
+
+	void check(bool passed, const std::string& what) {
+		++g_checks;
+		if (passed) return;
+		++g_failures;
+		std::cout << "[Bench] FAILED: " << what << std::endl;
+	}
+
+	const char* name_of(reactor_backend backend) {
+		return backend == reactor_backend::io_uring ? "io_uring" : "epoll";
+	}
+
+	char pattern(std::size_t offset) {
+		return static_cast<char>(offset * 131 + 7);
+	}
+
+	// Writes transfer_size bytes of pattern() in chunks. False on error or early EOF.
+	bool send_all(int fd) {
+		std::vector<char> chunk(chunk_size);
+		for (std::size_t done = 0; done < transfer_size;) {
+			auto size = std::min(chunk_size, transfer_size - done);
+			for (std::size_t i = 0; i < size; ++i) chunk[i] = pattern(done + i);
+			for (std::size_t sent = 0; sent < size;) {
+				auto n = io_write(fd, chunk.data() + sent, size - sent);
+				if (n <= 0) return false;
+				sent += static_cast<std::size_t>(n);
+			}
+			done += size;
+		}
+		return true;
+	}
+
+	// Reads until EOF and checks that exactly transfer_size bytes of pattern() arrived.
+	bool receive_all(int fd) {
+		std::vector<char> chunk(chunk_size);
+		std::size_t done = 0;
+		while (true) {
+			auto n = io_read(fd, chunk.data(), chunk.size());
+			if (n < 0) return false;
+			if (n == 0) return done == transfer_size;
+			for (std::size_t i = 0; i < static_cast<std::size_t>(n); ++i) {
+				if (chunk[i] != pattern(done + i)) return false;
+			}
+			done += static_cast<std::size_t>(n);
+		}
+	}
+
+	void drive(fiber_manager& manager, std::size_t workers, const std::function<bool()>& done) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (!done() && std::chrono::steady_clock::now() < deadline) {
+			if (workers > 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+			else manager.initialize();
+		}
+	}
+
+	std::string label(reactor_backend backend, std::size_t workers, const char* test, bool nonblocking) {
+		return std::string(name_of(backend)) + " workers=" + std::to_string(workers) + " " + test
+			+ (nonblocking ? " non-blocking" : " blocking");
+	}
+
+	void pipe_transfer(reactor_backend backend, std::size_t workers, bool nonblocking) {
+		int fds[2];
+		if (::pipe2(fds, nonblocking ? O_NONBLOCK : 0) != 0) throw std::runtime_error("Failed to create a pipe.");
+
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		std::atomic<int> sent{ -1 };
+		std::atomic<int> received{ -1 };
+		manager.add(std::make_unique<fiber>("reader", [&] {
+			received = receive_all(fds[0]);
+			}));
+		manager.add(std::make_unique<fiber>("writer", [&] {
+			sent = send_all(fds[1]);
+			::close(fds[1]);
+			}));
+
+		if (workers > 0) manager.start(workers);
+		drive(manager, workers, [&] { return sent >= 0 && received >= 0; });
+		auto test = label(backend, workers, "pipe", nonblocking);
+		check(sent == 1, test + ": write");
+		check(received == 1, test + ": read");
+		manager.cleanup();
+		::close(fds[0]);
+	}
+
+	void socket_transfer(reactor_backend backend, std::size_t workers, bool nonblocking) {
+		auto type = SOCK_STREAM | (nonblocking ? SOCK_NONBLOCK : 0);
+		int listener = ::socket(AF_INET, type, 0);
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(address);
+		if (::bind(listener, reinterpret_cast<sockaddr*>(&address), length) != 0 || ::listen(listener, 16) != 0) {
+			throw std::runtime_error("Failed to open the listening socket.");
+		}
+		::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+
+		// The server echoes what it reads; the client sends and receives on two fibers so
+		// neither side waits on a full buffer the other is not draining.
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		fiber_semaphore connected(0);
+		int client = -1;
+		std::atomic<int> accepted{ -1 };
+		std::atomic<int> echoed{ -1 };
+		std::atomic<int> sent{ -1 };
+		std::atomic<int> received{ -1 };
+		manager.add(std::make_unique<fiber>("server", [&] {
+			int fd = io_accept(listener, nullptr, nullptr, nonblocking ? SOCK_NONBLOCK : 0);
+			accepted = fd >= 0;
+			std::vector<char> buffer(chunk_size);
+			bool ok = fd >= 0;
+			ssize_t n = 0;
+			while (ok && (n = io_read(fd, buffer.data(), buffer.size())) > 0) {
+				for (ssize_t done = 0; ok && done < n;) {
+					auto written = io_write(fd, buffer.data() + done, static_cast<std::size_t>(n - done));
+					ok = written > 0;
+					done += written;
+				}
+			}
+			echoed = ok && n == 0;
+			if (fd >= 0) ::close(fd);
+			}));
+		manager.add(std::make_unique<fiber>("client_writer", [&] {
+			client = ::socket(AF_INET, type, 0);
+			auto ok = io_connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+			connected.release();
+			sent = ok && send_all(client);
+			::shutdown(client, SHUT_WR);
+			}));
+		manager.add(std::make_unique<fiber>("client_reader", [&] {
+			connected.acquire();
+			received = receive_all(client);
+			}));
+
+		if (workers > 0) manager.start(workers);
+		drive(manager, workers, [&] { return echoed >= 0 && sent >= 0 && received >= 0; });
+		auto test = label(backend, workers, "loopback socket", nonblocking);
+		check(accepted == 1, test + ": accept");
+		check(sent == 1, test + ": connect and write");
+		check(echoed == 1, test + ": echo");
+		check(received == 1, test + ": read");
+		manager.cleanup();
+		if (client >= 0) ::close(client);
+		::close(listener);
+	}
+
+	// A blocking connect that cannot complete: the listener's queue is full, so the SYN is
+	// dropped. Other fibers have to keep running meanwhile, and shutdown() ends it.
+	void blocking_connect(reactor_backend backend, std::size_t workers) {
+		int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t length = sizeof(address);
+		if (::bind(listener, reinterpret_cast<sockaddr*>(&address), length) != 0 || ::listen(listener, 0) != 0) {
+			throw std::runtime_error("Failed to open the listening socket.");
+		}
+		::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length);
+		int queued = ::socket(AF_INET, SOCK_STREAM, 0);
+		if (::connect(queued, reinterpret_cast<sockaddr*>(&address), length) != 0) {
+			throw std::runtime_error("Failed to fill the listening socket's queue.");
+		}
+
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		int client = ::socket(AF_INET, SOCK_STREAM, 0);
+		std::atomic<bool> connected{ false };
+		std::atomic<int> ticks{ 0 };
+		manager.add(std::make_unique<fiber>("connector", [&] {
+			io_connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+			connected = true;
+			}));
+		manager.add(std::make_unique<fiber>("ticker", [&] {
+			while (!connected && ticks < 1000) {
+				++ticks;
+				fiber::current()->sleep(std::chrono::milliseconds(1));
+			}
+			}));
+
+		if (workers > 0) manager.start(workers);
+		drive(manager, workers, [&] { return connected || ticks >= 20; });
+		auto test = label(backend, workers, "connect", false);
+		check(!connected && ticks >= 20, test + ": other fibers ran while it was pending");
+		check(!(::fcntl(client, F_GETFL) & O_NONBLOCK), test + ": socket left blocking");
+
+		::shutdown(client, SHUT_RDWR);
+		drive(manager, workers, [&] { return connected.load(); });
+		check(connected, test + ": ended by shutdown()");
+		manager.cleanup();
+		::close(client);
+		::close(queued);
+		::close(listener);
+	}
+
+	// One io_write() much larger than the pipe has to come back complete, like the plain call.
+	void large_blocking_write(reactor_backend backend, std::size_t workers) {
+		int fds[2];
+		if (::pipe(fds) != 0) throw std::runtime_error("Failed to create a pipe.");
+
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		std::vector<char> data(transfer_size);
+		for (std::size_t i = 0; i < data.size(); ++i) data[i] = pattern(i);
+		std::atomic<ssize_t> written{ -2 };
+		std::atomic<int> received{ -1 };
+		manager.add(std::make_unique<fiber>("reader", [&] {
+			received = receive_all(fds[0]);
+			}));
+		manager.add(std::make_unique<fiber>("writer", [&] {
+			written = io_write(fds[1], data.data(), data.size());
+			::close(fds[1]);
+			}));
+
+		if (workers > 0) manager.start(workers);
+		drive(manager, workers, [&] { return written != -2 && received >= 0; });
+		auto test = label(backend, workers, "single large write", false);
+		check(written == static_cast<ssize_t>(transfer_size), test + ": written in full");
+		check(received == 1, test + ": read");
+		check(!(::fcntl(fds[0], F_GETFL) & O_NONBLOCK), test + ": pipe left blocking");
+		manager.cleanup();
+		::close(fds[0]);
+	}
+
+	// The fiber reads into a buffer on its stack and is destroyed before anything arrives. Its
+	// read has to be withdrawn: nothing may stay in flight, and the byte written afterwards
+	// must still be in the pipe rather than in the recycled stack.
+	void destroyed_while_pending(reactor_backend backend, std::size_t workers, bool nonblocking, bool by_resize) {
+		int fds[2];
+		if (::pipe2(fds, nonblocking ? O_NONBLOCK : 0) != 0) throw std::runtime_error("Failed to create a pipe.");
+
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		std::atomic<bool> returned{ false };
+		auto script = std::make_unique<fiber>("stuck", [&] {
+			char buffer[64];
+			io_read(fds[0], buffer, sizeof(buffer));
+			returned = true;
+			});
+		auto* stuck = script.get();
+		manager.add(std::move(script));
+
+		if (workers > 0) manager.start(workers);
+		drive(manager, workers, [&] { return stuck->is_parked() && reactor::instance().has_pending(); });
+		auto test = label(backend, workers, by_resize ? "destroyed by resize()" : "destroyed by cleanup()", nonblocking);
+		check(reactor::instance().has_pending(), test + ": read in flight");
+
+		if (by_resize) {
+			manager.resize(0);
+		}
+		else {
+			manager.cleanup();
+		}
+		check(!reactor::instance().has_pending(), test + ": read withdrawn");
+		check(!returned, test + ": fiber did not resume");
+
+		char byte = 'x';
+		[[maybe_unused]] auto written = ::write(fds[1], &byte, 1);
+		::fcntl(fds[0], F_SETFL, O_NONBLOCK);
+		char back = 0;
+		check(::read(fds[0], &back, 1) == 1 && back == byte, test + ": later data left in the pipe");
+
+		// Runs on the stack the destroyed fiber used, anything still writing there shows up.
+		std::atomic<bool> intact{ false };
+		manager.add(std::make_unique<fiber>("reuse", [&] {
+			char buffer[64];
+			std::memset(buffer, 0x5a, sizeof(buffer));
+			fiber::current()->sleep(std::chrono::milliseconds(5));
+			intact = std::all_of(std::begin(buffer), std::end(buffer), [](char c) { return c == 0x5a; });
+			}));
+		drive(manager, 0, [&] { return intact.load(); });
+		check(intact, test + ": recycled stack intact");
+
+		manager.cleanup();
+		::close(fds[0]);
+		::close(fds[1]);
+	}
+}
+
+int main() {
+	std::size_t workers = std::max(1u, std::thread::hardware_concurrency());
+
+	for (auto backend : { reactor_backend::io_uring, reactor_backend::epoll }) {
+		if (!reactor::is_available(backend)) {
+			std::cout << "[Bench] io_uring is not available, skipped\n";
+			continue;
+		}
+		// Throws if a test left I/O in flight.
+		reactor::instance().set_backend(backend);
+
+		auto start = std::chrono::steady_clock::now();
+		for (auto threads : { std::size_t{ 0 }, workers }) {
+			for (auto nonblocking : { false, true }) {
+				pipe_transfer(backend, threads, nonblocking);
+				socket_transfer(backend, threads, nonblocking);
+				destroyed_while_pending(backend, threads, nonblocking, false);
+			}
+		}
+		for (auto threads : { std::size_t{ 0 }, workers }) {
+			blocking_connect(backend, threads);
+			large_blocking_write(backend, threads);
+		}
+		destroyed_while_pending(backend, 0, false, true);
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "[Bench] backend=" << name_of(backend) << " done in " << elapsed << "ms\n";
+	}
+
+	std::cout << "[Bench] " << g_checks - g_failures << "/" << g_checks << " I/O checks passed" << std::endl;
+	return g_failures == 0 ? 0 : 1;
+}
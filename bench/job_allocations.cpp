@@ -0,0 +1,104 @@
+#include "../stdafx.hpp"
+
+#include <cstdlib>
+
+using namespace ve;
+
+namespace {
+	std::atomic<std::size_t> g_allocations{ 0 };
+}
+
+// Counts every heap allocation in the process.
+void* operator new(std::size_t size) {
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (auto* block = std::malloc(size ? size : 1)) return block;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void operator delete(void* block) noexcept {
+	std::free(block);
+}
+
+void operator delete[](void* block) noexcept {
+	std::free(block);
+}
+
+void operator delete(void* block, std::size_t) noexcept {
+	std::free(block);
+}
+
+void operator delete[](void* block, std::size_t) noexcept {
+	std::free(block);
+}
+
+namespace {
+	constexpr std::size_t jobs = 100'000;
+	constexpr std::size_t batch = 500;
+
+	struct payload {
+		std::atomic<std::size_t>* executed;
+		std::uint64_t values[4];
+	};
+
+	// A capture the size of a few pointers and counters, 40 bytes.
+	auto make_job(std::atomic<std::size_t>& executed, std::uint64_t seed) {
+		payload data{ &executed, { seed, seed + 1, seed + 2, seed + 3 } };
+		return [data] {
+			data.executed->fetch_add(1, std::memory_order_relaxed);
+		};
+	}
+
+	// Submits in batches below max_jobs and drains each one, counting the allocations of
+	// both halves.
+	void run(fiber_manager& manager, fiber_pool& pool, std::size_t count, std::size_t& submit_allocations, std::size_t& run_allocations) {
+		std::atomic<std::size_t> executed{ 0 };
+		submit_allocations = 0;
+		run_allocations = 0;
+		for (std::size_t done = 0; done < count; done += batch) {
+			auto before = g_allocations.load(std::memory_order_relaxed);
+			for (std::size_t i = 0; i < batch; ++i) {
+				pool.add(make_job(executed, done + i), 0);
+			}
+			auto submitted = g_allocations.load(std::memory_order_relaxed);
+			while (executed.load(std::memory_order_relaxed) < done + batch) manager.initialize();
+			auto after = g_allocations.load(std::memory_order_relaxed);
+
+			submit_allocations += submitted - before;
+			run_allocations += after - submitted;
+		}
+	}
+}
+
+int main() {
+	auto manager = get_fiber_manager();
+	auto pool = get_fiber_pool();
+	manager->set_verbosity(false);
+	pool->set_verbosity(false);
+	pool->initialize(4);
+
+	// The first round grows the queue and the slot table to their working size.
+	std::size_t submit_allocations = 0, run_allocations = 0;
+	run(*manager, *pool, batch, submit_allocations, run_allocations);
+	run(*manager, *pool, jobs, submit_allocations, run_allocations);
+
+	std::atomic<std::size_t> unused{ 0 };
+	auto before = g_allocations.load(std::memory_order_relaxed);
+	{
+		std::function<void()> boxed = make_job(unused, 0);
+	}
+	auto boxed_allocations = g_allocations.load(std::memory_order_relaxed) - before;
+
+	std::cout << "[Bench] " << jobs << " jobs with a " << sizeof(payload) << "-byte capture: "
+		<< static_cast<double>(submit_allocations) / jobs << " allocations/job in add(), "
+		<< static_cast<double>(run_allocations) / jobs << " allocations/job to run, "
+		<< boxed_allocations << " per std::function for comparison\n";
+	std::cout << "[Bench] sizeof(job_function)=" << sizeof(job_function) << " sizeof(job)=" << sizeof(job) << "\n";
+
+	pool->cleanup();
+	manager->cleanup();
+	return submit_allocations + run_allocations == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include "../stdafx.hpp"
+#include "bench.hpp"
+
+using namespace ve;
+using bench::percentile;
+
+namespace {
+	// Jobs that block their fiber, e.g. on I/O, so throughput depends on the fiber count.
+	constexpr auto job_length = std::chrono::milliseconds(1);
+	constexpr std::size_t burst = 32;
+	constexpr auto burst_gap = std::chrono::milliseconds(10);
+	constexpr std::size_t bursts = 50;
+	constexpr auto idle_time = std::chrono::milliseconds(1'500);
+
+	void pump(fiber_manager& manager, std::chrono::steady_clock::duration length) {
+		auto end = std::chrono::steady_clock::now() + length;
+		while (std::chrono::steady_clock::now() < end) manager.initialize();
+	}
+
+	// Submits bursts of blocking jobs, then idles, and reports submit-to-start latency and
+	// the fiber count under load and after the idle phase.
+	void run(const char* label, fiber_manager& manager, fiber_pool& pool) {
+		std::mutex mutex;
+		std::vector<double> latency_us;
+		latency_us.reserve(burst * bursts);
+		std::atomic<std::size_t> executed{ 0 };
+		std::size_t accepted = 0;
+		std::size_t peak = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t b = 0; b < bursts; ++b) {
+			for (std::size_t i = 0; i < burst; ++i) {
+				auto submitted = std::chrono::steady_clock::now();
+				accepted += pool.add([&, submitted] {
+					auto waited = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - submitted).count();
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						latency_us.push_back(waited);
+					}
+					fiber::current()->sleep(job_length);
+					executed.fetch_add(1, std::memory_order_relaxed);
+					}, 0);
+			}
+			pump(manager, burst_gap);
+			peak = std::max(peak, pool.get_stats().active_fibers);
+		}
+		while (executed.load(std::memory_order_relaxed) < accepted) manager.initialize();
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		pump(manager, idle_time);
+		auto stats = pool.get_stats();
+
+		std::cout.clear();
+		std::cout << "[Bench] " << label << " jobs=" << executed << " rejected=" << burst * bursts - accepted << " in " << elapsed << "ms"
+			<< " latency p50=" << percentile(latency_us, 0.5) << "us p99=" << percentile(latency_us, 0.99) << "us"
+			<< " fibers peak=" << peak << " idle=" << stats.active_fibers
+			<< " scale ups=" << stats.scale_ups << " downs=" << stats.scale_downs << "\n";
+		std::cout.setstate(std::ios::badbit);
+	}
+}
+
+int main() {
+	auto manager = get_fiber_manager();
+	auto pool = get_fiber_pool();
+	manager->set_verbosity(false);
+	pool->set_verbosity(false);
+	std::cout.setstate(std::ios::badbit);
+
+	pool->initialize(4);
+	run("fixed 4     ", *manager, *pool);
+
+	fiber_pool::autoscale_policy policy;
+	policy.min_fibers = 4;
+	policy.max_fibers = 64;
+	pool->set_autoscaling(policy);
+	run("autoscaled  ", *manager, *pool);
+
+	pool->set_autoscaling(std::nullopt);
+	pool->cleanup();
+	manager->cleanup();
+}
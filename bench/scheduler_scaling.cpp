@@ -0,0 +1,53 @@
+#include "../stdafx.hpp"
+
+using namespace ve;
+
+namespace {
+	constexpr std::size_t fiber_count = 512;
+	constexpr std::size_t slices_per_fiber = 200;
+	constexpr std::size_t work_per_slice = 20'000;
+
+	double run(std::size_t workers) {
+		fiber_manager manager;
+		std::atomic<std::size_t> finished{ 0 };
+		std::atomic<std::uint64_t> sink{ 0 };
+
+		for (std::size_t i = 0; i < fiber_count; ++i) {
+			manager.add(std::make_unique<fiber>("Worker_" + std::to_string(i), [&] {
+				std::uint64_t value = 0;
+				for (std::size_t slice = 0; slice < slices_per_fiber; ++slice) {
+					for (std::size_t n = 0; n < work_per_slice; ++n) {
+						value = value * 6364136223846793005ull + n;
+					}
+					fiber::current()->sleep();
+				}
+				sink.fetch_add(value, std::memory_order_relaxed);
+				finished.fetch_add(1, std::memory_order_relaxed);
+				fiber::current()->terminate();
+				}, 64 * 1024));
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		manager.start(workers);
+		while (finished.load(std::memory_order_relaxed) < fiber_count) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		auto end = std::chrono::steady_clock::now();
+		manager.cleanup();
+
+		return std::chrono::duration<double>(end - start).count();
+	}
+}
+
+int main() {
+	std::size_t max_workers = std::max(1u, std::thread::hardware_concurrency());
+	double baseline = 0;
+
+	for (std::size_t workers = 1; workers <= max_workers; workers *= 2) {
+		auto seconds = run(workers);
+		if (workers == 1) baseline = seconds;
+		std::cout << "[Bench] workers=" << workers
+			<< " slices/s=" << static_cast<std::size_t>(fiber_count * slices_per_fiber / seconds)
+			<< " speedup=" << baseline / seconds << "\n";
+	}
+}
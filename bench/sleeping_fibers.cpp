@@ -0,0 +1,49 @@
+#include "../stdafx.hpp"
+
+using namespace ve;
+
+namespace {
+	constexpr std::size_t fiber_count = 100'000;
+	constexpr std::size_t active_every = 100;
+	constexpr std::size_t passes = 2'000;
+}
+
+int main() {
+	fiber_manager manager;
+	std::atomic<std::size_t> slices{ 0 };
+
+	// The manager logs every add(), keep the report readable.
+	std::cout.setstate(std::ios::badbit);
+	for (std::size_t i = 0; i < fiber_count; ++i) {
+		bool active = i % active_every == 0;
+		manager.add(std::make_unique<fiber>("Sleeper_" + std::to_string(i), [active, &slices] {
+			while (true) {
+				slices.fetch_add(1, std::memory_order_relaxed);
+				if (active) {
+					fiber::current()->sleep();
+				}
+				else {
+					fiber::current()->sleep(std::chrono::seconds(30));
+				}
+			}
+			}, 16 * 1024));
+	}
+	manager.initialize();
+	std::cout.clear();
+
+	slices = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < passes; ++i) {
+		manager.initialize();
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	auto per_pass = std::chrono::duration<double, std::micro>(end - start).count() / passes;
+	std::cout << "[Bench] fibers=" << fiber_count
+		<< " runnable=" << fiber_count / active_every
+		<< " pass=" << per_pass << "us"
+		<< " slices/pass=" << static_cast<double>(slices.load()) / passes << "\n";
+
+	std::cout.setstate(std::ios::badbit);
+	manager.cleanup();
+}
@@ -0,0 +1,79 @@
+#include "../stdafx.hpp"
+
+using namespace ve;
+
+namespace {
+	constexpr std::size_t iterations = 200'000;
+	constexpr std::size_t batch = 1'000;
+
+	void touch_stack() {
+		volatile char buffer[8 * 1024];
+		for (std::size_t i = 0; i < sizeof(buffer); i += 512) {
+			buffer[i] = static_cast<char>(i);
+		}
+	}
+
+	// Spawn, run to completion and destroy one fiber at a time.
+	double measure_single(std::optional<std::size_t> stack_size) {
+		std::size_t ran = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < iterations; ++i) {
+			auto script = std::make_unique<fiber>("spawn", [&ran] {
+				touch_stack();
+				++ran;
+				}, stack_size);
+			script->tick();
+			script->terminate();
+		}
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+	}
+
+	// Keeps a batch alive before tearing it down, like resize() growing and shrinking.
+	double measure_batch(std::optional<std::size_t> stack_size) {
+		std::vector<std::unique_ptr<fiber>> live;
+		live.reserve(batch);
+		std::size_t ran = 0;
+		auto rounds = iterations / batch;
+
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t r = 0; r < rounds; ++r) {
+			for (std::size_t i = 0; i < batch; ++i) {
+				live.push_back(std::make_unique<fiber>("spawn", [&ran] {
+					touch_stack();
+					++ran;
+					}, stack_size));
+				live.back()->tick();
+			}
+			live.clear();
+		}
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(end - start).count() / (rounds * batch);
+	}
+
+	void report_pools() {
+		auto stacks = stack_pool::instance().get_stats();
+		for (const auto& c : stacks.classes) {
+			if (c.in_use + c.cached == 0) continue;
+			std::cout << "[Bench]   stacks " << c.stack_size / 1024 << " KiB: in_use=" << c.in_use << " cached=" << c.cached << "\n";
+		}
+		std::cout << "[Bench]   stacks mapped=" << stacks.mapped_bytes / 1024 << " KiB cached=" << stacks.cached_bytes / 1024
+			<< " KiB unguarded=" << stacks.unguarded << "\n";
+
+		auto blocks = object_pool<fiber>::get_stats();
+		std::cout << "[Bench]   control blocks allocated=" << blocks.allocated << " in_use=" << blocks.in_use << " cached=" << blocks.cached << "\n";
+	}
+}
+
+int main() {
+	std::cout << "[Bench] backend=" << context::backend_name << "\n";
+	std::cout << "[Bench] spawn+run+destroy default stack: " << measure_single(std::nullopt) << " ns/fiber\n";
+	std::cout << "[Bench] spawn+run+destroy 64 KiB stack: " << measure_single(64 * 1024) << " ns/fiber\n";
+	std::cout << "[Bench] batch of " << batch << " default stack: " << measure_batch(std::nullopt) << " ns/fiber\n";
+	report_pools();
+
+	// The default stacks fill most of the shared cache, drop them before switching sizes.
+	stack_pool::instance().trim();
+	std::cout << "[Bench] batch of " << batch << " 64 KiB stack: " << measure_batch(64 * 1024) << " ns/fiber\n";
+	report_pools();
+}
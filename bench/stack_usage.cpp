@@ -0,0 +1,95 @@
+#include "../stdafx.hpp"
+
+using namespace ve;
+
+namespace {
+	// Stays below the shared stack cache's default limit, so every deep stack is recycled.
+	constexpr std::size_t fiber_count = 1'000;
+	constexpr std::size_t deep_bytes = 128 * 1024;
+
+	// Resident set size from /proc, 0 where that is not available.
+	std::size_t resident_bytes() {
+#if defined(_WIN32)
+		return 0;
+#else
+		std::ifstream statm("/proc/self/statm");
+		std::size_t size = 0, resident = 0;
+		if (!(statm >> size >> resident)) return 0;
+		return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	__attribute__((noinline)) void go_deep(std::size_t bytes) {
+		volatile char frame[4096];
+		frame[0] = 1;
+		frame[sizeof(frame) - 1] = 1;
+		if (bytes > sizeof(frame)) go_deep(bytes - sizeof(frame));
+		// Keeps the recursion from becoming a loop that reuses one frame.
+		frame[1] = 1;
+	}
+
+	// Runs fiber_count fibers through `body` once and destroys them.
+	template <typename Body>
+	void run_and_destroy(const char* name, Body body) {
+		std::vector<std::unique_ptr<fiber>> scripts;
+		scripts.reserve(fiber_count);
+		for (std::size_t i = 0; i < fiber_count; ++i) {
+			scripts.push_back(std::make_unique<fiber>(name + std::to_string(i), body));
+			scripts.back()->tick();
+		}
+	}
+
+	// Memory of fiber_count fibers that have started and then sit idle, resident relative
+	// to `resident` as measured before the scenario ran anything.
+	void measure_idle(const char* label, std::size_t resident) {
+		std::vector<std::unique_ptr<fiber>> scripts;
+		scripts.reserve(fiber_count);
+
+		for (std::size_t i = 0; i < fiber_count; ++i) {
+			scripts.push_back(std::make_unique<fiber>("idle_" + std::to_string(i), [] {
+				fiber::current()->sleep();
+				}));
+			scripts.back()->tick();
+		}
+		auto resident_per_fiber = (resident_bytes() - resident) / fiber_count;
+		std::size_t reserved = 0;
+		for (const auto& script : scripts) reserved += script->m_stack.size;
+
+		std::cout << "[Bench] " << fiber_count << " idle fibers, " << label << ": "
+			<< resident_per_fiber << " bytes/fiber resident, "
+			<< reserved / fiber_count / 1024 << " KiB/fiber of stack reserved\n";
+	}
+}
+
+int main() {
+	auto& profiler = stack_profiler::instance();
+
+	// Stacks recycled from fibers that went deep, with and without giving those pages back.
+	profiler.set_sample_interval(0);
+	auto resident = resident_bytes();
+	run_and_destroy("deep_", [] { go_deep(deep_bytes); });
+	measure_idle("default stacks recycled after deep use, not measured", resident);
+	stack_pool::instance().trim();
+
+	profiler.set_sample_interval(1);
+	resident = resident_bytes();
+	run_and_destroy("deep_", [] { go_deep(deep_bytes); });
+	measure_idle("default stacks recycled after deep use, measured", resident);
+	stack_pool::instance().trim();
+
+	// Fresh stacks.
+	measure_idle("default stacks", resident_bytes());
+	stack_pool::instance().trim();
+
+	profiler.set_auto_sizing(true);
+	measure_idle("auto-sized stacks", resident_bytes());
+	stack_pool::instance().trim();
+
+	for (const auto& profile : profiler.profiles()) {
+		std::cout << "[Bench]   profile " << profile.name << ": samples=" << profile.samples
+			<< " max=" << profile.max_high_water / 1024 << " KiB mean=" << profile.mean_high_water / 1024
+			<< " KiB stack=" << profile.stack_size / 1024 << " KiB";
+		if (profile.suggested_size) std::cout << " suggested=" << *profile.suggested_size / 1024 << " KiB";
+		std::cout << "\n";
+	}
+}
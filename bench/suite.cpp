@@ -0,0 +1,371 @@
+#include "../stdafx.hpp"
+
+#include <future>
+
+using namespace ve;
+
+// Regression suite: one run covers context switches, spawning, scheduler passes and the
+// pool, each next to its std::thread / std::async counterpart where there is one.
+//
+//   bench_suite [--json <file>|-] [--quick]
+//
+// Human-readable lines go to stdout, or to stderr when the JSON goes to stdout.
+namespace {
+	struct result {
+		std::string benchmark;
+		std::string variant;
+		std::vector<std::pair<std::string, double>> values;
+	};
+
+	std::vector<result> g_results;
+	std::ostream* g_log = &std::cout;
+	std::size_t g_scale = 1;
+
+	using clock = std::chrono::steady_clock;
+
+	double elapsed_ns(clock::time_point start, clock::time_point end) {
+		return std::chrono::duration<double, std::nano>(end - start).count();
+	}
+
+	void record(std::string benchmark, std::string variant, std::vector<std::pair<std::string, double>> values) {
+		*g_log << "[Bench] " << benchmark << " " << variant << ":";
+		for (const auto& [key, value] : values) {
+			*g_log << " " << key << "=" << value;
+		}
+		*g_log << std::endl;
+		g_results.push_back({ std::move(benchmark), std::move(variant), std::move(values) });
+	}
+
+	std::string escape(const std::string& text) {
+		std::string escaped;
+		for (char c : text) {
+			if (c == '"' || c == '\\') escaped += '\\';
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	void write_json(std::ostream& out) {
+		auto seconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		out << "{\n"
+			<< "  \"suite\": \"fiber\",\n"
+			<< "  \"timestamp\": " << seconds << ",\n"
+			<< "  \"context_backend\": \"" << context::backend_name << "\",\n"
+			<< "  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n"
+			<< "  \"results\": [";
+		for (std::size_t i = 0; i < g_results.size(); ++i) {
+			const auto& entry = g_results[i];
+			out << (i ? ",\n" : "\n") << "    { \"benchmark\": \"" << escape(entry.benchmark)
+				<< "\", \"variant\": \"" << escape(entry.variant) << "\"";
+			for (const auto& [key, value] : entry.values) {
+				out << ", \"" << escape(key) << "\": " << std::setprecision(12) << value;
+			}
+			out << " }";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	// p50/p90/p99/p99.9/max of the samples, in ns.
+	std::vector<std::pair<std::string, double>> percentiles(std::vector<std::int64_t> samples) {
+		std::sort(samples.begin(), samples.end());
+		auto at = [&](double q) {
+			return static_cast<double>(samples[std::min(samples.size() - 1, static_cast<std::size_t>(q * samples.size()))]);
+		};
+		return { { "p50_ns", at(0.5) }, { "p90_ns", at(0.9) }, { "p99_ns", at(0.99) }, { "p999_ns", at(0.999) },
+			{ "max_ns", static_cast<double>(samples.back()) } };
+	}
+
+	std::vector<std::size_t> thread_counts() {
+		std::vector<std::size_t> counts;
+		std::size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+		for (std::size_t threads = 1; threads < hardware; threads *= 2) counts.push_back(threads);
+		counts.push_back(hardware);
+		return counts;
+	}
+
+	// One round trip is a switch into the fiber and one back out.
+	void context_switch() {
+		std::size_t iterations = 2'000'000 / g_scale;
+		fiber script("bench", [] {
+			while (true) {
+				fiber::current()->sleep();
+			}
+			}, 64 * 1024);
+		for (std::size_t i = 0; i < 1000; ++i) script.tick();
+
+		auto start = clock::now();
+		for (std::size_t i = 0; i < iterations; ++i) script.tick();
+		record("context_switch", "fiber", { { "round_trip_ns", elapsed_ns(start, clock::now()) / iterations } });
+
+		// Two threads handing a token back and forth through atomic wait/notify.
+		std::size_t handoffs = 50'000 / g_scale;
+		std::atomic<std::size_t> token{ 0 };
+		std::thread partner([&] {
+			for (std::size_t i = 0; i < handoffs; ++i) {
+				token.wait(2 * i);
+				token.store(2 * i + 2);
+				token.notify_one();
+			}
+			});
+		start = clock::now();
+		for (std::size_t i = 0; i < handoffs; ++i) {
+			token.store(2 * i + 1);
+			token.notify_one();
+			token.wait(2 * i + 1);
+		}
+		auto end = clock::now();
+		partner.join();
+		record("context_switch", "std::thread", { { "round_trip_ns", elapsed_ns(start, end) / handoffs } });
+	}
+
+	// Create, run to completion and destroy, one at a time.
+	void spawn() {
+		std::size_t fibers = 200'000 / g_scale;
+		std::size_t ran = 0;
+		auto start = clock::now();
+		for (std::size_t i = 0; i < fibers; ++i) {
+			auto script = std::make_unique<fiber>("spawn", [&ran] { ++ran; });
+			script->tick();
+			script->terminate();
+		}
+		auto ns = elapsed_ns(start, clock::now()) / fibers;
+		record("spawn", "fiber", { { "ns_per_spawn", ns }, { "spawns_per_s", 1e9 / ns } });
+
+		std::size_t threads = 5'000 / g_scale;
+		start = clock::now();
+		for (std::size_t i = 0; i < threads; ++i) {
+			std::thread([&ran] { ++ran; }).join();
+		}
+		ns = elapsed_ns(start, clock::now()) / threads;
+		record("spawn", "std::thread", { { "ns_per_spawn", ns }, { "spawns_per_s", 1e9 / ns } });
+
+		start = clock::now();
+		for (std::size_t i = 0; i < threads; ++i) {
+			std::async(std::launch::async, [&ran] { ++ran; }).get();
+		}
+		ns = elapsed_ns(start, clock::now()) / threads;
+		record("spawn", "std::async", { { "ns_per_spawn", ns }, { "spawns_per_s", 1e9 / ns } });
+	}
+
+	// Cost of one single-threaded initialize() pass with every fiber runnable.
+	void scheduler_pass() {
+		for (std::size_t count : { 100, 1'000, 10'000, 100'000 }) {
+			fiber_manager manager;
+			manager.set_verbosity(false);
+			for (std::size_t i = 0; i < count; ++i) {
+				manager.add(std::make_unique<fiber>("pass", [] {
+					while (true) {
+						fiber::current()->sleep();
+					}
+					}, stack_pool::min_class_size));
+			}
+			manager.initialize();
+
+			std::size_t passes = std::max<std::size_t>(10, 2'000'000 / g_scale / count);
+			auto start = clock::now();
+			for (std::size_t i = 0; i < passes; ++i) manager.initialize();
+			auto ns = elapsed_ns(start, clock::now()) / passes;
+			manager.cleanup();
+
+			record("scheduler_pass", "fiber_manager", { { "fibers", static_cast<double>(count) },
+				{ "pass_ns", ns }, { "ns_per_fiber", ns / count } });
+		}
+	}
+
+	struct latency_state {
+		std::vector<std::int64_t> samples;
+		std::atomic<std::size_t> completed{ 0 };
+	};
+
+	// threads == 0 means the calling thread drives the manager itself.
+	template <typename Done>
+	void wait_until(fiber_manager& manager, std::size_t threads, Done done) {
+		while (!done()) {
+			if (threads == 0) manager.initialize();
+			else std::this_thread::yield();
+		}
+	}
+
+	void pool_run(fiber_manager& manager, fiber_pool& pool, std::size_t threads) {
+		if (threads > 0) manager.start(threads);
+
+		// Latency: one job in flight at a time, from add() to the job starting.
+		std::size_t samples = 20'000 / g_scale;
+		latency_state latency;
+		latency.samples.resize(samples);
+		for (std::size_t i = 0; i < samples; ++i) {
+			auto submitted = clock::now();
+			pool.add([&latency, submitted, i] {
+				latency.samples[i] = (clock::now() - submitted).count();
+				latency.completed.store(i + 1, std::memory_order_release);
+				}, 0);
+			wait_until(manager, threads, [&] { return latency.completed.load(std::memory_order_acquire) == i + 1; });
+		}
+		auto values = percentiles(std::move(latency.samples));
+
+		// Throughput: as many jobs queued as max_jobs allows.
+		std::size_t jobs = 500'000 / g_scale;
+		std::atomic<std::size_t> executed{ 0 };
+		auto start = clock::now();
+		for (std::size_t i = 0; i < jobs; ++i) {
+			while (!pool.add([&executed] { executed.fetch_add(1, std::memory_order_relaxed); }, 0)) {
+				if (threads == 0) manager.initialize();
+				else std::this_thread::yield();
+			}
+		}
+		wait_until(manager, threads, [&] { return executed.load(std::memory_order_relaxed) == jobs; });
+		auto seconds = elapsed_ns(start, clock::now()) / 1e9;
+
+		if (threads > 0) manager.stop();
+
+		values.insert(values.begin(), { "threads", static_cast<double>(threads) });
+		values.push_back({ "jobs_per_s", jobs / seconds });
+		record("pool", "fiber_pool", std::move(values));
+	}
+
+	void async_run() {
+		std::size_t samples = 5'000 / g_scale;
+		std::vector<std::int64_t> latency(samples);
+		for (std::size_t i = 0; i < samples; ++i) {
+			auto submitted = clock::now();
+			std::async(std::launch::async, [&latency, submitted, i] {
+				latency[i] = (clock::now() - submitted).count();
+				}).get();
+		}
+		auto values = percentiles(std::move(latency));
+
+		// Throughput with a bounded number of outstanding futures.
+		std::size_t jobs = 20'000 / g_scale;
+		std::atomic<std::size_t> executed{ 0 };
+		std::vector<std::future<void>> pending;
+		auto start = clock::now();
+		for (std::size_t i = 0; i < jobs; ++i) {
+			pending.push_back(std::async(std::launch::async, [&executed] { executed.fetch_add(1, std::memory_order_relaxed); }));
+			if (pending.size() == 64) pending.clear();
+		}
+		pending.clear();
+		auto seconds = elapsed_ns(start, clock::now()) / 1e9;
+
+		values.push_back({ "jobs_per_s", jobs / seconds });
+		record("pool", "std::async", std::move(values));
+	}
+
+	// The same burst of jobs through add() one at a time and through one add_bulk().
+	void pool_burst(fiber_manager& manager, fiber_pool& pool) {
+		constexpr std::size_t burst = 4096;
+		std::size_t rounds = 200 / g_scale;
+		std::atomic<std::size_t> executed{ 0 };
+		std::vector<job_function> funcs(burst);
+		double add_ns = 0, bulk_ns = 0;
+
+		for (std::size_t r = 0; r < rounds; ++r) {
+			auto start = clock::now();
+			for (std::size_t i = 0; i < burst; ++i) {
+				pool.add([&executed] { executed.fetch_add(1, std::memory_order_relaxed); }, 0);
+			}
+			add_ns += elapsed_ns(start, clock::now());
+			wait_until(manager, 0, [&] { return executed.load(std::memory_order_relaxed) == (2 * r + 1) * burst; });
+
+			for (auto& func : funcs) {
+				func = [&executed] { executed.fetch_add(1, std::memory_order_relaxed); };
+			}
+			start = clock::now();
+			pool.add_bulk(funcs);
+			bulk_ns += elapsed_ns(start, clock::now());
+			wait_until(manager, 0, [&] { return executed.load(std::memory_order_relaxed) == (2 * r + 2) * burst; });
+		}
+
+		record("pool_burst", "add", { { "burst", burst }, { "ns_per_job", add_ns / (rounds * burst) } });
+		record("pool_burst", "add_bulk", { { "burst", burst }, { "ns_per_job", bulk_ns / (rounds * burst) } });
+	}
+
+	// Adopting ready-made fibers one add() at a time and through one add_bulk().
+	void spawn_burst() {
+		constexpr std::size_t burst = 1000;
+		std::size_t rounds = 50 / g_scale;
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		std::vector<std::unique_ptr<fiber>> scripts;
+		double add_ns = 0, bulk_ns = 0;
+
+		auto build = [&] {
+			scripts.clear();
+			for (std::size_t i = 0; i < burst; ++i) {
+				scripts.push_back(std::make_unique<fiber>("burst", [] {}, stack_pool::min_class_size));
+			}
+		};
+		for (std::size_t r = 0; r < rounds; ++r) {
+			build();
+			auto start = clock::now();
+			for (auto& script : scripts) {
+				manager.add(std::move(script));
+			}
+			add_ns += elapsed_ns(start, clock::now());
+			manager.cleanup();
+
+			build();
+			start = clock::now();
+			manager.add_bulk(scripts);
+			bulk_ns += elapsed_ns(start, clock::now());
+			manager.cleanup();
+		}
+
+		record("spawn_burst", "add", { { "burst", burst }, { "ns_per_fiber", add_ns / (rounds * burst) } });
+		record("spawn_burst", "add_bulk", { { "burst", burst }, { "ns_per_fiber", bulk_ns / (rounds * burst) } });
+	}
+
+	void pool() {
+		auto manager = get_fiber_manager();
+		auto pool = get_fiber_pool();
+		manager->set_verbosity(false);
+		pool->set_verbosity(false);
+		pool->set_max_jobs(4096);
+		pool->initialize(4);
+
+		pool_run(*manager, *pool, 0);
+		pool_burst(*manager, *pool);
+		for (auto threads : thread_counts()) {
+			pool_run(*manager, *pool, threads);
+		}
+		async_run();
+
+		pool->cleanup();
+		manager->cleanup();
+	}
+}
+
+int main(int argc, char** argv) {
+	std::string json_path;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--json" && i + 1 < argc) {
+			json_path = argv[++i];
+		}
+		else if (arg == "--quick") {
+			g_scale = 10;
+		}
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--json <file>|-] [--quick]\n";
+			return 2;
+		}
+	}
+	if (json_path == "-") g_log = &std::cerr;
+
+	context_switch();
+	spawn();
+	spawn_burst();
+	scheduler_pass();
+	pool();
+
+	if (json_path == "-") {
+		write_json(std::cout);
+	}
+	else if (!json_path.empty()) {
+		std::ofstream out(json_path);
+		if (!out) {
+			std::cerr << "Cannot write " << json_path << "\n";
+			return 1;
+		}
+		write_json(out);
+	}
+}
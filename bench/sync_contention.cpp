@@ -0,0 +1,252 @@
+#include "../stdafx.hpp"
+
+using namespace ve;
+
+namespace {
+	constexpr std::size_t fiber_count = 2'000;
+	constexpr std::size_t iterations = 10;
+	constexpr std::size_t stack_size = 32 * 1024;
+
+	void yield() {
+		fiber::current()->sleep();
+	}
+
+	// Runs `body` on fiber_count fibers and returns the wall time until all of them are
+	// done. workers == 0 drives everything from this thread.
+	template <typename Body>
+	double run_fibers(std::size_t workers, Body body) {
+		fiber_manager manager;
+		manager.set_verbosity(false);
+		std::atomic<std::size_t> finished{ 0 };
+
+		for (std::size_t i = 0; i < fiber_count; ++i) {
+			manager.add(std::make_unique<fiber>("bench_" + std::to_string(i), [&body, &finished, i] {
+				body(i);
+				finished.fetch_add(1, std::memory_order_release);
+				fiber::current()->terminate();
+				}, stack_size));
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		if (workers > 0) {
+			manager.start(workers);
+			while (finished.load(std::memory_order_acquire) < fiber_count) {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+			}
+		}
+		else {
+			while (finished.load(std::memory_order_acquire) < fiber_count) {
+				manager.initialize();
+			}
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		manager.cleanup();
+		return std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	// What a fiber has to do with a std primitive it must not block on: poll and yield.
+	template <typename TryLock>
+	void poll(TryLock try_lock) {
+		while (!try_lock()) {
+			yield();
+		}
+	}
+
+	void report(const char* scenario, std::size_t workers, double fiber_ms, double std_ms, const char* std_label) {
+		auto ops = static_cast<double>(fiber_count * iterations);
+		std::cout << "[Bench] " << scenario << " workers=" << workers
+			<< " fiber=" << fiber_ms << "ms (" << ops / fiber_ms * 1000.0 << " ops/s)"
+			<< " " << std_label << "=" << std_ms << "ms (" << ops / std_ms * 1000.0 << " ops/s)\n";
+	}
+
+	void bench_mutex_short(std::size_t workers) {
+		fiber_mutex fm;
+		std::mutex sm;
+		std::size_t fiber_counter = 0;
+		std::size_t std_counter = 0;
+
+		auto fiber_ms = run_fibers(workers, [&](std::size_t) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				{
+					std::lock_guard<fiber_mutex> lock(fm);
+					++fiber_counter;
+				}
+				yield();
+			}
+			});
+		auto std_ms = run_fibers(workers, [&](std::size_t) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				{
+					std::lock_guard<std::mutex> lock(sm);
+					++std_counter;
+				}
+				yield();
+			}
+			});
+		report("mutex (short section)", workers, fiber_ms, std_ms, "std::mutex");
+	}
+
+	void bench_mutex_across_yield(std::size_t workers) {
+		fiber_mutex fm;
+		std::mutex sm;
+
+		auto fiber_ms = run_fibers(workers, [&](std::size_t) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				std::lock_guard<fiber_mutex> lock(fm);
+				yield();
+			}
+			});
+		// Blocking in std::mutex::lock() here would deadlock the thread driving the fibers.
+		auto std_ms = run_fibers(workers, [&](std::size_t) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				poll([&] { return sm.try_lock(); });
+				yield();
+				sm.unlock();
+			}
+			});
+		report("mutex (held across yield)", workers, fiber_ms, std_ms, "std::mutex+poll");
+	}
+
+	void bench_semaphore(std::size_t workers) {
+		fiber_semaphore fs(8);
+		std::counting_semaphore<> ss(8);
+
+		auto fiber_ms = run_fibers(workers, [&](std::size_t) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				fs.acquire();
+				yield();
+				fs.release();
+			}
+			});
+		auto std_ms = run_fibers(workers, [&](std::size_t) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				poll([&] { return ss.try_acquire(); });
+				yield();
+				ss.release();
+			}
+			});
+		report("semaphore(8)", workers, fiber_ms, std_ms, "std::counting_semaphore+poll");
+	}
+
+	void bench_shared_mutex(std::size_t workers) {
+		fiber_shared_mutex fm;
+		std::shared_mutex sm;
+
+		auto fiber_ms = run_fibers(workers, [&](std::size_t id) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				if ((id + i) % 10 == 0) {
+					std::unique_lock<fiber_shared_mutex> lock(fm);
+					yield();
+				}
+				else {
+					std::shared_lock<fiber_shared_mutex> lock(fm);
+					yield();
+				}
+			}
+			});
+		auto std_ms = run_fibers(workers, [&](std::size_t id) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				if ((id + i) % 10 == 0) {
+					poll([&] { return sm.try_lock(); });
+					yield();
+					sm.unlock();
+				}
+				else {
+					poll([&] { return sm.try_lock_shared(); });
+					yield();
+					sm.unlock_shared();
+				}
+			}
+			});
+		report("shared_mutex (10% writers)", workers, fiber_ms, std_ms, "std::shared_mutex+poll");
+	}
+
+	void bench_barrier(std::size_t workers) {
+		fiber_barrier fb(fiber_count);
+		std::atomic<std::size_t> arrived{ 0 };
+		std::atomic<std::size_t> phase{ 0 };
+
+		auto fiber_ms = run_fibers(workers, [&](std::size_t) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				fb.arrive_and_wait();
+			}
+			});
+		// std::barrier::arrive_and_wait() blocks the thread, so poll a phase counter instead.
+		auto std_ms = run_fibers(workers, [&](std::size_t) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				auto current = phase.load(std::memory_order_acquire);
+				if (arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == fiber_count) {
+					arrived.store(0, std::memory_order_relaxed);
+					phase.fetch_add(1, std::memory_order_release);
+				}
+				else {
+					poll([&] { return phase.load(std::memory_order_acquire) != current; });
+				}
+			}
+			});
+		report("barrier", workers, fiber_ms, std_ms, "atomic phase+poll");
+	}
+
+	void bench_condition_variable(std::size_t workers) {
+		fiber_mutex fm;
+		fiber_condition_variable cv;
+		std::size_t fiber_tokens = 0;
+
+		std::mutex sm;
+		std::size_t std_tokens = 0;
+
+		// Half the fibers hand tokens to the other half.
+		auto fiber_ms = run_fibers(workers, [&](std::size_t id) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				std::unique_lock<fiber_mutex> lock(fm);
+				if (id % 2 == 0) {
+					++fiber_tokens;
+					lock.unlock();
+					cv.notify_one();
+					yield();
+				}
+				else {
+					cv.wait(lock, [&] { return fiber_tokens > 0; });
+					--fiber_tokens;
+				}
+			}
+			});
+		auto std_ms = run_fibers(workers, [&](std::size_t id) {
+			for (std::size_t i = 0; i < iterations; ++i) {
+				if (id % 2 == 0) {
+					{
+						std::lock_guard<std::mutex> lock(sm);
+						++std_tokens;
+					}
+					yield();
+				}
+				else {
+					poll([&] {
+						std::lock_guard<std::mutex> lock(sm);
+						if (std_tokens == 0) return false;
+						--std_tokens;
+						return true;
+						});
+				}
+			}
+			});
+		report("condition_variable (handoff)", workers, fiber_ms, std_ms, "std::mutex+poll");
+	}
+}
+
+int main() {
+	std::vector<std::size_t> worker_counts{ 0 };
+	auto hw = std::max(1u, std::thread::hardware_concurrency());
+	worker_counts.push_back(hw);
+
+	std::cout << "[Bench] fibers=" << fiber_count << " iterations=" << iterations << "\n";
+	for (auto workers : worker_counts) {
+		bench_mutex_short(workers);
+		bench_mutex_across_yield(workers);
+		bench_semaphore(workers);
+		bench_shared_mutex(workers);
+		bench_barrier(workers);
+		bench_condition_variable(workers);
+	}
+}
@@ -0,0 +1,75 @@
+#include "../../stdafx.hpp"
+
+#if defined(_MSC_VER)
+#define VE_NOINLINE __declspec(noinline)
+#else
+#define VE_NOINLINE __attribute__((noinline))
+#endif
+
+namespace ve {
+	namespace {
+		thread_local context t_thread_context;
+		thread_local fiber* t_current_fiber = nullptr;
+
+#if !defined(_WIN32)
+		void ucontext_entry(unsigned int entry_hi, unsigned int entry_lo, unsigned int param_hi, unsigned int param_lo) {
+			auto entry = (static_cast<std::uintptr_t>(entry_hi) << 32) | entry_lo;
+			auto param = (static_cast<std::uintptr_t>(param_hi) << 32) | param_lo;
+			reinterpret_cast<context_entry>(entry)(reinterpret_cast<void*>(param));
+		}
+#endif
+	}
+
+#if defined(VE_CONTEXT_HAS_ASM)
+	void asm_context::create(void* stack, std::size_t size, context_entry entry, void* param) {
+		auto top = (reinterpret_cast<std::uintptr_t>(stack) + size) & ~static_cast<std::uintptr_t>(15);
+#if defined(__x86_64__)
+		// mxcsr|fpucw, r12, r13, r14, r15, rbx, rbp, return address, then 16 bytes of padding
+		// so the trampoline starts with a 16-byte aligned stack.
+		auto* frame = reinterpret_cast<std::uint64_t*>(top - 80);
+		std::fill(frame, frame + 10, 0);
+		frame[0] = 0x1F80 | (static_cast<std::uint64_t>(0x037F) << 32);
+		frame[1] = reinterpret_cast<std::uint64_t>(entry);
+		frame[2] = reinterpret_cast<std::uint64_t>(param);
+		frame[7] = reinterpret_cast<std::uint64_t>(&ve_context_trampoline);
+#elif defined(__aarch64__)
+		// d8-d15, x19-x28, x29, x30.
+		auto* frame = reinterpret_cast<std::uint64_t*>(top - 0xa0);
+		std::fill(frame, frame + 20, 0);
+		frame[8] = reinterpret_cast<std::uint64_t>(entry);
+		frame[9] = reinterpret_cast<std::uint64_t>(param);
+		frame[19] = reinterpret_cast<std::uint64_t>(&ve_context_trampoline);
+#endif
+		m_sp = frame;
+	}
+#endif
+
+#if !defined(_WIN32)
+	void ucontext_context::create(void* stack, std::size_t size, context_entry entry, void* param) {
+		if (getcontext(&m_context) != 0) {
+			throw std::runtime_error("Failed to create fiber context.");
+		}
+		m_context.uc_stack.ss_sp = stack;
+		m_context.uc_stack.ss_size = size;
+		m_context.uc_link = nullptr;
+
+		auto e = reinterpret_cast<std::uintptr_t>(entry);
+		auto p = reinterpret_cast<std::uintptr_t>(param);
+		makecontext(&m_context, reinterpret_cast<void(*)()>(&ucontext_entry), 4,
+			static_cast<unsigned int>(e >> 32), static_cast<unsigned int>(e),
+			static_cast<unsigned int>(p >> 32), static_cast<unsigned int>(p));
+	}
+#endif
+
+	VE_NOINLINE context& this_thread_context() {
+		return t_thread_context;
+	}
+
+	VE_NOINLINE fiber* current_fiber() {
+		return t_current_fiber;
+	}
+
+	VE_NOINLINE void set_current_fiber(fiber* current) {
+		t_current_fiber = current;
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+#if !defined(_WIN32) && !defined(VE_CONTEXT_NO_ASM) && (defined(__x86_64__) || defined(__aarch64__))
+#define VE_CONTEXT_HAS_ASM
+#endif
+
+#if defined(VE_CONTEXT_HAS_ASM)
+extern "C" void ve_context_switch(void** from_sp, void* to_sp);
+extern "C" void ve_context_trampoline();
+#endif
+
+namespace ve {
+	class fiber;
+
+	using context_entry = void(*)(void*);
+
+	constexpr std::size_t default_stack_size = 1024 * 1024;
+
+#if defined(VE_CONTEXT_HAS_ASM)
+	class asm_context {
+	public:
+		static constexpr const char* backend_name = "asm";
+		static constexpr bool needs_stack = true;
+
+		void create(void* stack, std::size_t size, context_entry entry, void* param);
+
+		void switch_to(asm_context& target) {
+			ve_context_switch(&m_sp, target.m_sp);
+		}
+
+	private:
+		void* m_sp{};
+	};
+#endif
+
+#if !defined(_WIN32)
+	class ucontext_context {
+	public:
+		static constexpr const char* backend_name = "ucontext";
+		static constexpr bool needs_stack = true;
+
+		void create(void* stack, std::size_t size, context_entry entry, void* param);
+
+		void switch_to(ucontext_context& target) {
+			swapcontext(&m_context, &target.m_context);
+		}
+
+	private:
+		ucontext_t m_context{};
+	};
+#else
+	class winfiber_context {
+	public:
+		static constexpr const char* backend_name = "winfiber";
+		static constexpr bool needs_stack = false;
+
+		winfiber_context() = default;
+		winfiber_context(const winfiber_context&) = delete;
+		winfiber_context& operator=(const winfiber_context&) = delete;
+
+		~winfiber_context() {
+			if (m_owned && m_handle) DeleteFiber(m_handle);
+		}
+
+		void create(void*, std::size_t size, context_entry entry, void* param) {
+			m_handle = CreateFiber(size, reinterpret_cast<LPFIBER_START_ROUTINE>(entry), param);
+			if (!m_handle) {
+				throw std::runtime_error("Failed to create fiber context.");
+			}
+			m_owned = true;
+		}
+
+		void switch_to(winfiber_context& target) {
+			if (!m_handle) {
+				m_handle = IsThreadAFiber() ? GetCurrentFiber() : ConvertThreadToFiber(nullptr);
+				if (!m_handle) {
+					throw std::runtime_error("Failed to convert thread to fiber.");
+				}
+			}
+			SwitchToFiber(target.m_handle);
+		}
+
+	private:
+		void* m_handle{};
+		bool m_owned{ false };
+	};
+#endif
+
+#if defined(_WIN32)
+	using context = winfiber_context;
+#elif defined(VE_CONTEXT_HAS_ASM) && !defined(VE_CONTEXT_UCONTEXT)
+	using context = asm_context;
+#else
+	using context = ucontext_context;
+#endif
+
+	// Out of line on purpose: a fiber may resume on another thread, and an inlined
+	// thread_local access could keep the previous thread's address in a register.
+	context& this_thread_context();
+	fiber* current_fiber();
+	void set_current_fiber(fiber* current);
+}
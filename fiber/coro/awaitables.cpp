@@ -0,0 +1,20 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	void sleep_awaiter::await_suspend(std::coroutine_handle<> handle) const {
+		get_fiber_pool()->resume(handle, m_priority, m_duration);
+	}
+
+	bool finished_awaiter::await_suspend(std::coroutine_handle<> handle) {
+		auto* pool = m_pool;
+		return m_script->on_finished([pool, handle] { pool->resume(handle); });
+	}
+
+	sleep_awaiter sleep_for(std::chrono::steady_clock::duration duration, int priority) {
+		return sleep_awaiter(duration, priority);
+	}
+
+	finished_awaiter when_finished(fiber& script) {
+		return finished_awaiter(script, *get_fiber_pool());
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	class fiber_pool;
+
+	class sleep_awaiter {
+	public:
+		sleep_awaiter(std::chrono::steady_clock::duration duration, int priority)
+			: m_duration(duration), m_priority(priority) {}
+
+		bool await_ready() const noexcept {
+			return m_duration <= std::chrono::steady_clock::duration::zero();
+		}
+
+		void await_suspend(std::coroutine_handle<> handle) const;
+
+		void await_resume() const noexcept {}
+
+	private:
+		std::chrono::steady_clock::duration m_duration;
+		int m_priority;
+	};
+
+	class finished_awaiter {
+	public:
+		finished_awaiter(fiber& script, fiber_pool& pool)
+			: m_script(&script), m_pool(&pool) {}
+
+		bool await_ready() const {
+			return m_script->is_finished();
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle);
+
+		void await_resume() const noexcept {}
+
+	private:
+		fiber* m_script;
+		fiber_pool* m_pool;
+	};
+
+	// `co_await sleep_for(d)` suspends the coroutine for at least `d` without holding on to a
+	// fiber. It continues on the global pool, whose timed fiber sleeps until the deadline.
+	sleep_awaiter sleep_for(std::chrono::steady_clock::duration duration, int priority = 0);
+
+	// `co_await when_finished(script)` continues on the global pool once the stackful fiber's
+	// function has returned. The fiber must stay alive until then.
+	finished_awaiter when_finished(fiber& script);
+}
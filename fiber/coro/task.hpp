@@ -0,0 +1,133 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	template <typename T>
+	class task;
+
+	struct task_promise_base {
+		struct final_awaiter {
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			// Symmetric transfer into whoever awaited the task, so long chains of tasks do not
+			// grow the stack.
+			template <typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+				auto continuation = handle.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+
+			void await_resume() const noexcept {}
+		};
+
+		std::suspend_always initial_suspend() noexcept {
+			return {};
+		}
+
+		final_awaiter final_suspend() noexcept {
+			return {};
+		}
+
+		void unhandled_exception() noexcept {
+			exception = std::current_exception();
+		}
+
+		std::coroutine_handle<> continuation;
+		std::exception_ptr exception;
+	};
+
+	template <typename T>
+	struct task_promise : task_promise_base {
+		task<T> get_return_object() noexcept;
+
+		template <typename U>
+		void return_value(U&& value) {
+			result.emplace(std::forward<U>(value));
+		}
+
+		T take() {
+			if (exception) std::rethrow_exception(exception);
+			return std::move(*result);
+		}
+
+		std::optional<T> result;
+	};
+
+	template <>
+	struct task_promise<void> : task_promise_base {
+		task<void> get_return_object() noexcept;
+
+		void return_void() noexcept {}
+
+		void take() {
+			if (exception) std::rethrow_exception(exception);
+		}
+	};
+
+	// Stackless coroutine. It is lazy: the body starts when the task is awaited, and the
+	// awaiter resumes when it finishes. Hand a top-level task to fiber_pool::add_task() to
+	// run it on the pool's fibers.
+	template <typename T = void>
+	class task {
+	public:
+		using promise_type = task_promise<T>;
+
+		task(task&& other) noexcept
+			: m_handle(std::exchange(other.m_handle, {})) {}
+
+		task& operator=(task&& other) noexcept {
+			if (this != &other) {
+				if (m_handle) m_handle.destroy();
+				m_handle = std::exchange(other.m_handle, {});
+			}
+			return *this;
+		}
+
+		~task() {
+			if (m_handle) m_handle.destroy();
+		}
+
+		bool done() const {
+			return !m_handle || m_handle.done();
+		}
+
+		auto operator co_await() && noexcept {
+			struct awaiter {
+				std::coroutine_handle<promise_type> handle;
+
+				bool await_ready() const noexcept {
+					return !handle || handle.done();
+				}
+
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+					handle.promise().continuation = awaiting;
+					return handle;
+				}
+
+				T await_resume() {
+					return handle.promise().take();
+				}
+			};
+			return awaiter{ m_handle };
+		}
+
+	private:
+		friend struct task_promise<T>;
+
+		explicit task(std::coroutine_handle<promise_type> handle)
+			: m_handle(handle) {}
+
+		std::coroutine_handle<promise_type> m_handle;
+	};
+
+	template <typename T>
+	task<T> task_promise<T>::get_return_object() noexcept {
+		return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+	}
+
+	inline task<void> task_promise<void>::get_return_object() noexcept {
+		return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+	}
+}
@@ -1,140 +1,375 @@
-#pragma once
-#include "../stdafx.hpp"
-
-namespace ve {
-	class fiber {
-	public:
-		explicit fiber(std::string name, std::function<void()> func, std::optional<std::size_t> stackSize = std::nullopt, int priority = 0)
-			: m_name(std::move(name)), m_func(std::move(func)), m_suspended(false), m_disabled(false), m_priority(priority),
-			m_execution_time(0), m_interrupted(false), m_termination_timeout(std::nullopt) {
-
-			std::size_t stack_size = stackSize.value_or(0);
-			m_secondary = CreateFiber(stack_size, [](void* param) {
-				static_cast<fiber*>(param)->run();
-				}, this);
-		}
-
-		~fiber() {
-			if (m_secondary) DeleteFiber(m_secondary);
-		}
-
-		void tick() {
-			if (!m_disabled && !m_suspended) {
-				m_primary = GetCurrentFiber();
-				if (!m_time.has_value() || m_time.value() <= std::chrono::high_resolution_clock::now()) {
-					SwitchToFiber(m_secondary);
-				}
-			}
-		}
-
-		void suspend() {
-			m_suspended.store(true, std::memory_order_relaxed);
-		}
-
-		void resume() {
-			m_suspended.store(false, std::memory_order_relaxed);
-		}
-
-		void terminate() {
-			m_disabled.store(true, std::memory_order_relaxed);
-		}
-
-		bool is_suspended() const {
-			return m_suspended.load(std::memory_order_acquire);
-		}
-
-		bool is_disabled() const {
-			return m_disabled.load(std::memory_order_acquire);
-		}
-
-		const std::string& name() const {
-			return m_name;
-		}
-
-		int priority() const {
-			return m_priority;
-		}
-
-		long long execution_time() const {
-			return m_execution_time;
-		}
-
-		bool is_interrupted() const {
-			return m_interrupted.load(std::memory_order_acquire);
-		}
-
-		void set_termination_timeout(std::chrono::milliseconds timeout) {
-			m_termination_timeout = timeout;
-		}
-
-	private:
-		void run() {
-			auto start = std::chrono::high_resolution_clock::now();
-			try {
-				m_func();
-			}
-			catch (const std::exception& ex) {
-				std::cerr << "Exception in fiber '" << m_name << "': " << ex.what() << std::endl;
-			}
-			catch (...) {
-				std::cerr << "Unknown exception in fiber '" << m_name << "'" << std::endl;
-			}
-			auto end = std::chrono::high_resolution_clock::now();
-			m_execution_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-			while (!m_disabled.load(std::memory_order_acquire)) {
-				sleep();
-			}
-		}
-	public:
-		void sleep(std::optional<std::chrono::high_resolution_clock::duration> time = std::nullopt) {
-			if (time.has_value()) {
-				m_time = std::chrono::high_resolution_clock::now() + time.value();
-			}
-			else {
-				m_time = std::nullopt;
-			}
-			SwitchToFiber(m_primary);
-		}
-
-		static fiber* current() {
-			return static_cast<fiber*>(GetFiberData());
-		}
-
-		void print_status() const {
-			std::cout << "Fiber '" << m_name << "' "
-				<< (m_disabled.load(std::memory_order_acquire) ? "Disabled" : "Active")
-				<< ", Execution time: " << m_execution_time << "ms"
-				<< ", Priority: " << m_priority
-				<< ", Suspended: " << (m_suspended.load(std::memory_order_acquire) ? "Yes" : "No")
-				<< std::endl;
-		}
-
-		void interrupt() {
-			m_interrupted.store(true, std::memory_order_relaxed);
-		}
-
-		void set_state_callback(std::function<void(fiber*)> callback) {
-			m_state_callback = callback;
-		}
-
-		void trigger_state_callback() {
-			if (m_state_callback) {
-				m_state_callback(this);
-			}
-		}
-
-	public:
-		std::string m_name;
-		std::function<void()> m_func;
-		std::atomic<bool> m_suspended;
-		std::atomic<bool> m_disabled;
-		std::atomic<bool> m_interrupted;
-		void* m_primary{};
-		void* m_secondary{};
-		std::optional<std::chrono::high_resolution_clock::time_point> m_time;
-		int m_priority;
-		long long m_execution_time;
-		std::optional<std::chrono::milliseconds> m_termination_timeout;
-		std::function<void(fiber*)> m_state_callback;
-	};
+#pragma once
+#include "../stdafx.hpp"
+
+namespace ve {
+	class fiber_manager;
+	struct io_wait;
+	void cancel_io(io_wait& wait);
+
+	class fiber {
+	public:
+		explicit fiber(std::string name, inplace_function<void()> func, std::optional<std::size_t> stackSize = std::nullopt, int priority = 0)
+			: m_name(std::move(name)), m_func(std::move(func)), m_suspended(false), m_disabled(false), m_priority(priority),
+			m_interrupted(false) {
+
+			std::size_t stack_size = stackSize.value_or(0);
+			if constexpr (context::needs_stack) {
+				if (stack_size == 0) stack_size = stack_profiler::instance().suggested_size(m_name).value_or(default_stack_size);
+				m_stack = allocate_stack(stack_size);
+				stack_size = m_stack.size;
+				// Decided now rather than when it is destroyed, a recycled stack has to be
+				// cleaned before the fiber runs for its high-water mark to be its own.
+				m_stack_sampled = stack_profiler::instance().take_sample();
+				if (m_stack_sampled) stack_pool::instance().clean(m_stack);
+			}
+			m_timer.data = this;
+			m_context.create(m_stack.base, stack_size, [](void* param) {
+				static_cast<fiber*>(param)->run();
+				}, this);
+		}
+
+		~fiber() {
+			// The kernel may still write into buffers on the stack; withdraw the I/O first.
+			if (m_io) cancel_io(*m_io);
+			std::optional<std::size_t> high_water;
+			if (m_stack_sampled) {
+				high_water = stack_pool::high_water(m_stack);
+				if (high_water) stack_profiler::instance().record(m_name, *high_water, m_stack.size);
+			}
+			release_stack(m_stack, high_water);
+		}
+
+		// Control blocks are recycled, so spawning a short-lived fiber does not hit the heap.
+		static void* operator new(std::size_t size) {
+			if (size != sizeof(fiber)) return ::operator new(size);
+			return object_pool<fiber>::allocate();
+		}
+
+		static void operator delete(void* block, std::size_t size) noexcept {
+			if (size != sizeof(fiber)) {
+				::operator delete(block);
+				return;
+			}
+			object_pool<fiber>::deallocate(block);
+		}
+
+		void tick() {
+			if (!m_disabled && !m_suspended && (!m_parked || m_timed_park)) {
+				std::optional<std::uint64_t> late_ns;
+				if (m_time.has_value()) {
+					auto now = std::chrono::steady_clock::now();
+					if (m_time.value() > now) return;
+					late_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_time.value()).count();
+				}
+
+				auto* previous = current_fiber();
+				m_primary = previous ? &previous->m_context : &this_thread_context();
+				set_current_fiber(this);
+				VE_TRACE(3, trace_type::switch_in, trace_id(), 0);
+				auto watched = watchdog::enabled();
+				std::uint64_t begin = runtime_stats_enabled || watched ? cycle_clock::now() : 0;
+				if constexpr (runtime_stats_enabled) m_runtime.begin_slice(begin, late_ns);
+				if (watched) watchdog::enter(this, begin);
+				m_primary->switch_to(m_context);
+				if (watched) watchdog::leave();
+				if constexpr (runtime_stats_enabled) {
+					m_runtime.end_slice(begin, cycle_clock::now(), !m_parked.load(std::memory_order_relaxed) && !m_suspended.load(std::memory_order_relaxed));
+				}
+				VE_TRACE(3, trace_type::switch_out, trace_id(), 0);
+				set_current_fiber(previous);
+			}
+		}
+
+		void suspend() {
+			m_suspended.store(true, std::memory_order_relaxed);
+		}
+
+		void resume() {
+			if constexpr (runtime_stats_enabled) m_runtime.mark_runnable(cycle_clock::now());
+			m_suspended.store(false, std::memory_order_relaxed);
+		}
+
+		void terminate() {
+			m_disabled.store(true, std::memory_order_relaxed);
+		}
+
+		bool is_suspended() const {
+			return m_suspended.load(std::memory_order_acquire);
+		}
+
+		bool is_disabled() const {
+			return m_disabled.load(std::memory_order_acquire);
+		}
+
+		bool is_parked() const {
+			return m_parked.load(std::memory_order_acquire);
+		}
+
+		bool is_sleeping(std::chrono::steady_clock::time_point now) const {
+			return m_time.has_value() && m_time.value() > now;
+		}
+
+		const std::string& name() const {
+			return m_name;
+		}
+
+		// Invalid until the fiber is added to a manager.
+		fiber_handle handle() const {
+			return m_handle;
+		}
+
+		// Derived from the handle once the fiber has one, its address before that. Never 0.
+		std::uint64_t trace_id() const {
+			if (m_handle) return (static_cast<std::uint64_t>(m_handle.generation) << 32) | (m_handle.index + 1);
+			return reinterpret_cast<std::uintptr_t>(this);
+		}
+
+		int priority() const {
+			return m_priority;
+		}
+
+		// Takes effect the next time the fiber is queued.
+		void set_priority(int priority) {
+			m_priority = priority;
+		}
+
+		// Time spent running, in milliseconds. runtime() has the full breakdown.
+		long long execution_time() const {
+			return static_cast<long long>(m_runtime.on_cpu_ns() / 1'000'000);
+		}
+
+		fiber_runtime runtime() const {
+			fiber_runtime snapshot;
+			snapshot.name = m_name;
+			snapshot.handle = m_handle;
+			m_runtime.read(snapshot);
+			return snapshot;
+		}
+
+		bool is_interrupted() const {
+			return m_interrupted.load(std::memory_order_acquire);
+		}
+
+		// With the watchdog running, a slice longer than this terminates the fiber.
+		void set_termination_timeout(std::chrono::milliseconds timeout) {
+			m_termination_timeout.store(timeout.count(), std::memory_order_relaxed);
+		}
+
+		std::optional<std::chrono::milliseconds> termination_timeout() const {
+			auto timeout = m_termination_timeout.load(std::memory_order_relaxed);
+			if (timeout < 0) return std::nullopt;
+			return std::chrono::milliseconds(timeout);
+		}
+
+		// True once the fiber's function has returned (or thrown). A fiber added to a manager
+		// is destroyed soon after, see fiber_manager::set_auto_reap().
+		bool is_finished() const {
+			return m_finished.load(std::memory_order_acquire);
+		}
+
+		// Runs `callback` on this fiber right after its function returns. Returns false, and
+		// drops the callback, if it has already returned.
+		bool on_finished(std::function<void()> callback) {
+			std::lock_guard<spin_lock> guard(m_finish_guard);
+			if (m_finished.load(std::memory_order_relaxed)) return false;
+			m_finish_callbacks.push_back(std::move(callback));
+			return true;
+		}
+
+		void pin(std::size_t worker) {
+			m_affinity.store(static_cast<std::int32_t>(worker), std::memory_order_relaxed);
+		}
+
+		void unpin() {
+			m_affinity.store(-1, std::memory_order_relaxed);
+		}
+
+		std::optional<std::size_t> pinned_worker() const {
+			auto worker = m_affinity.load(std::memory_order_relaxed);
+			if (worker < 0) return std::nullopt;
+			return static_cast<std::size_t>(worker);
+		}
+
+	private:
+		void run() {
+			try {
+				m_func();
+			}
+			catch (const std::exception& ex) {
+				std::cerr << "Exception in fiber '" << m_name << "': " << ex.what() << std::endl;
+			}
+			catch (...) {
+				std::cerr << "Unknown exception in fiber '" << m_name << "'" << std::endl;
+			}
+
+			std::vector<std::function<void()>> callbacks;
+			{
+				std::lock_guard<spin_lock> guard(m_finish_guard);
+				m_finished.store(true, std::memory_order_release);
+				callbacks.swap(m_finish_callbacks);
+			}
+			for (auto& callback : callbacks) {
+				callback();
+			}
+			// Whoever ticked the fiber hands it to the manager to be destroyed. The entry
+			// point must not return, so ticking it again just switches back out.
+			while (true) {
+				sleep();
+			}
+		}
+	public:
+		void sleep(std::optional<std::chrono::high_resolution_clock::duration> time = std::nullopt) {
+			if (time.has_value()) {
+				m_time = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(time.value());
+				VE_TRACE(2, trace_type::sleep, trace_id(), static_cast<std::uint32_t>(std::clamp<std::int64_t>(
+					std::chrono::duration_cast<std::chrono::microseconds>(time.value()).count(), 0, std::numeric_limits<std::uint32_t>::max())));
+			}
+			else {
+				m_time = std::nullopt;
+			}
+			m_context.switch_to(*m_primary);
+		}
+
+		// Switches out until unpark(). Set m_parked before publishing the fiber to whoever
+		// will wake it, otherwise the wakeup can be lost.
+		void park() {
+			while (m_parked.load(std::memory_order_acquire)) {
+				sleep();
+			}
+		}
+
+		// Like park(), but gives up at `deadline` and returns false. An unpark() that comes
+		// first cuts the sleep short.
+		bool park_until(std::chrono::steady_clock::time_point deadline) {
+			m_timed_park = true;
+			while (m_parked.load(std::memory_order_acquire)) {
+				auto now = std::chrono::steady_clock::now();
+				if (now >= deadline) {
+					m_timed_park = false;
+					return false;
+				}
+				sleep(deadline - now);
+			}
+			m_timed_park = false;
+			return true;
+		}
+
+		void unpark();
+
+		// The timer of a park_until() belongs to the thread that armed it, so an unpark()
+		// cannot take the fiber out of it directly. The thread arms the timer and calls
+		// arm_park_timer(); a waker that wins claim_park_timer() sends the fiber back to that
+		// thread, which then takes it out of the timer with take_park_claim().
+		enum class park_timer : std::uint8_t {
+			none,
+			armed,
+			claimed,
+		};
+
+		// False if an unpark() came first: cancel the timer and run the fiber now.
+		bool arm_park_timer(std::int32_t owner) {
+			m_timer_owner = owner;
+			m_park_timer.store(park_timer::armed, std::memory_order_seq_cst);
+			if (m_parked.load(std::memory_order_seq_cst)) return true;
+			auto expected = park_timer::armed;
+			return !m_park_timer.compare_exchange_strong(expected, park_timer::none, std::memory_order_seq_cst);
+		}
+
+		bool claim_park_timer() {
+			auto expected = park_timer::armed;
+			return m_park_timer.load(std::memory_order_seq_cst) == park_timer::armed
+				&& m_park_timer.compare_exchange_strong(expected, park_timer::claimed, std::memory_order_seq_cst);
+		}
+
+		// For an expired timer: false if a waker claimed the fiber and is sending it back.
+		bool expire_park_timer() {
+			auto expected = park_timer::armed;
+			m_park_timer.compare_exchange_strong(expected, park_timer::none, std::memory_order_seq_cst);
+			return expected != park_timer::claimed;
+		}
+
+		// For a fiber that was handed back: true if it was claimed out of its timer, which
+		// the caller must cancel.
+		bool take_park_claim() {
+			if (m_park_timer.load(std::memory_order_acquire) != park_timer::claimed) return false;
+			m_park_timer.store(park_timer::none, std::memory_order_relaxed);
+			m_time.reset();
+			return true;
+		}
+
+		std::int32_t park_timer_owner() const {
+			return m_timer_owner;
+		}
+
+		static fiber* current() {
+			return current_fiber();
+		}
+
+		void print_status() const {
+			std::cout << "Fiber '" << m_name << "' "
+				<< (m_disabled.load(std::memory_order_acquire) ? "Disabled" : "Active")
+				<< ", Execution time: " << execution_time() << "ms"
+				<< ", Priority: " << m_priority
+				<< ", Suspended: " << (m_suspended.load(std::memory_order_acquire) ? "Yes" : "No")
+				<< std::endl;
+		}
+
+		// How deep the fiber's stack has gone so far, see stack_pool::high_water().
+		std::optional<std::size_t> stack_high_water() const {
+			return stack_pool::high_water(m_stack);
+		}
+
+		// Asks the fiber to switch out at its next yield_if_needed().
+		void interrupt() {
+			m_interrupted.store(true, std::memory_order_relaxed);
+		}
+
+		void set_state_callback(inplace_function<void(fiber*)> callback) {
+			m_state_callback = std::move(callback);
+		}
+
+		void trigger_state_callback() {
+			if (m_state_callback) {
+				m_state_callback(this);
+			}
+		}
+
+	public:
+		std::string m_name;
+		inplace_function<void()> m_func;
+		std::atomic<bool> m_suspended;
+		std::atomic<bool> m_disabled;
+		std::atomic<bool> m_interrupted;
+		context* m_primary{};
+		context m_context;
+		stack_allocation m_stack;
+		bool m_stack_sampled{ false };
+		std::optional<std::chrono::steady_clock::time_point> m_time;
+		int m_priority;
+		std::atomic<std::int64_t> m_termination_timeout{ -1 };
+		inplace_function<void(fiber*)> m_state_callback;
+		std::atomic<bool> m_parked{ false };
+		// The reactor operation it is parked on, see cancel_io().
+		io_wait* m_io{};
+		// Set for the duration of a park_until(), read by whoever ticks the fiber.
+		bool m_timed_park{ false };
+		std::atomic<park_timer> m_park_timer{ park_timer::none };
+		// Scheduler worker whose wheel holds the timer, -1 for the manager's own.
+		std::int32_t m_timer_owner{ -1 };
+		runtime_counters m_runtime;
+		std::atomic<bool> m_finished{ false };
+		spin_lock m_finish_guard;
+		std::vector<std::function<void()>> m_finish_callbacks;
+		std::atomic<bool> m_scheduled{ false };
+		std::atomic<std::int32_t> m_affinity{ -1 };
+		fiber* m_next_ready{};
+		fiber_manager* m_manager{};
+		fiber_handle m_handle;
+		// Its slot in the manager's registry, and when it was added there. Under the
+		// manager's registry lock.
+		std::size_t m_registry_index{};
+		std::uint64_t m_registry_order{};
+		timer_node m_timer;
+		ready_hook m_ready_hook;
+	};
 }
\ No newline at end of file
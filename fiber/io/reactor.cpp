@@ -0,0 +1,806 @@
+#include "../../stdafx.hpp"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ve {
+#if defined(__linux__)
+	enum class io_op : std::uint8_t {
+		read,
+		write,
+		accept,
+		connect,
+		poll
+	};
+
+	struct io_request {
+		io_op op;
+		int fd;
+		void* buffer{};
+		std::size_t size{};
+		std::int64_t offset{ -1 };
+		sockaddr* address{};
+		socklen_t* length{};
+		int flags{};
+	};
+
+	class io_backend;
+
+	enum class io_state : std::uint8_t {
+		pending,
+		completed,
+		// Its fiber is being destroyed and waits for the completion instead.
+		abandoned,
+	};
+
+	struct io_wait {
+		io_backend* backend{};
+		wait_node waiter;
+		int fd{ -1 };
+		std::int32_t result{};
+		std::atomic<io_state> state{ io_state::pending };
+		// The epoll backend made `fd` non-blocking for this call and has to undo it.
+		bool switched{};
+	};
+
+	class io_backend {
+	public:
+		virtual ~io_backend() = default;
+
+		virtual reactor_backend kind() const = 0;
+
+		// Parks the calling fiber until the operation is done. Returns the result of the
+		// system call or -errno.
+		virtual std::int64_t execute(const io_request& request) = 0;
+		virtual std::size_t poll(std::chrono::microseconds timeout) = 0;
+		// Makes a poll() that is waiting, or the next one, return right away.
+		virtual void interrupt() = 0;
+		// See cancel_io().
+		virtual void cancel(io_wait& wait) = 0;
+
+		bool has_pending() const {
+			return m_pending.load(std::memory_order_acquire) > 0;
+		}
+
+	protected:
+		std::atomic<std::size_t> m_pending{ 0 };
+	};
+
+	namespace {
+		static_assert(POLLIN == EPOLLIN && POLLOUT == EPOLLOUT && POLLPRI == EPOLLPRI && POLLERR == EPOLLERR && POLLHUP == EPOLLHUP,
+			"poll and epoll event bits are used interchangeably");
+
+		std::atomic<reactor*> s_reactor{ nullptr };
+
+		std::int64_t result_of(std::int64_t value) {
+			return value < 0 ? -errno : value;
+		}
+
+		// The plain system call, for callers outside a fiber and for ready descriptors.
+		std::int64_t perform(const io_request& request) {
+			switch (request.op) {
+			case io_op::read:
+				return result_of(request.offset < 0 ? ::read(request.fd, request.buffer, request.size)
+					: ::pread(request.fd, request.buffer, request.size, request.offset));
+			case io_op::write:
+				return result_of(request.offset < 0 ? ::write(request.fd, request.buffer, request.size)
+					: ::pwrite(request.fd, request.buffer, request.size, request.offset));
+			case io_op::accept:
+				return result_of(::accept4(request.fd, request.address, request.length, request.flags));
+			case io_op::connect:
+				return result_of(::connect(request.fd, request.address, static_cast<socklen_t>(request.size)));
+			case io_op::poll: {
+				pollfd target{ request.fd, static_cast<short>(request.flags), 0 };
+				auto count = ::poll(&target, 1, -1);
+				return count < 0 ? -errno : target.revents;
+			}
+			}
+			return -EINVAL;
+		}
+
+		short events_of(io_op op) {
+			return op == io_op::read || op == io_op::accept ? POLLIN : POLLOUT;
+		}
+
+		io_request poll_request(int fd, short events) {
+			io_request request{ io_op::poll, fd };
+			request.flags = events;
+			return request;
+		}
+
+		std::uint32_t load_acquire(std::uint32_t* value) {
+			return std::atomic_ref<std::uint32_t>(*value).load(std::memory_order_acquire);
+		}
+
+		void store_release(std::uint32_t* value, std::uint32_t desired) {
+			std::atomic_ref<std::uint32_t>(*value).store(desired, std::memory_order_release);
+		}
+
+		// Points the parked fiber at its wait for as long as it is in the reactor.
+		class io_wait_scope {
+		public:
+			io_wait_scope(io_wait& wait, io_backend* backend)
+				: m_script(fiber::current()) {
+				wait.backend = backend;
+				m_script->m_io = &wait;
+			}
+
+			~io_wait_scope() {
+				m_script->m_io = nullptr;
+			}
+
+			io_wait_scope(const io_wait_scope&) = delete;
+			io_wait_scope& operator=(const io_wait_scope&) = delete;
+
+		private:
+			fiber* m_script;
+		};
+
+		class uring_backend final : public io_backend {
+		public:
+			static constexpr std::uint32_t sq_entries = 1024;
+			static constexpr std::uint32_t cq_entries = 16384;
+
+			uring_backend() {
+				io_uring_params params{};
+				params.flags = IORING_SETUP_CQSIZE;
+				params.cq_entries = cq_entries;
+				m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, sq_entries, &params));
+				if (m_fd < 0) {
+					throw std::runtime_error("io_uring is not available.");
+				}
+
+				constexpr auto required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_FAST_POLL;
+				if ((params.features & required) != required) {
+					::close(m_fd);
+					throw std::runtime_error("io_uring lacks required features.");
+				}
+
+				m_ring_size = std::max<std::size_t>(params.sq_off.array + params.sq_entries * sizeof(std::uint32_t),
+					params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+				m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+				m_ring = ::mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+				m_sqes_map = m_ring == MAP_FAILED ? MAP_FAILED
+					: ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+				if (m_ring == MAP_FAILED || m_sqes_map == MAP_FAILED) {
+					if (m_ring != MAP_FAILED) ::munmap(m_ring, m_ring_size);
+					::close(m_fd);
+					throw std::runtime_error("Failed to map the io_uring rings.");
+				}
+
+				auto* base = static_cast<char*>(m_ring);
+				m_sq_head = reinterpret_cast<std::uint32_t*>(base + params.sq_off.head);
+				m_sq_tail = reinterpret_cast<std::uint32_t*>(base + params.sq_off.tail);
+				m_sq_flags = reinterpret_cast<std::uint32_t*>(base + params.sq_off.flags);
+				m_sq_array = reinterpret_cast<std::uint32_t*>(base + params.sq_off.array);
+				m_sq_mask = *reinterpret_cast<std::uint32_t*>(base + params.sq_off.ring_mask);
+				m_sq_size = params.sq_entries;
+				m_cq_head = reinterpret_cast<std::uint32_t*>(base + params.cq_off.head);
+				m_cq_tail = reinterpret_cast<std::uint32_t*>(base + params.cq_off.tail);
+				m_cq_mask = *reinterpret_cast<std::uint32_t*>(base + params.cq_off.ring_mask);
+				m_cqes = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+				m_sqes = static_cast<io_uring_sqe*>(m_sqes_map);
+			}
+
+			~uring_backend() override {
+				::munmap(m_sqes_map, m_sqes_size);
+				::munmap(m_ring, m_ring_size);
+				::close(m_fd);
+			}
+
+			reactor_backend kind() const override {
+				return reactor_backend::io_uring;
+			}
+
+			std::int64_t execute(const io_request& request) override {
+				auto result = submit(request);
+				if (request.op != io_op::write || result <= 0 || static_cast<std::size_t>(result) == request.size) {
+					return result;
+				}
+
+				// A blocking write writes everything, the ring may stop short, e.g. at a full pipe.
+				auto flags = ::fcntl(request.fd, F_GETFL);
+				if (flags < 0 || (flags & O_NONBLOCK)) return result;
+
+				auto written = result;
+				auto rest = request;
+				while (static_cast<std::size_t>(written) < request.size) {
+					rest.buffer = static_cast<char*>(request.buffer) + written;
+					rest.size = request.size - static_cast<std::size_t>(written);
+					if (request.offset >= 0) rest.offset = request.offset + written;
+					auto more = submit(rest);
+					if (more <= 0) break;
+					written += more;
+				}
+				return written;
+			}
+
+			void interrupt() override {
+				// Its completion ends the wait; user_data 0 tells reap() to skip it. If the ring
+				// is broken the wait just runs to its timeout.
+				auto error = push([](io_uring_sqe& sqe) {
+					sqe.opcode = IORING_OP_NOP;
+					});
+				if (error == 0) enter(m_sq_size, 0, 0, nullptr);
+			}
+
+			void cancel(io_wait& wait) override {
+				auto expected = io_state::pending;
+				if (!wait.state.compare_exchange_strong(expected, io_state::abandoned, std::memory_order_acq_rel)) {
+					// Reaped already, the reaper may still be waking the fiber.
+					std::lock_guard<spin_lock> lock(m_reap_lock);
+					return;
+				}
+
+				// The operation completes with -ECANCELED, or with its result if it was too far
+				// along. Until then the kernel may still write into the buffer.
+				push([&](io_uring_sqe& sqe) {
+					sqe.opcode = IORING_OP_ASYNC_CANCEL;
+					sqe.addr = reinterpret_cast<std::uint64_t>(&wait);
+					});
+				while (wait.state.load(std::memory_order_acquire) != io_state::completed) {
+					if (poll(std::chrono::milliseconds(1)) == 0) std::this_thread::yield();
+				}
+			}
+
+			std::size_t poll(std::chrono::microseconds timeout) override {
+				std::unique_lock<spin_lock> lock(m_reap_lock, std::try_to_lock);
+				if (!lock) return 0;
+
+				auto unsubmitted = load_acquire(m_sq_tail) != load_acquire(m_sq_head);
+				auto wait = timeout.count() > 0 && load_acquire(m_cq_tail) == *m_cq_head;
+				if (unsubmitted || wait) {
+					__kernel_timespec ts{};
+					ts.tv_sec = timeout.count() / 1'000'000;
+					ts.tv_nsec = (timeout.count() % 1'000'000) * 1'000;
+					io_uring_getevents_arg arg{};
+					arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+					// to_submit is capped by the kernel at what is actually queued.
+					enter(unsubmitted ? m_sq_size : 0, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0, wait ? &arg : nullptr);
+				}
+
+				auto completed = reap();
+				// Completions that did not fit were kept by the kernel, flush them into the ring.
+				while (load_acquire(m_sq_flags) & IORING_SQ_CQ_OVERFLOW) {
+					enter(0, 0, IORING_ENTER_GETEVENTS, nullptr);
+					auto more = reap();
+					if (more == 0) break;
+					completed += more;
+				}
+				return completed;
+			}
+
+		private:
+			std::int64_t submit(const io_request& request) {
+				io_wait wait;
+				io_wait_scope scope(wait, this);
+				prepare_wait(wait.waiter);
+				m_pending.fetch_add(1, std::memory_order_acq_rel);
+
+				auto error = push([&](io_uring_sqe& sqe) {
+					fill(sqe, request);
+					sqe.user_data = reinterpret_cast<std::uint64_t>(&wait);
+					});
+				if (error != 0) {
+					m_pending.fetch_sub(1, std::memory_order_acq_rel);
+					cancel_wait(wait.waiter);
+					return error;
+				}
+
+				// Submitted with the next batch, by whichever thread polls first.
+				wait_for_notify(wait.waiter);
+				return wait.result;
+			}
+
+			// Returns 0, or -errno if the ring is full and the kernel will not take entries.
+			template <typename Fill>
+			int push(Fill&& fill_entry) {
+				std::unique_lock<spin_lock> lock(m_submit_lock);
+				while (*m_sq_tail - load_acquire(m_sq_head) == m_sq_size) {
+					// The ring is full; hand it to the kernel now rather than wait for a poll.
+					if (enter(m_sq_size, 0, 0, nullptr) >= 0) continue;
+					auto error = errno;
+					if (error != EINTR && error != EAGAIN && error != EBUSY) return -error;
+					// Out of memory for requests or completions backed up: reap to make room.
+					lock.unlock();
+					if (poll({}) == 0) std::this_thread::yield();
+					lock.lock();
+				}
+
+				auto tail = *m_sq_tail;
+				auto index = tail & m_sq_mask;
+				auto& sqe = m_sqes[index];
+				std::memset(&sqe, 0, sizeof(sqe));
+				fill_entry(sqe);
+				m_sq_array[index] = index;
+				store_release(m_sq_tail, tail + 1);
+				return 0;
+			}
+
+			int enter(std::uint32_t to_submit, std::uint32_t min_complete, std::uint32_t flags, io_uring_getevents_arg* arg) {
+				return static_cast<int>(::syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, arg, arg ? sizeof(*arg) : 0));
+			}
+
+			static void fill(io_uring_sqe& sqe, const io_request& request) {
+				sqe.fd = request.fd;
+				switch (request.op) {
+				case io_op::read:
+				case io_op::write:
+					sqe.opcode = request.op == io_op::read ? IORING_OP_READ : IORING_OP_WRITE;
+					sqe.addr = reinterpret_cast<std::uint64_t>(request.buffer);
+					sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(request.size, std::numeric_limits<std::uint32_t>::max()));
+					sqe.off = request.offset < 0 ? ~std::uint64_t{ 0 } : static_cast<std::uint64_t>(request.offset);
+					break;
+				case io_op::accept:
+					sqe.opcode = IORING_OP_ACCEPT;
+					sqe.addr = reinterpret_cast<std::uint64_t>(request.address);
+					sqe.addr2 = reinterpret_cast<std::uint64_t>(request.length);
+					sqe.accept_flags = static_cast<std::uint32_t>(request.flags);
+					break;
+				case io_op::connect:
+					sqe.opcode = IORING_OP_CONNECT;
+					sqe.addr = reinterpret_cast<std::uint64_t>(request.address);
+					sqe.off = request.size;
+					break;
+				case io_op::poll:
+					sqe.opcode = IORING_OP_POLL_ADD;
+					sqe.poll32_events = static_cast<std::uint32_t>(request.flags);
+					break;
+				}
+			}
+
+			std::size_t reap() {
+				wait_node* woken = nullptr;
+				std::size_t completed = 0;
+
+				auto head = *m_cq_head;
+				auto tail = load_acquire(m_cq_tail);
+				for (; head != tail; ++head) {
+					const auto& cqe = m_cqes[head & m_cq_mask];
+					if (cqe.user_data == 0) continue;
+					auto* wait = reinterpret_cast<io_wait*>(cqe.user_data);
+					wait->result = cqe.res;
+					++completed;
+					// An abandoned wait belongs to cancel() from here on.
+					if (wait->state.exchange(io_state::completed, std::memory_order_acq_rel) == io_state::abandoned) continue;
+					wait->waiter.next = woken;
+					woken = &wait->waiter;
+				}
+				store_release(m_cq_head, head);
+
+				m_pending.fetch_sub(completed, std::memory_order_acq_rel);
+				notify_waiters(woken);
+				return completed;
+			}
+
+			int m_fd{ -1 };
+			void* m_ring{};
+			void* m_sqes_map{};
+			std::size_t m_ring_size{};
+			std::size_t m_sqes_size{};
+			std::uint32_t* m_sq_head{};
+			std::uint32_t* m_sq_tail{};
+			std::uint32_t* m_sq_flags{};
+			std::uint32_t* m_sq_array{};
+			std::uint32_t m_sq_mask{};
+			std::uint32_t m_sq_size{};
+			std::uint32_t* m_cq_head{};
+			std::uint32_t* m_cq_tail{};
+			std::uint32_t m_cq_mask{};
+			io_uring_cqe* m_cqes{};
+			io_uring_sqe* m_sqes{};
+			spin_lock m_submit_lock;
+			spin_lock m_reap_lock;
+		};
+
+		// Readiness based: a fiber waits until its descriptor is ready, then makes the system
+		// call itself. Descriptors are armed one-shot, with the union of what their waiters need.
+		class epoll_backend final : public io_backend {
+		public:
+			epoll_backend() {
+				m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+				if (m_epoll < 0) {
+					throw std::runtime_error("Failed to create epoll instance.");
+				}
+
+				// Level-triggered, it stays readable until poll() drains it.
+				m_wake = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+				epoll_event event{};
+				event.events = EPOLLIN;
+				event.data.fd = m_wake;
+				if (m_wake < 0 || ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake, &event) < 0) {
+					if (m_wake >= 0) ::close(m_wake);
+					::close(m_epoll);
+					throw std::runtime_error("Failed to create the reactor's wake event.");
+				}
+			}
+
+			~epoll_backend() override {
+				::close(m_wake);
+				::close(m_epoll);
+			}
+
+			reactor_backend kind() const override {
+				return reactor_backend::epoll;
+			}
+
+			std::int64_t execute(const io_request& request) override {
+				if (request.op == io_op::poll) {
+					return wait_ready(request.fd, static_cast<short>(request.flags));
+				}
+
+				// Non-blocking descriptors are tried once and come back with EAGAIN if they are
+				// not ready, reactor::execute() waits for those. A blocking one could still stall
+				// the thread once ready, e.g. in a large write, so it is made non-blocking while
+				// fibers are in a call on it. The flag is on the open file, so for that long
+				// other users of the file see it too.
+				if (!enter_blocking(request.fd)) {
+					return perform(request);
+				}
+
+				// A connect in progress is finished by reactor::execute() as for a
+				// non-blocking socket.
+				auto result = request.op == io_op::connect ? perform(request) : run_blocking(request);
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				leave_blocking(request.fd);
+				return result;
+			}
+
+			std::size_t poll(std::chrono::microseconds timeout) override {
+				std::unique_lock<spin_lock> reap_lock(m_reap_lock, std::try_to_lock);
+				if (!reap_lock) return 0;
+
+				std::array<epoll_event, 256> events;
+				auto ms = static_cast<int>((timeout.count() + 999) / 1000);
+				auto count = ::epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), ms);
+				if (count <= 0) return 0;
+
+				wait_node* woken = nullptr;
+				std::size_t completed = 0;
+				{
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					for (int i = 0; i < count; ++i) {
+						if (events[i].data.fd == m_wake) {
+							std::uint64_t value;
+							[[maybe_unused]] auto drained = ::read(m_wake, &value, sizeof(value));
+							continue;
+						}
+
+						auto it = m_watches.find(events[i].data.fd);
+						if (it == m_watches.end()) continue;
+
+						auto& watched = it->second;
+						wait_list remaining;
+						for (auto* node = watched.waiters.take_all(); node;) {
+							auto* next = node->next;
+							auto hit = events[i].events & (node->tag | POLLERR | POLLHUP);
+							if (hit) {
+								node->tag = hit;
+								node->next = woken;
+								woken = node;
+								++completed;
+							}
+							else {
+								remaining.push_back(node);
+							}
+							node = next;
+						}
+						watched.waiters = remaining;
+						if (!watched.waiters.empty()) arm(it->first, watched);
+					}
+				}
+
+				m_pending.fetch_sub(completed, std::memory_order_acq_rel);
+				notify_waiters(woken);
+				return completed;
+			}
+
+			void interrupt() override {
+				std::uint64_t one = 1;
+				[[maybe_unused]] auto written = ::write(m_wake, &one, sizeof(one));
+			}
+
+			void cancel(io_wait& wait) override {
+				{
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					// The fiber does not get to put the flags back itself.
+					if (wait.switched) leave_blocking(wait.fd);
+					auto it = m_watches.find(wait.fd);
+					if (it != m_watches.end() && it->second.waiters.remove(&wait.waiter)) {
+						m_pending.fetch_sub(1, std::memory_order_acq_rel);
+						return;
+					}
+				}
+				// Taken by poll(), which may still be waking the fiber.
+				std::lock_guard<spin_lock> lock(m_reap_lock);
+			}
+
+		private:
+			struct watch {
+				wait_list waiters;
+				bool registered{};
+				// Calls in progress on a blocking descriptor made non-blocking, and its flags
+				// from before.
+				std::size_t blocking_calls{};
+				int saved_flags{};
+			};
+
+			// False unless `fd` is a blocking descriptor, which it makes non-blocking until
+			// the matching leave_blocking().
+			bool enter_blocking(int fd) {
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				auto& watched = m_watches[fd];
+				if (watched.blocking_calls == 0) {
+					auto flags = ::fcntl(fd, F_GETFL);
+					if (flags < 0 || (flags & O_NONBLOCK) || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+						return false;
+					}
+					watched.saved_flags = flags;
+				}
+				++watched.blocking_calls;
+				return true;
+			}
+
+			// Expects m_Mutex to be held.
+			void leave_blocking(int fd) {
+				auto& watched = m_watches[fd];
+				if (--watched.blocking_calls == 0) {
+					::fcntl(fd, F_SETFL, watched.saved_flags);
+				}
+			}
+
+			// The call on a descriptor enter_blocking() switched. Waits whenever it is not
+			// ready, and writes out the whole buffer as a blocking write would.
+			std::int64_t run_blocking(io_request request) {
+				std::int64_t written = 0;
+				while (true) {
+					auto result = perform(request);
+					if (result == -EAGAIN) {
+						result = wait_ready(request.fd, events_of(request.op), true);
+						if (result >= 0) continue;
+					}
+					if (request.op != io_op::write) return result;
+					if (result <= 0) return written > 0 ? written : result;
+
+					written += result;
+					if (static_cast<std::size_t>(result) == request.size) return written;
+					request.buffer = static_cast<char*>(request.buffer) + result;
+					request.size -= static_cast<std::size_t>(result);
+					if (request.offset >= 0) request.offset += result;
+				}
+			}
+
+			std::int64_t wait_ready(int fd, short events, bool switched = false) {
+				io_wait wait;
+				io_wait_scope scope(wait, this);
+				wait.fd = fd;
+				wait.switched = switched;
+				wait.waiter.tag = static_cast<std::uint32_t>(events);
+				prepare_wait(wait.waiter);
+
+				{
+					std::lock_guard<std::mutex> lock(m_Mutex);
+					auto& watched = m_watches[fd];
+					watched.waiters.push_back(&wait.waiter);
+					if (auto error = arm(fd, watched); error != 0) {
+						watched.waiters.remove(&wait.waiter);
+						wait.waiter.script->m_parked.store(false, std::memory_order_seq_cst);
+						// Regular files cannot be watched, but they never block on readiness either.
+						return error == EPERM ? events : -error;
+					}
+					m_pending.fetch_add(1, std::memory_order_acq_rel);
+				}
+
+				wait_for_notify(wait.waiter);
+				return wait.waiter.tag;
+			}
+
+			// Returns 0 or the errno of epoll_ctl. A closed and reused descriptor drops out of
+			// the epoll set, so ADD and MOD fall back on each other.
+			int arm(int fd, watch& watched) {
+				std::uint32_t interest = 0;
+				for (auto* node = watched.waiters.front(); node; node = node->next) {
+					interest |= node->tag;
+				}
+
+				epoll_event event{};
+				event.events = interest | EPOLLONESHOT;
+				event.data.fd = fd;
+				auto op = watched.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+				if (::epoll_ctl(m_epoll, op, fd, &event) < 0) {
+					if (errno != ENOENT && errno != EEXIST) return errno;
+					op = op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+					if (::epoll_ctl(m_epoll, op, fd, &event) < 0) return errno;
+				}
+				watched.registered = true;
+				return 0;
+			}
+
+			int m_epoll{ -1 };
+			int m_wake{ -1 };
+			std::mutex m_Mutex;
+			std::unordered_map<int, watch> m_watches;
+			spin_lock m_reap_lock;
+		};
+
+		std::int64_t finish(std::int64_t result) {
+			if (result < 0) {
+				errno = static_cast<int>(-result);
+				return -1;
+			}
+			return result;
+		}
+	}
+
+	reactor& reactor::instance() {
+		// Never destroyed, fibers may still be parked on I/O while statics are torn down.
+		static auto* instance = [] {
+			auto* created = new reactor();
+			s_reactor.store(created, std::memory_order_release);
+			return created;
+			}();
+		return *instance;
+	}
+
+	reactor::reactor() {
+		set_backend(is_available(reactor_backend::io_uring) ? reactor_backend::io_uring : reactor_backend::epoll);
+	}
+
+	reactor_backend reactor::backend() const {
+		return m_backend.load(std::memory_order_acquire)->kind();
+	}
+
+	void reactor::set_backend(reactor_backend backend) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		auto* current = m_backend.load(std::memory_order_acquire);
+		if (current && current->has_pending()) {
+			throw std::runtime_error("Cannot switch the reactor backend while I/O is in flight.");
+		}
+
+		std::unique_ptr<io_backend> next;
+		if (backend == reactor_backend::io_uring) next = std::make_unique<uring_backend>();
+		else next = std::make_unique<epoll_backend>();
+
+		m_backend.store(next.get(), std::memory_order_release);
+		// The old backend stays alive, a poller may still be inside it.
+		m_backends.push_back(std::move(next));
+	}
+
+	bool reactor::is_available(reactor_backend backend) {
+		if (backend == reactor_backend::epoll) return true;
+
+		static const bool available = [] {
+			try {
+				uring_backend probe;
+				return true;
+			}
+			catch (const std::runtime_error&) {
+				return false;
+			}
+			}();
+		return available;
+	}
+
+	std::size_t reactor::poll(std::chrono::microseconds timeout) {
+		return m_backend.load(std::memory_order_acquire)->poll(timeout);
+	}
+
+	void reactor::interrupt() {
+		m_backend.load(std::memory_order_acquire)->interrupt();
+	}
+
+	bool reactor::has_pending() const {
+		return m_backend.load(std::memory_order_acquire)->has_pending();
+	}
+
+	std::int64_t reactor::execute(const io_request& request) {
+		// Nothing would reap the completion for a plain thread, so it just makes the call.
+		if (!fiber::current()) return perform(request);
+
+		auto& backend = *m_backend.load(std::memory_order_acquire);
+		auto result = backend.execute(request);
+
+		if (request.op == io_op::connect && (result == -EINPROGRESS || result == -EAGAIN)) {
+			auto ready = backend.execute(poll_request(request.fd, POLLOUT));
+			if (ready < 0) return ready;
+
+			int error = 0;
+			socklen_t length = sizeof(error);
+			if (::getsockopt(request.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) return -errno;
+			return error ? -error : 0;
+		}
+
+		// Non-blocking descriptors report EAGAIN instead of waiting, so wait for them here.
+		while (result == -EAGAIN && request.op != io_op::poll && request.op != io_op::connect) {
+			auto ready = backend.execute(poll_request(request.fd, events_of(request.op)));
+			if (ready < 0) return ready;
+			result = backend.execute(request);
+		}
+		return result;
+	}
+
+	ssize_t io_read(int fd, void* buffer, std::size_t size, std::int64_t offset) {
+		io_request request{ io_op::read, fd };
+		request.buffer = buffer;
+		request.size = size;
+		request.offset = offset;
+		return static_cast<ssize_t>(finish(reactor::instance().execute(request)));
+	}
+
+	ssize_t io_write(int fd, const void* buffer, std::size_t size, std::int64_t offset) {
+		io_request request{ io_op::write, fd };
+		request.buffer = const_cast<void*>(buffer);
+		request.size = size;
+		request.offset = offset;
+		return static_cast<ssize_t>(finish(reactor::instance().execute(request)));
+	}
+
+	int io_accept(int fd, sockaddr* address, socklen_t* length, int flags) {
+		io_request request{ io_op::accept, fd };
+		request.address = address;
+		request.length = length;
+		request.flags = flags;
+		return static_cast<int>(finish(reactor::instance().execute(request)));
+	}
+
+	int io_connect(int fd, const sockaddr* address, socklen_t length) {
+		io_request request{ io_op::connect, fd };
+		request.address = const_cast<sockaddr*>(address);
+		request.size = length;
+		return static_cast<int>(finish(reactor::instance().execute(request)));
+	}
+
+	int io_poll(int fd, short events) {
+		return static_cast<int>(finish(reactor::instance().execute(poll_request(fd, events))));
+	}
+
+	void cancel_io(io_wait& wait) {
+		wait.backend->cancel(wait);
+	}
+
+	bool poll_reactor(std::chrono::microseconds timeout) {
+		auto* instance = s_reactor.load(std::memory_order_acquire);
+		if (!instance || !instance->has_pending()) return false;
+
+		instance->poll(timeout);
+		return true;
+	}
+
+	bool wait_reactor(std::chrono::microseconds timeout) {
+		static std::atomic<bool> s_waiting{ false };
+
+		auto* instance = s_reactor.load(std::memory_order_acquire);
+		if (!instance || !instance->has_pending() || s_waiting.exchange(true, std::memory_order_acquire)) return false;
+
+		instance->poll(timeout);
+		s_waiting.store(false, std::memory_order_release);
+		return true;
+	}
+
+	void interrupt_reactor() {
+		if (auto* instance = s_reactor.load(std::memory_order_acquire)) {
+			instance->interrupt();
+		}
+	}
+#else
+	bool poll_reactor(std::chrono::microseconds) {
+		return false;
+	}
+
+	bool wait_reactor(std::chrono::microseconds) {
+		return false;
+	}
+
+	void interrupt_reactor() {}
+
+	void cancel_io(io_wait&) {}
+#endif
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Called from the scheduler loops: submits queued I/O and wakes the fibers whose
+	// operations completed, waiting up to `timeout` for the first completion. Returns false
+	// when no I/O is in flight.
+	bool poll_reactor(std::chrono::microseconds timeout = {});
+
+	// Lets an idle thread sleep in the reactor, so I/O completions wake it. Only one thread
+	// waits at a time; the others, and every caller while no I/O is in flight, get false
+	// right away. interrupt_reactor() ends the wait early, from any thread.
+	bool wait_reactor(std::chrono::microseconds timeout);
+	void interrupt_reactor();
+
+	// What a fiber parked in the reactor waits on. Lives on the fiber's stack.
+	struct io_wait;
+
+	// Called when a fiber is destroyed while parked on I/O. Cancels the operation and
+	// returns once neither the kernel nor the reactor will touch the fiber's stack again.
+	void cancel_io(io_wait& wait);
+}
+
+#if defined(__linux__)
+namespace ve {
+	enum class reactor_backend {
+		io_uring,
+		epoll
+	};
+
+	struct io_request;
+	class io_backend;
+
+	// Runs blocking-style I/O on behalf of fibers. The calling fiber parks until its operation
+	// completes while the thread goes on with other fibers; completions are reaped in batches
+	// by whichever thread drives the scheduler. Uses io_uring when the kernel allows it and
+	// falls back to epoll otherwise.
+	class reactor {
+	public:
+		static reactor& instance();
+
+		reactor_backend backend() const;
+
+		// Switches the backend. Throws if I/O is in flight or the backend is not available.
+		void set_backend(reactor_backend backend);
+		static bool is_available(reactor_backend backend);
+
+		// Only one thread polls at a time, the others return 0 right away.
+		std::size_t poll(std::chrono::microseconds timeout = {});
+		// Makes a poll() in progress, or else the next one, return right away.
+		void interrupt();
+		bool has_pending() const;
+
+		std::int64_t execute(const io_request& request);
+
+	private:
+		reactor();
+
+		std::atomic<io_backend*> m_backend{ nullptr };
+		std::vector<std::unique_ptr<io_backend>> m_backends;
+		std::mutex m_Mutex;
+	};
+
+	// Fiber-aware replacements for the system calls of the same name. Inside a fiber they park
+	// only the calling fiber; outside a fiber they are the plain blocking calls. Errors are
+	// reported the same way, -1 and errno.
+	ssize_t io_read(int fd, void* buffer, std::size_t size, std::int64_t offset = -1);
+	ssize_t io_write(int fd, const void* buffer, std::size_t size, std::int64_t offset = -1);
+	int io_accept(int fd, sockaddr* address = nullptr, socklen_t* length = nullptr, int flags = 0);
+	int io_connect(int fd, const sockaddr* address, socklen_t length);
+
+	// Waits until one of the poll(2) `events` is signalled and returns the revents.
+	int io_poll(int fd, short events);
+}
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	class fiber;
+
+	// Slot index plus generation. Stays cheap to copy and compare, and stops resolving
+	// once the fiber it named is gone, even if its slot has been reused since.
+	struct fiber_handle {
+		static constexpr std::uint32_t invalid_index = std::numeric_limits<std::uint32_t>::max();
+
+		std::uint32_t index{ invalid_index };
+		std::uint32_t generation{ 0 };
+
+		bool is_valid() const {
+			return index != invalid_index;
+		}
+
+		explicit operator bool() const {
+			return is_valid();
+		}
+
+		bool operator==(const fiber_handle&) const = default;
+	};
+
+	class handle_table {
+	public:
+		fiber_handle insert(fiber* script) {
+			std::uint32_t index;
+			if (m_free_head != fiber_handle::invalid_index) {
+				index = m_free_head;
+				m_free_head = m_slots[index].next_free;
+			}
+			else {
+				if (m_slots.size() >= fiber_handle::invalid_index) {
+					throw std::length_error("Fiber handle table is full.");
+				}
+				index = static_cast<std::uint32_t>(m_slots.size());
+				m_slots.emplace_back();
+			}
+
+			auto& entry = m_slots[index];
+			entry.script = script;
+			entry.next_free = fiber_handle::invalid_index;
+			++m_size;
+			return { index, entry.generation };
+		}
+
+		void reserve(std::size_t additional) {
+			m_slots.reserve(m_size + additional);
+		}
+
+		fiber* get(fiber_handle handle) const {
+			if (handle.index >= m_slots.size()) return nullptr;
+			const auto& entry = m_slots[handle.index];
+			return entry.generation == handle.generation ? entry.script : nullptr;
+		}
+
+		void erase(fiber_handle handle) {
+			if (!get(handle)) return;
+
+			auto& entry = m_slots[handle.index];
+			entry.script = nullptr;
+			++entry.generation;
+			entry.next_free = m_free_head;
+			m_free_head = handle.index;
+			--m_size;
+		}
+
+		std::size_t size() const {
+			return m_size;
+		}
+
+	private:
+		struct slot {
+			fiber* script{};
+			std::uint32_t generation{ 0 };
+			std::uint32_t next_free{ fiber_handle::invalid_index };
+		};
+
+		std::vector<slot> m_slots;
+		std::uint32_t m_free_head{ fiber_handle::invalid_index };
+		std::size_t m_size{ 0 };
+	};
+}
+
+template <>
+struct std::hash<ve::fiber_handle> {
+	std::size_t operator()(const ve::fiber_handle& handle) const noexcept {
+		return std::hash<std::uint64_t>{}((static_cast<std::uint64_t>(handle.generation) << 32) | handle.index);
+	}
+};
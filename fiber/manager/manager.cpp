@@ -1,232 +1,948 @@
-#include "manager.hpp"
-
-namespace ve {
-    std::shared_ptr<fiber_manager> g_fiber_manager = std::make_shared<fiber_manager>();
-
-	fiber_manager::fiber_manager()
-		: m_main_fiber_initialized(false), m_active_fibers(0) {}
-
-	void fiber_manager::initialize() {
-		std::lock_guard<std::mutex> lock(m_Mutex);
-
-		if (!m_main_fiber_initialized) {
-			if (!ConvertThreadToFiber(nullptr)) {
-				throw std::runtime_error("Failed to convert main thread to fiber.");
-			}
-			m_main_fiber_initialized = true;
-			std::cout << "[FiberManager] Main fiber initialized.";
-		}
-
-        for (const auto& script : m_fibers) {
-            if (!script->is_disabled()) {
-                script->tick();
-            }
-        }
-	}
-
-    void fiber_manager::resize(std::size_t new_size) {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-
-        if (new_size == m_fibers.size()) {
-            std::cout << "[FiberManager] Taille inchange.";
-            return;
-        }
-
-        if (new_size > m_fibers.size()) {
-            std::size_t fibers_to_add = new_size - m_fibers.size();
-            for (std::size_t i = 0; i < fibers_to_add; ++i) {
-                auto fiber_name = std::format("Fiber_{}", m_fibers.size() + i);
-                auto script = std::make_unique<fiber>(fiber_name, [] {
-                    while (true) {
-                        fiber::current()->sleep();
-                    }
-                    });
-                std::cout << std::format("Ajout de la fibre : {}", fiber_name);
-                m_fibers.push_back(std::move(script));
-                ++m_active_fibers;
-            }
-        }
-        else {
-            std::size_t fibers_to_remove = m_fibers.size() - new_size;
-            for (auto it = m_fibers.rbegin(); fibers_to_remove > 0 && it != m_fibers.rend(); ++it) {
-                if ((*it)->is_disabled()) {
-                    std::cout << std::format("Fibre dj dsactive : {}\n", (*it)->name());
-                }
-                else {
-                    (*it)->terminate();
-
-                    if ((*it)->is_disabled()) {
-                        std::cout << std::format("Fibre termine : {}\n", (*it)->name());
-                        --m_active_fibers;
-                        fibers_to_remove--;
-                    }
-                }
-            }
-
-            m_fibers.resize(new_size);
-        }
-        std::cout << std::format("Redimensionnement complet : taille actuelle = {}", m_fibers.size());
-    }
-
-	void fiber_manager::add(std::unique_ptr<fiber> script) {
-		std::lock_guard<std::mutex> lock(m_Mutex);
-
-		if (!script) throw std::invalid_argument("Fiber script is null.");
-
-		std::cout << std::format("Adding fiber: {}", script->name());
-		m_fibers.push_back(std::move(script));
-		++m_active_fibers;
-
-		if (m_fiber_added_callback) {
-			m_fiber_added_callback(m_fibers.back().get());
-		}
-	}
-
-	void fiber_manager::add(fiber* script) {
-		std::lock_guard<std::mutex> lock(m_Mutex);
-
-		if (!script) throw std::invalid_argument("Fiber script is null.");
-
-		std::cout << std::format("Adding fiber: {}", script->m_name);
-		m_fibers.emplace_back(script);
-		++m_active_fibers;
-
-		if (m_fiber_added_callback) {
-			m_fiber_added_callback(script);
-		}
-	}
-
-	void fiber_manager::add(const std::vector<std::pair<std::string, std::function<void()>>>& fibers) {
-		std::lock_guard<std::mutex> lock(m_Mutex);
-
-		for (const auto& [name, func] : fibers) {
-			auto script = std::make_unique<fiber>(name, func);
-			std::cout << std::format("Adding fiber: {}", script->name());
-			m_fibers.push_back(std::move(script));
-			++m_active_fibers;
-
-			if (m_fiber_added_callback) {
-				m_fiber_added_callback(m_fibers.back().get());
-			}
-		}
-	}
-
-	void fiber_manager::add(const std::string& name, std::function<void()> func) {
-		std::lock_guard<std::mutex> lock(m_Mutex);
-
-		auto script = std::make_unique<fiber>(name, std::move(func));
-		std::cout << std::format("Adding fiber: {}", script->name());
-		m_fibers.push_back(std::move(script));
-		++m_active_fibers;
-
-		if (m_fiber_added_callback) {
-			m_fiber_added_callback(m_fibers.back().get());
-		}
-	}
-
-	void fiber_manager::cleanup() {
-		std::lock_guard<std::mutex> lock(m_Mutex);
-
-		for (auto& fiber : m_fibers) {
-			if (!fiber->is_disabled()) {
-				fiber->terminate();
-				std::cout << std::format("Terminated fiber: {}", fiber->name());
-			}
-		}
-
-		m_fibers.clear();
-		m_active_fibers = 0;
-
-		if (m_cleanup_callback) {
-			m_cleanup_callback();
-		}
-		std::cout << "[FiberManager] All fibers cleaned up.";
-	}
-
-    void fiber_manager::suspend(const std::string& name) {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-
-        auto* target_fiber = find(name);
-        if (target_fiber && !target_fiber->is_suspended()) {
-            target_fiber->suspend();
-            std::cout << std::format("Fiber suspended: {}", name);
-            --m_active_fibers;
-
-            if (m_fiber_suspended_callback) {
-                m_fiber_suspended_callback(target_fiber);
-            }
-        }
-    }
-
-    void fiber_manager::resume(const std::string& name) {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-
-        auto* target_fiber = find(name);
-        if (target_fiber && target_fiber->is_suspended()) {
-            target_fiber->resume();
-            std::cout << std::format("Fiber resumed: {}", name);
-            ++m_active_fibers;
-
-            if (m_fiber_resumed_callback) {
-                m_fiber_resumed_callback(target_fiber);
-            }
-        }
-    }
-
-    void fiber_manager::terminate(const std::string& name) {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-
-        auto* target_fiber = find(name);
-        if (target_fiber && !target_fiber->is_disabled()) {
-            target_fiber->terminate();
-            std::cout << std::format("Fiber terminated: {}", name);
-            --m_active_fibers;
-
-            if (m_fiber_terminated_callback) {
-                m_fiber_terminated_callback(target_fiber);
-            }
-        }
-    }
-
-    void fiber_manager::list_active_fibers() {
-        std::lock_guard<std::mutex> lock(m_Mutex);
-
-        std::cout << "Listing all active fibers:\n";
-        for (const auto& fiber : m_fibers) {
-            if (!fiber->is_disabled()) {
-                std::cout << std::format("Active fiber: {}\n", fiber->name());
-            }
-        }
-    }
-
-    fiber* fiber_manager::find(const std::string& name) {
-        for (auto& fiber : m_fibers) {
-            if (fiber->name() == name) {
-                return fiber.get();
-            }
-        }
-        return nullptr;
-    }
-
-    void fiber_manager::set_fiber_added_callback(std::function<void(fiber*)> callback) {
-        m_fiber_added_callback = std::move(callback);
-    }
-
-    void fiber_manager::set_fiber_suspended_callback(std::function<void(fiber*)> callback) {
-        m_fiber_suspended_callback = std::move(callback);
-    }
-
-    void fiber_manager::set_fiber_resumed_callback(std::function<void(fiber*)> callback) {
-        m_fiber_resumed_callback = std::move(callback);
-    }
-
-    void fiber_manager::set_fiber_terminated_callback(std::function<void(fiber*)> callback) {
-        m_fiber_terminated_callback = std::move(callback);
-    }
-
-    void fiber_manager::set_cleanup_callback(std::function<void()> callback) {
-        m_cleanup_callback = std::move(callback);
-    }
-
-    std::shared_ptr<fiber_manager> get_fiber_manager() { return g_fiber_manager; }
+#include "manager.hpp"
+
+namespace ve {
+    std::shared_ptr<fiber_manager> g_fiber_manager = std::make_shared<fiber_manager>();
+
+	fiber_manager::fiber_manager()
+		: m_main_fiber_initialized(false), m_active_fibers(0) {}
+
+	fiber_manager::~fiber_manager() {
+		for (auto* command = m_commands.take_all(); command;) {
+			auto* next = command->next;
+			delete command;
+			command = next;
+		}
+		delete m_snapshot.exchange(nullptr);
+	}
+
+	void fiber_manager::initialize() {
+		if (in_pass()) {
+			return;
+		}
+
+		pass_lock pass(*this);
+		m_pass_owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+		run_pass();
+		m_pass_owner.store(std::thread::id(), std::memory_order_relaxed);
+	}
+
+	void fiber_manager::run_pass() {
+		if (!m_main_fiber_initialized) {
+			m_main_fiber_initialized = true;
+			if (m_verbose) std::cout << "[FiberManager] Main fiber initialized.";
+		}
+
+		apply_commands();
+
+		if (m_scheduler) {
+			// Picks up wakeups that raced with start() and still landed in the local inbox.
+			for (auto* script = m_remote.take_all(); script;) {
+				auto* next = script->m_next_ready;
+				script->take_park_claim();
+				m_scheduler->submit(script);
+				script = next;
+			}
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			reap_finished();
+			return;
+		}
+
+		// Completed I/O wakes its fibers through m_remote, so reap it first.
+		poll_reactor();
+
+		for (auto* script = m_remote.take_all(); script;) {
+			auto* next = script->m_next_ready;
+			reclaim(script);
+			m_ready.push(script);
+			script = next;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		m_timers.advance(now, [this](timer_node& node) {
+			auto* script = static_cast<fiber*>(node.data);
+			if (!script->expire_park_timer()) return;
+			VE_TRACE(2, trace_type::wake, script->trace_id(), 0);
+			m_ready.push(script);
+			});
+
+		// One dispatch per fiber that was runnable when the pass started, highest priority
+		// first. A fiber that yields competes again within the same pass.
+		for (auto pending = m_ready.size(); pending > 0; --pending) {
+			auto* script = m_ready.pop();
+			if (!script) break;
+			script->tick();
+			requeue(script);
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		reap_finished();
+	}
+
+	bool fiber_manager::in_pass() const {
+		return m_pass_owner.load(std::memory_order_relaxed) == std::this_thread::get_id();
+	}
+
+	void fiber_manager::require_outside_pass(const char* operation) const {
+		if (in_pass()) {
+			throw std::logic_error(std::string("Fiber manager: ") + operation + "() cannot be called from a fiber during a pass.");
+		}
+	}
+
+	void fiber_manager::defer(control_command::kind type, std::optional<std::size_t> value) {
+		// initialize() flushes the inbox once the pass is over.
+		m_commands.push(new control_command{ type, {}, nullptr, value });
+	}
+
+	void fiber_manager::post(control_command::kind type, fiber_handle target) {
+		if (!target) return;
+
+		m_commands.push(new control_command{ type, target });
+		flush_commands();
+	}
+
+	fiber_manager::pass_lock::pass_lock(fiber_manager& manager)
+		: m_manager(manager), m_lock(manager.m_pass_mutex) {
+	}
+
+	fiber_manager::pass_lock::pass_lock(fiber_manager& manager, std::try_to_lock_t)
+		: m_manager(manager), m_lock(manager.m_pass_mutex, std::try_to_lock) {
+	}
+
+	fiber_manager::pass_lock::~pass_lock() {
+		if (!m_lock.owns_lock()) return;
+
+		m_manager.apply_commands();
+		m_lock.unlock();
+		// A command posted between the two found the mutex still taken.
+		m_manager.flush_commands();
+	}
+
+	bool fiber_manager::pass_lock::owns_lock() const {
+		return m_lock.owns_lock();
+	}
+
+	void fiber_manager::flush_commands() {
+		// Whoever holds the pass applies what is queued, and every pass_lock does so again
+		// before and after letting go, so a command that found it taken is not left behind.
+		while (!m_commands.empty() && !in_pass()) {
+			std::unique_lock<std::mutex> pass(m_pass_mutex, std::try_to_lock);
+			if (!pass.owns_lock()) return;
+			apply_commands();
+		}
+	}
+
+	void fiber_manager::apply_commands() {
+		auto* command = m_commands.take_all();
+		if (!command) return;
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		while (command) {
+			// The handle no longer resolves if the fiber was reaped in the meantime.
+			auto* target = m_handles.get(command->target);
+			switch (command->type) {
+			case control_command::kind::suspend:
+				suspend_fiber(target);
+				break;
+			case control_command::kind::resume:
+				resume_fiber(target);
+				break;
+			case control_command::kind::terminate:
+				terminate_fiber(target);
+				break;
+			case control_command::kind::resize:
+				resize_locked(*command->value);
+				break;
+			case control_command::kind::set_aging_threshold:
+				m_ready.set_aging_threshold(command->value);
+				break;
+			}
+			auto* next = command->next;
+			delete command;
+			command = next;
+		}
+	}
+
+	void fiber_manager::requeue(fiber* script) {
+		if (script->is_finished()) {
+			// Stays marked as scheduled, so nothing queues it again.
+			if (m_auto_reap.load(std::memory_order_relaxed)) m_finished.push(script);
+			return;
+		}
+
+		if (script->is_disabled()) {
+			script->m_scheduled.store(false, std::memory_order_release);
+			return;
+		}
+
+		if (script->is_sleeping(std::chrono::steady_clock::now())) {
+			m_timers.schedule(script->m_timer, *script->m_time);
+			if (script->m_timed_park && !script->arm_park_timer(-1)) {
+				m_timers.cancel(script->m_timer);
+				script->m_time.reset();
+				m_ready.push(script);
+			}
+			return;
+		}
+
+		auto runnable = [script] {
+			return !script->is_suspended() && (!script->is_parked() || script->m_timed_park);
+		};
+
+		if (runnable()) {
+			m_ready.push(script);
+			return;
+		}
+
+		script->m_scheduled.store(false, std::memory_order_seq_cst);
+		if (runnable() && !script->is_disabled() && !script->m_scheduled.exchange(true, std::memory_order_acq_rel)) {
+			m_ready.push(script);
+		}
+	}
+
+	void fiber_manager::reclaim(fiber* script) {
+		if (script->take_park_claim()) {
+			m_timers.cancel(script->m_timer);
+		}
+	}
+
+	void fiber_manager::reap(fiber* script) {
+		if (!m_auto_reap.load(std::memory_order_relaxed)) return;
+		m_finished.push(script);
+
+		// Reaping takes m_Mutex, which add() and the control calls also need, and makes the
+		// next registry read rebuild its snapshot. Workers batch it at most once per interval.
+		constexpr auto reap_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::milliseconds(1)).count();
+		auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+		if (now < m_next_reap.load(std::memory_order_relaxed)) return;
+
+		std::unique_lock<std::mutex> lock(m_Mutex, std::try_to_lock);
+		if (!lock.owns_lock()) return;
+		m_next_reap.store(now + reap_interval, std::memory_order_relaxed);
+		reap_finished();
+	}
+
+	void fiber_manager::reap_finished() {
+		if (m_finished.empty()) return;
+
+		for (auto* script = m_finished.take_all(); script;) {
+			auto* next = script->m_next_ready;
+			// Already released by resize(), which keeps it alive until stop().
+			if (script->handle()) {
+				if (!script->is_disabled() && !script->is_suspended()) --m_active_fibers;
+				VE_TRACE(1, trace_type::fiber_terminate, script->trace_id(), 0);
+				release(script);
+				retire(unregister(script));
+			}
+			script = next;
+		}
+		collect();
+	}
+
+	fiber_manager::registry_snapshot* fiber_manager::current_snapshot() {
+		if (auto* snapshot = m_snapshot.load(std::memory_order_seq_cst)) {
+			return snapshot;
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		auto* snapshot = m_snapshot.load(std::memory_order_relaxed);
+		if (!snapshot) {
+			auto built = std::make_unique<registry_snapshot>();
+			built->fibers.reserve(m_fibers.size());
+			for (const auto& script : m_fibers) {
+				built->fibers.push_back(script.get());
+			}
+			snapshot = built.release();
+			m_snapshot.store(snapshot, std::memory_order_seq_cst);
+		}
+		collect();
+		return snapshot;
+	}
+
+	void fiber_manager::invalidate_snapshot() {
+		if (auto* stale = m_snapshot.exchange(nullptr, std::memory_order_seq_cst)) {
+			m_limbo_snapshots.emplace_back(m_epochs.retire(), stale);
+		}
+	}
+
+	void fiber_manager::retire(std::unique_ptr<fiber> script) {
+		// Any snapshot listing it was retired by release(), so this stamp is the later one.
+		m_limbo.emplace_back(m_epochs.retire(), std::move(script));
+	}
+
+	void fiber_manager::collect() {
+		if (m_limbo.empty() && m_limbo_snapshots.empty()) return;
+
+		auto oldest = m_epochs.oldest_pinned();
+		std::erase_if(m_limbo_snapshots, [oldest](const auto& entry) { return entry.first < oldest; });
+		std::erase_if(m_limbo, [oldest](const auto& entry) { return entry.first < oldest; });
+	}
+
+	void fiber_manager::set_auto_reap(bool enabled) {
+		m_auto_reap.store(enabled, std::memory_order_relaxed);
+	}
+
+	void fiber_manager::forget(fiber* script) {
+		for (auto* pending = m_remote.take_all(); pending;) {
+			auto* next = pending->m_next_ready;
+			reclaim(pending);
+			m_ready.push(pending);
+			pending = next;
+		}
+		unqueue(script);
+	}
+
+	void fiber_manager::unqueue(fiber* script) {
+		if (m_scheduler) {
+			return;
+		}
+
+		// Only fibers parked in our own queues can be taken back eagerly; anything still in
+		// the remote inbox is dropped lazily by requeue().
+		if (script->m_ready_hook.linked || script->m_timer.is_linked()) {
+			m_ready.remove(script);
+			m_timers.cancel(script->m_timer);
+			script->m_scheduled.store(false, std::memory_order_release);
+		}
+	}
+
+    void fiber_manager::resize(std::size_t new_size) {
+        // The pass holds m_pass_mutex, and the calling fiber may be one of those removed.
+        if (in_pass()) {
+            defer(control_command::kind::resize, new_size);
+            return;
+        }
+
+        pass_lock pass(*this);
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        resize_locked(new_size);
+    }
+
+    void fiber_manager::resize_locked(std::size_t new_size) {
+        if (new_size == m_fibers.size()) {
+            if (m_verbose) std::cout << "[FiberManager] Taille inchange.";
+            return;
+        }
+
+        if (new_size > m_fibers.size()) {
+            std::size_t fibers_to_add = new_size - m_fibers.size();
+            for (std::size_t i = 0; i < fibers_to_add; ++i) {
+                auto fiber_name = "Fiber_" + std::to_string(m_fibers.size() + i);
+                auto script = std::make_unique<fiber>(fiber_name, [] {
+                    while (true) {
+                        fiber::current()->sleep();
+                    }
+                    });
+                if (m_verbose) std::cout << "Ajout de la fibre : " + fiber_name;
+                schedule(adopt(std::move(script)));
+            }
+        }
+        else {
+            std::size_t fibers_to_remove = m_fibers.size() - new_size;
+            for (auto it = m_fibers.rbegin(); fibers_to_remove > 0 && it != m_fibers.rend(); ++it) {
+                if ((*it)->is_disabled()) {
+                    if (m_verbose) std::cout << "Fibre dj dsactive : " + (*it)->name() + "\n";
+                }
+                else {
+                    (*it)->terminate();
+
+                    if ((*it)->is_disabled()) {
+                        if (m_verbose) std::cout << "Fibre termine : " + (*it)->name() + "\n";
+                        --m_active_fibers;
+                        fibers_to_remove--;
+                    }
+                }
+            }
+
+            for (auto it = m_fibers.begin() + new_size; it != m_fibers.end(); ++it) {
+                release(it->get());
+                if (m_scheduler) {
+                    // Workers may still hold these in their queues, keep them alive until stop().
+                    m_retired.push_back(std::move(*it));
+                }
+                else {
+                    forget(it->get());
+                    retire(std::move(*it));
+                }
+            }
+            m_fibers.resize(new_size);
+            collect();
+        }
+        if (m_verbose) std::cout << "Redimensionnement complet : taille actuelle = " + std::to_string(m_fibers.size());
+    }
+
+	fiber_handle fiber_manager::add(std::unique_ptr<fiber> script) {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		if (!script) throw std::invalid_argument("Fiber script is null.");
+
+		reap_finished();
+		auto* added = adopt(std::move(script));
+		schedule(added);
+
+		if (m_fiber_added_callback) {
+			m_fiber_added_callback(added);
+		}
+		return added->handle();
+	}
+
+	fiber_handle fiber_manager::add(fiber* script) {
+		if (!script) throw std::invalid_argument("Fiber script is null.");
+
+		return add(std::unique_ptr<fiber>(script));
+	}
+
+	std::vector<fiber_handle> fiber_manager::add(const std::vector<std::pair<std::string, std::function<void()>>>& fibers) {
+		std::vector<std::unique_ptr<fiber>> scripts;
+		scripts.reserve(fibers.size());
+		for (const auto& [name, func] : fibers) {
+			scripts.push_back(std::make_unique<fiber>(name, func));
+		}
+		return add_bulk(scripts).handles;
+	}
+
+	fiber_manager::bulk_result fiber_manager::add_bulk(std::span<std::unique_ptr<fiber>> fibers) {
+		bulk_result result{ {}, 0, 0 };
+		result.handles.reserve(fibers.size());
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		reap_finished();
+		m_fibers.reserve(m_fibers.size() + fibers.size());
+		m_handles.reserve(fibers.size());
+
+		std::vector<fiber*> runnable;
+		runnable.reserve(fibers.size());
+		for (auto& script : fibers) {
+			if (!script) {
+				result.handles.emplace_back();
+				++result.rejected;
+				continue;
+			}
+
+			auto* added = adopt(std::move(script));
+			result.handles.push_back(added->handle());
+			++result.accepted;
+			if (!added->is_disabled() && !added->is_suspended() && !added->is_parked()
+				&& !added->m_scheduled.exchange(true, std::memory_order_acq_rel)) {
+				runnable.push_back(added);
+			}
+
+			if (m_fiber_added_callback) {
+				m_fiber_added_callback(added);
+			}
+		}
+
+		if (m_scheduler) {
+			m_scheduler->submit(runnable);
+		}
+		else {
+			// The pass picks them up from the inbox, m_ready is its own.
+			for (auto* script : runnable) {
+				push_remote(script);
+			}
+		}
+		return result;
+	}
+
+	fiber_handle fiber_manager::add(const std::string& name, std::function<void()> func) {
+		return add(std::make_unique<fiber>(name, std::move(func)));
+	}
+
+	fiber* fiber_manager::adopt(std::unique_ptr<fiber> script) {
+		auto* added = script.get();
+		added->m_manager = this;
+		added->m_handle = m_handles.insert(added);
+		if (m_name_index_enabled) {
+			m_name_index[added->name()].push_back(added->m_handle);
+		}
+		added->m_registry_index = m_fibers.size();
+		added->m_registry_order = m_next_registry_order++;
+		m_fibers.push_back(std::move(script));
+		++m_active_fibers;
+		invalidate_snapshot();
+		VE_TRACE_NAME(1, added->trace_id(), added->name());
+		VE_TRACE(1, trace_type::fiber_add, added->trace_id(), static_cast<std::uint32_t>(added->priority()));
+		return added;
+	}
+
+	void fiber_manager::release(fiber* script) {
+		if (m_name_index_enabled) {
+			auto it = m_name_index.find(script->name());
+			if (it != m_name_index.end()) {
+				auto& handles = it->second;
+				handles.erase(std::remove(handles.begin(), handles.end(), script->m_handle), handles.end());
+				if (handles.empty()) m_name_index.erase(it);
+			}
+		}
+		m_handles.erase(script->m_handle);
+		script->m_handle = {};
+		invalidate_snapshot();
+	}
+
+	std::unique_ptr<fiber> fiber_manager::unregister(fiber* script) {
+		auto index = script->m_registry_index;
+		auto owned = std::move(m_fibers[index]);
+		if (index + 1 != m_fibers.size()) {
+			m_fibers[index] = std::move(m_fibers.back());
+			m_fibers[index]->m_registry_index = index;
+		}
+		m_fibers.pop_back();
+		return owned;
+	}
+
+	void fiber_manager::cleanup() {
+		require_outside_pass("cleanup");
+		stop();
+
+		pass_lock pass(*this);
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		for (auto& fiber : m_fibers) {
+			if (!fiber->is_disabled()) {
+				fiber->terminate();
+				if (m_verbose) std::cout << "Terminated fiber: " + fiber->name();
+			}
+		}
+
+		m_remote.take_all();
+		m_finished.take_all();
+		while (m_ready.pop()) {}
+		m_timers.clear([](timer_node&) {});
+		for (auto& fiber : m_fibers) {
+			release(fiber.get());
+		}
+		for (auto& fiber : m_fibers) {
+			retire(std::move(fiber));
+		}
+		m_fibers.clear();
+		collect();
+		m_active_fibers = 0;
+
+		if (m_cleanup_callback) {
+			m_cleanup_callback();
+		}
+		if (m_verbose) std::cout << "[FiberManager] All fibers cleaned up.";
+	}
+
+    void fiber_manager::suspend(const std::string& name) {
+        post(control_command::kind::suspend, find_handle(name));
+    }
+
+    void fiber_manager::suspend(fiber_handle handle) {
+        post(control_command::kind::suspend, handle);
+    }
+
+    void fiber_manager::resume(const std::string& name) {
+        post(control_command::kind::resume, find_handle(name));
+    }
+
+    void fiber_manager::resume(fiber_handle handle) {
+        post(control_command::kind::resume, handle);
+    }
+
+    void fiber_manager::terminate(const std::string& name) {
+        post(control_command::kind::terminate, find_handle(name));
+    }
+
+    void fiber_manager::terminate(fiber_handle handle) {
+        post(control_command::kind::terminate, handle);
+    }
+
+    void fiber_manager::suspend_fiber(fiber* target_fiber) {
+        if (target_fiber && !target_fiber->is_suspended()) {
+            target_fiber->suspend();
+            unqueue(target_fiber);
+            VE_TRACE(1, trace_type::fiber_suspend, target_fiber->trace_id(), 0);
+            if (m_verbose) std::cout << "Fiber suspended: " + target_fiber->name();
+            --m_active_fibers;
+
+            if (m_fiber_suspended_callback) {
+                m_fiber_suspended_callback(target_fiber);
+            }
+        }
+    }
+
+    void fiber_manager::resume_fiber(fiber* target_fiber) {
+        if (target_fiber && target_fiber->is_suspended()) {
+            target_fiber->resume();
+            VE_TRACE(1, trace_type::fiber_resume, target_fiber->trace_id(), 0);
+            if (m_verbose) std::cout << "Fiber resumed: " + target_fiber->name();
+            ++m_active_fibers;
+            schedule(target_fiber);
+
+            if (m_fiber_resumed_callback) {
+                m_fiber_resumed_callback(target_fiber);
+            }
+        }
+    }
+
+    void fiber_manager::terminate_fiber(fiber* target_fiber) {
+        if (target_fiber && !target_fiber->is_disabled()) {
+            target_fiber->terminate();
+            unqueue(target_fiber);
+            VE_TRACE(1, trace_type::fiber_terminate, target_fiber->trace_id(), 0);
+            if (m_verbose) std::cout << "Fiber terminated: " + target_fiber->name();
+            --m_active_fibers;
+
+            if (m_fiber_terminated_callback) {
+                m_fiber_terminated_callback(target_fiber);
+            }
+        }
+    }
+
+    void fiber_manager::list_active_fibers() {
+        std::cout << "Listing all active fibers:\n";
+        for_each_registered([](fiber* script) {
+            if (!script->is_disabled()) {
+                std::cout << "Active fiber: " + script->name() + "\n";
+            }
+            });
+    }
+
+    void fiber_manager::start(std::size_t worker_count) {
+        launch(std::make_unique<scheduler>(std::max<std::size_t>(worker_count, 1)));
+    }
+
+    void fiber_manager::start(std::size_t worker_count, const cpu_topology& topology, bool pin_threads) {
+        launch(std::make_unique<scheduler>(std::max<std::size_t>(worker_count, 1), scheduler::worker_placement{ topology, pin_threads }));
+    }
+
+    void fiber_manager::launch(std::unique_ptr<scheduler> workers) {
+        require_outside_pass("start");
+        pass_lock pass(*this);
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (m_scheduler) {
+            throw std::logic_error("Fiber manager is already running worker threads.");
+        }
+
+        m_scheduler = std::move(workers);
+        m_scheduler->set_idle_policy(m_idle_policy.load());
+        m_active_scheduler.store(m_scheduler.get(), std::memory_order_seq_cst);
+
+        // Everything queued for the single-threaded pass moves over as is.
+        for (auto* script = m_remote.take_all(); script;) {
+            auto* next = script->m_next_ready;
+            reclaim(script);
+            m_scheduler->submit(script);
+            script = next;
+        }
+        while (auto* script = m_ready.pop()) {
+            m_scheduler->submit(script);
+        }
+        m_timers.clear([this](timer_node& node) {
+            auto* script = static_cast<fiber*>(node.data);
+            if (script->expire_park_timer()) m_scheduler->submit(script);
+            });
+
+        for (auto& script : m_fibers) {
+            schedule(script.get());
+        }
+        m_scheduler->start();
+        if (m_verbose) std::cout << "[FiberManager] Started " + std::to_string(m_scheduler->worker_count()) + " worker threads.\n";
+    }
+
+    void fiber_manager::stop() {
+        require_outside_pass("stop");
+        std::unique_ptr<scheduler> running;
+        {
+            pass_lock pass(*this);
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            running = std::move(m_scheduler);
+            m_active_scheduler.store(nullptr, std::memory_order_release);
+        }
+
+        if (!running) {
+            return;
+        }
+
+        // Workers can call back into the manager from fiber bodies, so join them unlocked.
+        auto queued = running->stop();
+
+        pass_lock pass(*this);
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (auto* script : queued) {
+            if (script->is_disabled()) {
+                script->m_scheduled.store(false, std::memory_order_release);
+            }
+            else {
+                m_ready.push(script);
+            }
+        }
+        // Before m_retired goes, a retired fiber can still be waiting to be reaped.
+        reap_finished();
+        for (auto& script : m_retired) {
+            retire(std::move(script));
+        }
+        m_retired.clear();
+        collect();
+        // A driver parked in wait_for_work() has fibers to run again.
+        m_idle.notify();
+    }
+
+    std::vector<ve::worker_stats> fiber_manager::worker_stats() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (!m_scheduler) return {};
+        return m_scheduler->get_stats();
+    }
+
+    bool fiber_manager::is_multithreaded() {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_scheduler != nullptr;
+    }
+
+    void fiber_manager::wait_for_work() {
+        if (in_pass()) {
+            return;
+        }
+
+        auto policy = m_idle_policy.load();
+        auto deadline = std::chrono::steady_clock::now() + policy.max_park;
+        std::size_t round = 0;
+        {
+            // Another thread is running a pass, so there is work.
+            pass_lock pass(*this, std::try_to_lock);
+            if (!pass.owns_lock()) return;
+
+            if (m_scheduler) {
+                // The workers run the fibers, this thread only needs to come back eventually.
+                round = std::numeric_limits<std::size_t>::max();
+            }
+            else {
+                if (m_ready.size() > 0 || !m_remote.empty()) {
+                    m_idle_rounds = 0;
+                    return;
+                }
+                if (auto next = m_timers.next_deadline()) deadline = std::min(deadline, *next);
+                round = m_idle_rounds++;
+            }
+        }
+
+        if (round < policy.spin_rounds) {
+            cpu_relax();
+            return;
+        }
+        if (round < std::size_t{ policy.spin_rounds } + policy.yield_rounds) {
+            std::this_thread::yield();
+            return;
+        }
+
+        auto ticket = m_idle.prepare();
+        if (!m_remote.empty() || !m_commands.empty()) {
+            m_idle.cancel();
+            return;
+        }
+        // Stays past the spin and yield rounds, so an idle driver parks again right away.
+        m_idle.wait(ticket, deadline);
+    }
+
+    void fiber_manager::set_idle_policy(const idle_policy& policy) {
+        m_idle_policy.store(policy);
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (m_scheduler) m_scheduler->set_idle_policy(policy);
+        }
+        m_idle.notify();
+    }
+
+    idle_policy fiber_manager::get_idle_policy() const {
+        return m_idle_policy.load();
+    }
+
+    void fiber_manager::push_remote(fiber* script) {
+        m_remote.push(script);
+        m_idle.notify();
+    }
+
+    void fiber_manager::set_aging_threshold(std::optional<std::size_t> dispatches) {
+        if (in_pass()) {
+            defer(control_command::kind::set_aging_threshold, dispatches);
+            return;
+        }
+
+        pass_lock pass(*this);
+        m_ready.set_aging_threshold(dispatches);
+    }
+
+    void fiber_manager::pin(const std::string& name, std::size_t worker) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (auto* target_fiber = find_locked(name)) {
+            target_fiber->pin(worker);
+        }
+    }
+
+    void fiber_manager::pin(fiber_handle handle, std::size_t worker) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (auto* target_fiber = m_handles.get(handle)) {
+            target_fiber->pin(worker);
+        }
+    }
+
+    void fiber_manager::schedule(fiber* script) {
+        if (script->is_disabled() || script->is_suspended() || script->is_parked()) {
+            return;
+        }
+
+        if (!script->m_scheduled.exchange(true, std::memory_order_acq_rel)) {
+            if (m_scheduler) {
+                m_scheduler->submit(script);
+            }
+            else {
+                // Callers need not hold the pass, so go through the inbox it drains.
+                push_remote(script);
+            }
+        }
+    }
+
+    void fiber_manager::wake(fiber* script) {
+        // Lock-free on purpose: this runs on the job submission path and from fiber bodies
+        // while initialize() holds m_Mutex.
+        if (script->claim_park_timer()) {
+            // Still queued in a timer only its owner may touch, so send it back there.
+            VE_TRACE(2, trace_type::wake, script->trace_id(), 0);
+            auto* active = m_active_scheduler.load(std::memory_order_seq_cst);
+            if (active && script->park_timer_owner() >= 0) {
+                active->submit_claimed(script);
+            }
+            else {
+                push_remote(script);
+            }
+            return;
+        }
+
+        if (script->is_disabled() || script->is_suspended() || script->is_parked()) {
+            return;
+        }
+
+        if (!script->m_scheduled.exchange(true, std::memory_order_seq_cst)) {
+            VE_TRACE(2, trace_type::wake, script->trace_id(), 0);
+            if (auto* active = m_active_scheduler.load(std::memory_order_seq_cst)) {
+                active->submit(script);
+            }
+            else {
+                push_remote(script);
+            }
+        }
+    }
+
+    fiber* fiber_manager::find(const std::string& name) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return find_locked(name);
+    }
+
+    fiber* fiber_manager::find_locked(const std::string& name) {
+        if (m_name_index_enabled) {
+            auto it = m_name_index.find(name);
+            return it != m_name_index.end() ? m_handles.get(it->second.front()) : nullptr;
+        }
+
+        // m_fibers is not in the order added, so keep the earliest match.
+        fiber* first = nullptr;
+        for (auto& fiber : m_fibers) {
+            if (fiber->name() == name && (!first || fiber->m_registry_order < first->m_registry_order)) {
+                first = fiber.get();
+            }
+        }
+        return first;
+    }
+
+    fiber* fiber_manager::get(fiber_handle handle) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_handles.get(handle);
+    }
+
+    fiber_handle fiber_manager::find_handle(const std::string& name) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto* target_fiber = find_locked(name);
+        return target_fiber ? target_fiber->handle() : fiber_handle{};
+    }
+
+    void fiber_manager::set_name_index(bool enabled) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (enabled == m_name_index_enabled) return;
+
+        m_name_index_enabled = enabled;
+        m_name_index.clear();
+        if (enabled) {
+            // In the order added, so the first fiber under a name is still found first.
+            std::vector<fiber*> added;
+            added.reserve(m_fibers.size());
+            for (auto& fiber : m_fibers) {
+                added.push_back(fiber.get());
+            }
+            std::sort(added.begin(), added.end(), [](const fiber* a, const fiber* b) {
+                return a->m_registry_order < b->m_registry_order;
+                });
+            for (auto* fiber : added) {
+                m_name_index[fiber->name()].push_back(fiber->handle());
+            }
+        }
+    }
+
+    void fiber_manager::set_fiber_added_callback(std::function<void(fiber*)> callback) {
+        m_fiber_added_callback = std::move(callback);
+    }
+
+    void fiber_manager::set_fiber_suspended_callback(std::function<void(fiber*)> callback) {
+        m_fiber_suspended_callback = std::move(callback);
+    }
+
+    void fiber_manager::set_fiber_resumed_callback(std::function<void(fiber*)> callback) {
+        m_fiber_resumed_callback = std::move(callback);
+    }
+
+    void fiber_manager::set_fiber_terminated_callback(std::function<void(fiber*)> callback) {
+        m_fiber_terminated_callback = std::move(callback);
+    }
+
+    void fiber_manager::set_cleanup_callback(std::function<void()> callback) {
+        m_cleanup_callback = std::move(callback);
+    }
+
+    void fiber_manager::set_verbosity(bool verbose) {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_verbose = verbose;
+    }
+
+    std::vector<fiber_runtime> fiber_manager::runtime_snapshot() {
+        std::vector<fiber_runtime> snapshot;
+        for_each_registered([&](fiber* script) {
+            snapshot.push_back(script->runtime());
+            });
+        return snapshot;
+    }
+
+    fiber_runtime fiber_manager::runtime_snapshot(const std::string& prefix) {
+        fiber_runtime total;
+        total.name = prefix;
+        for_each_registered([&](fiber* script) {
+            if (script->name().compare(0, prefix.size(), prefix) == 0) {
+                total += script->runtime();
+            }
+            });
+        return total;
+    }
+
+    std::vector<stack_profile> fiber_manager::stack_profiles() {
+        auto profiles = stack_profiler::instance().profiles();
+        for_each_registered([&](fiber* script) {
+            auto high_water = script->stack_high_water();
+            if (!high_water) return;
+
+            auto key = stack_profiler::key_of(script->name());
+            auto it = std::find_if(profiles.begin(), profiles.end(), [&](const auto& profile) { return profile.name == key; });
+            if (it == profiles.end()) {
+                profiles.push_back({ std::string(key), 0, 0, 0, 0, std::nullopt });
+                it = profiles.end() - 1;
+            }
+            it->mean_high_water = (it->mean_high_water * it->samples + *high_water) / (it->samples + 1);
+            ++it->samples;
+            it->max_high_water = std::max(it->max_high_water, *high_water);
+            it->stack_size = std::max(it->stack_size, script->m_stack.size);
+            });
+        return profiles;
+    }
+
+    std::shared_ptr<fiber_manager> get_fiber_manager() { return g_fiber_manager; }
 }
\ No newline at end of file
@@ -1,48 +1,271 @@
-#pragma once
-#include "../../stdafx.hpp"
-
-namespace ve {
-	class fiber_manager : public std::enable_shared_from_this<fiber_manager> {
-	public:
-		explicit fiber_manager();
-
-		void initialize();
-		void add(std::unique_ptr<fiber> script);
-		void add(fiber* script);
-		void add(const std::vector<std::pair<std::string, std::function<void()>>>& fibers);
-		void add(const std::string& name, std::function<void()> func);
-		void cleanup();
-
-		void suspend(const std::string& name);
-		void resume(const std::string& name);
-		void terminate(const std::string& name);
-		void list_active_fibers();
-
-		void resize(std::size_t new_size);
-
-		void set_fiber_added_callback(std::function<void(fiber*)> callback);
-		void set_fiber_suspended_callback(std::function<void(fiber*)> callback);
-		void set_fiber_resumed_callback(std::function<void(fiber*)> callback);
-		void set_fiber_terminated_callback(std::function<void(fiber*)> callback);
-		void set_cleanup_callback(std::function<void()> callback);
-
-		void set_verbosity(bool verbose);
-
-	public:
-		fiber* find(const std::string& name);
-
-	private:
-		bool m_main_fiber_initialized;
-		std::size_t m_active_fibers;
-		std::vector<std::unique_ptr<fiber>> m_fibers;
-		std::mutex m_Mutex;
-
-		std::function<void(fiber*)> m_fiber_added_callback;
-		std::function<void(fiber*)> m_fiber_suspended_callback;
-		std::function<void(fiber*)> m_fiber_resumed_callback;
-		std::function<void(fiber*)> m_fiber_terminated_callback;
-		std::function<void()> m_cleanup_callback;
-	};
-
-	std::shared_ptr<fiber_manager> get_fiber_manager();
-}
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	class scheduler;
+	template <typename T> class fiber_future;
+	template <typename T> class fiber_promise;
+
+	class fiber_manager : public std::enable_shared_from_this<fiber_manager> {
+	public:
+		explicit fiber_manager();
+		~fiber_manager();
+
+		// Runs one scheduling pass. Only the pass itself is serialized, so fibers can call
+		// back into the manager. From a fiber during a pass, a nested initialize() returns
+		// right away, resize() and set_aging_threshold() take effect once the pass ends, and
+		// start(), stop() and cleanup() throw std::logic_error.
+		void initialize();
+		fiber_handle add(std::unique_ptr<fiber> script);
+		fiber_handle add(fiber* script);
+		std::vector<fiber_handle> add(const std::vector<std::pair<std::string, std::function<void()>>>& fibers);
+		fiber_handle add(const std::string& name, std::function<void()> func);
+
+		struct bulk_result {
+			// One per input, in order. Null inputs get an invalid handle.
+			std::vector<fiber_handle> handles;
+			std::size_t accepted;
+			std::size_t rejected;
+		};
+
+		// Adopts every non-null fiber under a single lock and makes them runnable in one
+		// step. Build the fibers beforehand, their stacks are allocated outside the lock.
+		bulk_result add_bulk(std::span<std::unique_ptr<fiber>> fibers);
+
+		// Starts `func` on a new fiber and returns a future for its result. What it throws
+		// ends up in the future instead of on std::cerr.
+		template <typename F>
+		fiber_future<std::invoke_result_t<F&>> spawn(std::string name, F func, std::optional<std::size_t> stack_size = std::nullopt, int priority = 0) {
+			fiber_promise<std::invoke_result_t<F&>> promise;
+			auto future = promise.get_future();
+			add(std::make_unique<fiber>(std::move(name), [promise = std::move(promise), func = std::move(func)]() mutable {
+				promise.fulfill(func);
+				}, stack_size, priority));
+			return future;
+		}
+		void cleanup();
+
+		// Queued on a lock-free inbox and applied right away unless a pass, stop(), resize()
+		// or the like holds the manager, in which case they are applied as soon as it is done. A fiber that suspends or
+		// terminates itself keeps running until it next yields.
+		void suspend(const std::string& name);
+		void suspend(fiber_handle handle);
+		void resume(const std::string& name);
+		void resume(fiber_handle handle);
+		void terminate(const std::string& name);
+		void terminate(fiber_handle handle);
+		// Reads a snapshot of the registry, see runtime_snapshot().
+		void list_active_fibers();
+
+		void resize(std::size_t new_size);
+
+		void start(std::size_t worker_count = std::thread::hardware_concurrency());
+		// Places the workers on `topology`, see scheduler::worker_placement. Pass
+		// cpu_topology::detect() for the machine's own layout.
+		void start(std::size_t worker_count, const cpu_topology& topology, bool pin_threads = true);
+		void stop();
+		// Empty while single-threaded.
+		std::vector<ve::worker_stats> worker_stats();
+		bool is_multithreaded();
+		void pin(const std::string& name, std::size_t worker);
+		void pin(fiber_handle handle, std::size_t worker);
+
+		void wake(fiber* script);
+
+		// Hands over a fiber whose function has returned, from the thread that ticked it.
+		// The fiber must not be touched afterwards, it may already be destroyed.
+		void reap(fiber* script);
+
+		// On by default: finished fibers are destroyed and their stacks recycled, within
+		// the pass that finished them when single-threaded. With worker threads that happens
+		// at most once a millisecond, or at the next initialize(), add() or stop(). Their
+		// handles stop resolving, so only keep handles or futures to fibers, not pointers.
+		void set_auto_reap(bool enabled);
+
+		void set_aging_threshold(std::optional<std::size_t> dispatches);
+
+		// Call between initialize() passes on the thread that drives the fibers. Returns at
+		// once while a fiber is runnable. Otherwise it spins, yields and then parks as the idle
+		// policy says, until a fiber is woken, a timer is due or I/O completes. With worker
+		// threads it just parks for the policy's max_park.
+		void wait_for_work();
+
+		// Used by wait_for_work() and by the worker threads. Can be changed at any time, e.g.
+		// to idle_policy::power() while the application is in the background.
+		void set_idle_policy(const idle_policy& policy);
+		idle_policy get_idle_policy() const;
+
+		void set_fiber_added_callback(std::function<void(fiber*)> callback);
+		void set_fiber_suspended_callback(std::function<void(fiber*)> callback);
+		void set_fiber_resumed_callback(std::function<void(fiber*)> callback);
+		void set_fiber_terminated_callback(std::function<void(fiber*)> callback);
+		void set_cleanup_callback(std::function<void()> callback);
+
+		void set_verbosity(bool verbose);
+
+		// Runtime accounting of every fiber currently added, and the same summed over the
+		// fibers whose name starts with `prefix` (e.g. "FiberPool_"). Like the other
+		// registry reads these go through an epoch-protected snapshot that is rebuilt on the
+		// first read after a fiber was added or removed, and otherwise take no lock.
+		std::vector<fiber_runtime> runtime_snapshot();
+		fiber_runtime runtime_snapshot(const std::string& prefix);
+
+		// stack_profiler's profiles, with the current high-water mark of every fiber added
+		// here counted in as one more sample.
+		std::vector<stack_profile> stack_profiles();
+
+		// Returns nullptr once the fiber has been removed, even if its slot was reused.
+		fiber* get(fiber_handle handle);
+
+		// By-name lookups go through a hash index unless it is turned off, in which case
+		// they scan every fiber. Names need not be unique; the first fiber added wins.
+		fiber_handle find_handle(const std::string& name);
+		void set_name_index(bool enabled);
+
+	public:
+		// Safe from any thread, also from fibers during a pass. The fiber may be reaped once
+		// it finishes, see set_auto_reap().
+		fiber* find(const std::string& name);
+
+	private:
+		struct control_command {
+			enum class kind : std::uint8_t {
+				suspend,
+				resume,
+				terminate,
+				// Called from a fiber during a pass, applied once it ends.
+				resize,
+				set_aging_threshold,
+			};
+
+			kind type;
+			fiber_handle target;
+			control_command* next{};
+			// The argument of resize and set_aging_threshold.
+			std::optional<std::size_t> value;
+		};
+
+		// Holds m_pass_mutex. A command posted meanwhile finds it taken and is left queued, so
+		// the holder applies the inbox before letting go and flushes it again afterwards.
+		class pass_lock {
+		public:
+			explicit pass_lock(fiber_manager& manager);
+			pass_lock(fiber_manager& manager, std::try_to_lock_t);
+			~pass_lock();
+
+			bool owns_lock() const;
+
+		private:
+			fiber_manager& m_manager;
+			std::unique_lock<std::mutex> m_lock;
+		};
+
+		// The fibers registered when it was built. A fiber is only freed after every
+		// snapshot listing it has been retired, so a pinned reader can use them all.
+		struct registry_snapshot {
+			std::vector<fiber*> fibers;
+		};
+
+		template <typename Visit>
+		void for_each_registered(Visit visit) {
+			auto guard = m_epochs.pin();
+			for (auto* script : current_snapshot()->fibers) {
+				visit(script);
+			}
+		}
+
+		void run_pass();
+		// Whether the calling thread is running a pass, i.e. is one of its fibers.
+		bool in_pass() const;
+		void require_outside_pass(const char* operation) const;
+		void post(control_command::kind type, fiber_handle target);
+		void defer(control_command::kind type, std::optional<std::size_t> value);
+		void flush_commands();
+		void apply_commands();
+		fiber* find_locked(const std::string& name);
+		registry_snapshot* current_snapshot();
+		void invalidate_snapshot();
+		void retire(std::unique_ptr<fiber> script);
+		void collect();
+		void launch(std::unique_ptr<scheduler> workers);
+		fiber* adopt(std::unique_ptr<fiber> script);
+		void release(fiber* script);
+		// Takes it out of m_fibers in O(1) by moving the last entry into its slot.
+		std::unique_ptr<fiber> unregister(fiber* script);
+		void suspend_fiber(fiber* target_fiber);
+		void resume_fiber(fiber* target_fiber);
+		void terminate_fiber(fiber* target_fiber);
+		void schedule(fiber* script);
+		void requeue(fiber* script);
+		void reclaim(fiber* script);
+		void forget(fiber* script);
+		void unqueue(fiber* script);
+		void reap_finished();
+		// Expects m_pass_mutex and m_Mutex to be held.
+		void resize_locked(std::size_t new_size);
+		// Queues for the single-threaded pass and wakes a driver in wait_for_work().
+		void push_remote(fiber* script);
+
+		bool m_main_fiber_initialized;
+		std::size_t m_active_fibers;
+		// Not in the order added once fibers have been reaped, see fiber::m_registry_order.
+		std::vector<std::unique_ptr<fiber>> m_fibers;
+		std::uint64_t m_next_registry_order{ 0 };
+		handle_table m_handles;
+		std::unordered_map<std::string, std::vector<fiber_handle>> m_name_index;
+		bool m_name_index_enabled{ true };
+		bool m_verbose{ true };
+		// Guards the registry: m_fibers, m_handles, m_name_index, m_retired and the counts.
+		// Never held while a fiber runs.
+		std::mutex m_Mutex;
+		// Held for a whole pass and guards what only the pass touches: m_ready and m_timers.
+		// Swapping m_scheduler takes both. Taken before m_Mutex, through pass_lock except in
+		// flush_commands().
+		std::mutex m_pass_mutex;
+		std::atomic<std::thread::id> m_pass_owner{};
+		mpsc_queue<control_command, &control_command::next> m_commands;
+		epoch_domain m_epochs;
+		// Null once stale, the next reader rebuilds it.
+		std::atomic<registry_snapshot*> m_snapshot{ nullptr };
+		// Unlinked under m_Mutex, freed by collect() once no pinned reader can see them.
+		std::vector<std::pair<std::uint64_t, std::unique_ptr<registry_snapshot>>> m_limbo_snapshots;
+		std::vector<std::pair<std::uint64_t, std::unique_ptr<fiber>>> m_limbo;
+		std::unique_ptr<scheduler> m_scheduler;
+		std::atomic<scheduler*> m_active_scheduler{ nullptr };
+		std::vector<std::unique_ptr<fiber>> m_retired;
+		ready_queue m_ready;
+		mpsc_queue<fiber, &fiber::m_next_ready> m_remote;
+		// Finished fibers waiting to be destroyed.
+		mpsc_queue<fiber, &fiber::m_next_ready> m_finished;
+		std::atomic<bool> m_auto_reap{ true };
+		// steady_clock ticks before which workers leave finished fibers for later.
+		std::atomic<std::int64_t> m_next_reap{ 0 };
+		timer_wheel m_timers;
+		shared_idle_policy m_idle_policy;
+		idle_event m_idle;
+		// Rounds in a row wait_for_work() found nothing to run, under m_pass_mutex.
+		std::size_t m_idle_rounds{ 0 };
+
+		std::function<void(fiber*)> m_fiber_added_callback;
+		std::function<void(fiber*)> m_fiber_suspended_callback;
+		std::function<void(fiber*)> m_fiber_resumed_callback;
+		std::function<void(fiber*)> m_fiber_terminated_callback;
+		std::function<void()> m_cleanup_callback;
+	};
+
+	std::shared_ptr<fiber_manager> get_fiber_manager();
+
+	// fiber_manager::spawn() on the global manager.
+	template <typename F>
+	fiber_future<std::invoke_result_t<F&>> spawn(std::string name, F func, std::optional<std::size_t> stack_size = std::nullopt, int priority = 0) {
+		return get_fiber_manager()->spawn(std::move(name), std::move(func), stack_size, priority);
+	}
+
+	inline void fiber::unpark() {
+		if constexpr (runtime_stats_enabled) m_runtime.mark_runnable(cycle_clock::now());
+		m_parked.store(false, std::memory_order_seq_cst);
+		if (m_manager) {
+			m_manager->wake(this);
+		}
+	}
+}
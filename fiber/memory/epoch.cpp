@@ -0,0 +1,35 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	epoch_domain::guard epoch_domain::pin() {
+		// Counted before the slot is taken, so a writer that sees no readers also knows any
+		// reader still to come will only find what was published after its unlink.
+		m_pinned.fetch_add(1, std::memory_order_seq_cst);
+
+		// Spread threads over the slots so they rarely probe each other's.
+		auto start = std::hash<std::thread::id>{}(std::this_thread::get_id()) % max_readers;
+		while (true) {
+			auto epoch = m_epoch.load(std::memory_order_seq_cst);
+			for (std::size_t i = 0; i < max_readers; ++i) {
+				auto index = (start + i) % max_readers;
+				std::uint64_t expected = 0;
+				// An epoch that went stale in between only holds back more than needed.
+				if (m_slots[index].epoch.compare_exchange_strong(expected, epoch, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					return guard(this, index);
+				}
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	std::uint64_t epoch_domain::oldest_pinned() const {
+		auto oldest = std::numeric_limits<std::uint64_t>::max();
+		if (m_pinned.load(std::memory_order_seq_cst) == 0) return oldest;
+
+		for (const auto& slot : m_slots) {
+			auto epoch = slot.epoch.load(std::memory_order_seq_cst);
+			if (epoch != 0) oldest = std::min(oldest, epoch);
+		}
+		return oldest;
+	}
+}
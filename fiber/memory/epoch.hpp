@@ -0,0 +1,66 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Epoch-based reclamation. A reader pins the current epoch while it looks at shared
+	// objects. A writer that unlinks an object stamps it with retire() and frees it once
+	// oldest_pinned() has moved past that stamp, i.e. once no reader that could still have
+	// seen it is in.
+	class epoch_domain {
+	public:
+		// Readers that can be pinned at once; pin() waits for a slot beyond that.
+		static constexpr std::size_t max_readers = 64;
+
+		class guard {
+		public:
+			guard(guard&& other) noexcept
+				: m_domain(std::exchange(other.m_domain, nullptr)), m_slot(other.m_slot) {}
+
+			guard& operator=(guard&&) = delete;
+
+			~guard() {
+				if (m_domain) m_domain->unpin(m_slot);
+			}
+
+		private:
+			friend class epoch_domain;
+
+			guard(epoch_domain* domain, std::size_t slot)
+				: m_domain(domain), m_slot(slot) {}
+
+			epoch_domain* m_domain;
+			std::size_t m_slot;
+		};
+
+		epoch_domain() = default;
+		epoch_domain(const epoch_domain&) = delete;
+		epoch_domain& operator=(const epoch_domain&) = delete;
+
+		// Load the shared pointers only after this returns.
+		guard pin();
+
+		// Call after unlinking. Ends the current epoch and returns it as the stamp.
+		std::uint64_t retire() {
+			return m_epoch.fetch_add(1, std::memory_order_seq_cst);
+		}
+
+		// Objects stamped below this can be freed. No reader pinned means every one can.
+		std::uint64_t oldest_pinned() const;
+
+	private:
+		void unpin(std::size_t slot) {
+			m_slots[slot].epoch.store(0, std::memory_order_release);
+			m_pinned.fetch_sub(1, std::memory_order_release);
+		}
+
+		struct alignas(64) slot {
+			// 0 while free.
+			std::atomic<std::uint64_t> epoch{ 0 };
+		};
+
+		std::atomic<std::uint64_t> m_epoch{ 1 };
+		// Lets oldest_pinned() skip the slots while nobody reads, the common case.
+		std::atomic<std::size_t> m_pinned{ 0 };
+		std::array<slot, max_readers> m_slots;
+	};
+}
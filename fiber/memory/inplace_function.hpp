@@ -0,0 +1,127 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	template <typename Signature, std::size_t Capacity = 48>
+	class inplace_function;
+
+	// Move-only std::function replacement. Callables up to `Capacity` bytes that can be moved
+	// without throwing live inside the object, anything larger falls back to the heap. A
+	// lambda capturing a few pointers and a std::string or shared_ptr stays inline.
+	template <typename R, typename... Args, std::size_t Capacity>
+	class inplace_function<R(Args...), Capacity> {
+	public:
+		template <typename F>
+		static constexpr bool stores_inline = sizeof(F) <= Capacity
+			&& alignof(F) <= alignof(void*)
+			&& std::is_nothrow_move_constructible_v<F>;
+
+		inplace_function() noexcept = default;
+
+		inplace_function(std::nullptr_t) noexcept {}
+
+		template <typename F, typename D = std::decay_t<F>,
+			typename = std::enable_if_t<!std::is_same_v<D, inplace_function> && std::is_invocable_r_v<R, D&, Args...>>>
+		inplace_function(F&& func) {
+			if constexpr (std::is_pointer_v<D> || std::is_member_pointer_v<D> || is_std_function<D>::value) {
+				if (!func) return;
+			}
+			if constexpr (stores_inline<D>) {
+				::new (static_cast<void*>(m_storage)) D(std::forward<F>(func));
+			}
+			else {
+				::new (static_cast<void*>(m_storage)) D*(new D(std::forward<F>(func)));
+			}
+			m_ops = &ops_for<D>;
+		}
+
+		inplace_function(inplace_function&& other) noexcept {
+			if (other.m_ops) {
+				other.m_ops->relocate(other.m_storage, m_storage);
+				m_ops = std::exchange(other.m_ops, nullptr);
+			}
+		}
+
+		inplace_function& operator=(inplace_function&& other) noexcept {
+			if (this != &other) {
+				reset();
+				if (other.m_ops) {
+					other.m_ops->relocate(other.m_storage, m_storage);
+					m_ops = std::exchange(other.m_ops, nullptr);
+				}
+			}
+			return *this;
+		}
+
+		inplace_function& operator=(std::nullptr_t) noexcept {
+			reset();
+			return *this;
+		}
+
+		inplace_function(const inplace_function&) = delete;
+		inplace_function& operator=(const inplace_function&) = delete;
+
+		~inplace_function() {
+			reset();
+		}
+
+		explicit operator bool() const noexcept {
+			return m_ops != nullptr;
+		}
+
+		R operator()(Args... args) {
+			if (!m_ops) throw std::bad_function_call();
+			return m_ops->invoke(m_storage, std::forward<Args>(args)...);
+		}
+
+	private:
+		template <typename T>
+		struct is_std_function : std::false_type {};
+
+		template <typename T>
+		struct is_std_function<std::function<T>> : std::true_type {};
+
+		struct operations {
+			R (*invoke)(void* storage, Args&&... args);
+			// Move-constructs into `to` and destroys the source.
+			void (*relocate)(void* from, void* to) noexcept;
+			void (*destroy)(void* storage) noexcept;
+		};
+
+		template <typename F>
+		static F& target(void* storage) noexcept {
+			if constexpr (stores_inline<F>) return *std::launder(static_cast<F*>(storage));
+			else return **std::launder(static_cast<F**>(storage));
+		}
+
+		template <typename F>
+		static constexpr operations ops_for = {
+			[](void* storage, Args&&... args) -> R {
+				return std::invoke(target<F>(storage), std::forward<Args>(args)...);
+			},
+			[](void* from, void* to) noexcept {
+				if constexpr (stores_inline<F>) {
+					auto* source = std::launder(static_cast<F*>(from));
+					::new (to) F(std::move(*source));
+					source->~F();
+				}
+				else {
+					::new (to) F*(*std::launder(static_cast<F**>(from)));
+				}
+			},
+			[](void* storage) noexcept {
+				if constexpr (stores_inline<F>) std::launder(static_cast<F*>(storage))->~F();
+				else delete *std::launder(static_cast<F**>(storage));
+			}
+		};
+
+		void reset() noexcept {
+			if (m_ops) {
+				std::exchange(m_ops, nullptr)->destroy(m_storage);
+			}
+		}
+
+		alignas(void*) std::byte m_storage[Capacity];
+		const operations* m_ops = nullptr;
+	};
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Recycles fixed-size blocks for T through an intrusive per-thread free list. A thread
+	// that caches too many hands half of them to a shared list, and an empty thread cache
+	// refills from it in batches.
+	template <typename T>
+	class object_pool {
+	public:
+		static constexpr std::size_t thread_cache_depth = 64;
+
+		struct stats {
+			std::size_t allocated;
+			std::size_t in_use;
+			std::size_t cached;
+		};
+
+		static void* allocate() {
+			static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+			auto& shared = shared_state();
+			if (!t_closed) {
+				auto& local = t_cache;
+				if (!local.head) {
+					std::lock_guard<std::mutex> lock(shared.mutex);
+					for (std::size_t i = 0; i < thread_cache_depth / 2 && shared.head; ++i) {
+						auto* block = shared.head;
+						shared.head = block->next;
+						block->next = local.head;
+						local.head = block;
+						++local.count;
+					}
+				}
+				if (auto* block = local.head) {
+					local.head = block->next;
+					--local.count;
+					shared.in_use.fetch_add(1, std::memory_order_relaxed);
+					return block;
+				}
+			}
+
+			void* block = ::operator new(block_size);
+			shared.allocated.fetch_add(1, std::memory_order_relaxed);
+			shared.in_use.fetch_add(1, std::memory_order_relaxed);
+			return block;
+		}
+
+		static void deallocate(void* pointer) noexcept {
+			auto& shared = shared_state();
+			auto* block = static_cast<node*>(pointer);
+			shared.in_use.fetch_sub(1, std::memory_order_relaxed);
+
+			if (t_closed) {
+				std::lock_guard<std::mutex> lock(shared.mutex);
+				block->next = shared.head;
+				shared.head = block;
+				return;
+			}
+
+			auto& local = t_cache;
+			block->next = local.head;
+			local.head = block;
+			if (++local.count > thread_cache_depth) {
+				local.give_back(thread_cache_depth / 2);
+			}
+		}
+
+		static stats get_stats() {
+			auto& shared = shared_state();
+			auto allocated = shared.allocated.load(std::memory_order_relaxed);
+			auto in_use = std::min(shared.in_use.load(std::memory_order_relaxed), allocated);
+			return { allocated, in_use, allocated - in_use };
+		}
+
+	private:
+		struct node {
+			node* next;
+		};
+
+		static constexpr std::size_t block_size = sizeof(T) < sizeof(node) ? sizeof(node) : sizeof(T);
+
+		struct shared_list {
+			std::mutex mutex;
+			node* head{};
+			std::atomic<std::size_t> allocated{ 0 };
+			std::atomic<std::size_t> in_use{ 0 };
+		};
+
+		struct local_list {
+			node* head{};
+			std::size_t count{ 0 };
+
+			void give_back(std::size_t keep) {
+				auto& shared = shared_state();
+				std::lock_guard<std::mutex> lock(shared.mutex);
+				while (count > keep) {
+					auto* block = head;
+					head = block->next;
+					block->next = shared.head;
+					shared.head = block;
+					--count;
+				}
+			}
+
+			~local_list() {
+				t_closed = true;
+				give_back(0);
+			}
+		};
+
+		static shared_list& shared_state() {
+			// Never destroyed, blocks may be released by other statics during shutdown.
+			static auto* shared = new shared_list();
+			return *shared;
+		}
+
+		static inline thread_local local_list t_cache;
+		static inline thread_local bool t_closed = false;
+	};
+}
@@ -0,0 +1,356 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	namespace {
+		constexpr std::size_t thread_cache_depth = 8;
+
+		std::size_t page_size() {
+#if defined(_WIN32)
+			static const std::size_t size = [] {
+				SYSTEM_INFO info;
+				GetSystemInfo(&info);
+				return static_cast<std::size_t>(info.dwPageSize);
+			}();
+#else
+			static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+			return size;
+		}
+
+		// Page-aligned stack tops all land in the same cache sets, so every stack gives up a
+		// few cache lines at the top depending on where it was mapped.
+		std::size_t color_of(void* base) {
+			return ((reinterpret_cast<std::uintptr_t>(base) / page_size()) % 16) * 64;
+		}
+
+		// A guarded stack costs two kernel mappings. Stop guarding well before the process
+		// runs into the mapping limit, otherwise mmap itself starts failing.
+		std::size_t guard_budget() {
+#if defined(__linux__)
+			static const std::size_t budget = [] {
+				std::size_t limit = 65530;
+				if (auto* file = std::fopen("/proc/sys/vm/max_map_count", "r")) {
+					unsigned long value = 0;
+					if (std::fscanf(file, "%lu", &value) == 1 && value > 0) limit = value;
+					std::fclose(file);
+				}
+				return limit / 4;
+			}();
+			return budget;
+#else
+			return std::numeric_limits<std::size_t>::max();
+#endif
+		}
+	}
+
+	struct stack_cache {
+		std::array<std::vector<stack_pool::cached_stack>, stack_pool::class_count> stacks;
+		// The node every cached stack belongs to.
+		std::optional<std::uint32_t> node;
+
+		// Hands the cache back when the thread has moved to another node.
+		void follow(std::optional<std::uint32_t> current);
+
+		~stack_cache();
+	};
+
+	namespace {
+		thread_local stack_cache t_stack_cache;
+		// Fibers can still be destroyed by static destructors after this thread's cache is
+		// gone; those stacks go straight to the shared cache.
+		thread_local bool t_stack_cache_closed = false;
+	}
+
+	void stack_cache::follow(std::optional<std::uint32_t> current) {
+		if (current == node) return;
+		for (std::size_t i = 0; i < stacks.size(); ++i) {
+			stack_pool::instance().give_back(node, i, stacks[i], 0);
+		}
+		node = current;
+	}
+
+	stack_cache::~stack_cache() {
+		t_stack_cache_closed = true;
+		for (std::size_t i = 0; i < stacks.size(); ++i) {
+			stack_pool::instance().give_back(node, i, stacks[i], 0);
+		}
+	}
+
+	stack_pool& stack_pool::instance() {
+		// Never destroyed, fibers owned by other statics may release their stacks late.
+		static auto* pool = new stack_pool();
+		return *pool;
+	}
+
+	std::optional<std::size_t> stack_pool::class_of(std::size_t size) {
+		if (size > max_class_size) return std::nullopt;
+		auto rounded = std::bit_ceil(std::max(size, min_class_size));
+		return static_cast<std::size_t>(std::countr_zero(rounded / min_class_size));
+	}
+
+	stack_pool::class_cache& stack_pool::shared_cache(std::optional<std::uint32_t> node) {
+		std::size_t slot = node ? *node + 1 : 0;
+		if (m_cached.size() <= slot) m_cached.resize(slot + 1);
+		return m_cached[slot];
+	}
+
+	stack_allocation stack_pool::acquire(std::size_t size) {
+		auto node = current_numa_node();
+		auto index = class_of(size);
+		if (!index) {
+			auto rounded = (size + page_size() - 1) & ~(page_size() - 1);
+			auto* base = map(rounded);
+			if (node) bind_to_numa_node(base, rounded, *node);
+			m_oversized.fetch_add(1, std::memory_order_relaxed);
+			m_oversized_bytes.fetch_add(rounded, std::memory_order_relaxed);
+			return { base, rounded - color_of(base), node, true };
+		}
+
+		auto class_size = min_class_size << *index;
+		void* base = nullptr;
+		bool clean = true;
+		if (!t_stack_cache_closed) {
+			t_stack_cache.follow(node);
+			auto& local = t_stack_cache.stacks[*index];
+			if (local.empty()) {
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto& shared = shared_cache(node)[*index];
+				auto count = std::min(shared.size(), thread_cache_depth / 2);
+				local.insert(local.end(), shared.end() - count, shared.end());
+				shared.resize(shared.size() - count);
+			}
+			if (!local.empty()) {
+				base = local.back().base;
+				clean = local.back().clean;
+				local.pop_back();
+			}
+		}
+		else {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto& shared = shared_cache(node)[*index];
+			if (!shared.empty()) {
+				base = shared.back().base;
+				clean = shared.back().clean;
+				shared.pop_back();
+			}
+		}
+
+		if (!base) {
+			base = map(class_size);
+			if (node) bind_to_numa_node(base, class_size, *node);
+			m_mapped[*index].fetch_add(1, std::memory_order_relaxed);
+		}
+		m_in_use[*index].fetch_add(1, std::memory_order_relaxed);
+		return { base, class_size - color_of(base), node, clean };
+	}
+
+	void stack_pool::release(stack_allocation& stack, std::optional<std::size_t> high_water) {
+		if (!stack.base) return;
+
+		auto mapped_size = stack.size + color_of(stack.base);
+		auto index = class_of(mapped_size);
+		if (!index || (min_class_size << *index) != mapped_size) {
+			unmap(stack.base, mapped_size);
+			m_oversized.fetch_sub(1, std::memory_order_relaxed);
+			m_oversized_bytes.fetch_sub(mapped_size, std::memory_order_relaxed);
+			stack = {};
+			return;
+		}
+
+		m_in_use[*index].fetch_sub(1, std::memory_order_relaxed);
+		if (high_water && *high_water > retained_size) decommit(stack, *high_water);
+		cached_stack entry{ stack.base, high_water.has_value() };
+		if (!t_stack_cache_closed) t_stack_cache.follow(current_numa_node());
+		if (!t_stack_cache_closed && t_stack_cache.node == stack.node) {
+			auto& local = t_stack_cache.stacks[*index];
+			local.push_back(entry);
+			if (local.size() > thread_cache_depth) {
+				give_back(stack.node, *index, local, thread_cache_depth / 2);
+			}
+		}
+		else {
+			// A stack from another node goes back to that node's cache.
+			std::vector<cached_stack> single{ entry };
+			give_back(stack.node, *index, single, 0);
+		}
+		stack = {};
+	}
+
+	void stack_pool::give_back(std::optional<std::uint32_t> node, std::size_t index, std::vector<cached_stack>& stacks, std::size_t keep) {
+		if (stacks.size() <= keep) return;
+
+		auto class_size = min_class_size << index;
+		std::vector<void*> excess;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::size_t cached_bytes = 0;
+			for (const auto& classes : m_cached) {
+				for (std::size_t i = 0; i < classes.size(); ++i) {
+					cached_bytes += classes[i].size() * (min_class_size << i);
+				}
+			}
+
+			auto& shared = shared_cache(node)[index];
+			while (stacks.size() > keep) {
+				auto cached = stacks.back();
+				stacks.pop_back();
+				if (cached_bytes + class_size <= m_cache_limit) {
+					shared.push_back(cached);
+					cached_bytes += class_size;
+				}
+				else {
+					excess.push_back(cached.base);
+				}
+			}
+		}
+
+		for (auto* base : excess) {
+			unmap(base, class_size);
+			m_mapped[index].fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	void stack_pool::trim() {
+		std::vector<class_cache> cached;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			cached.swap(m_cached);
+		}
+
+		for (const auto& classes : cached) {
+			for (std::size_t i = 0; i < classes.size(); ++i) {
+				for (const auto& entry : classes[i]) {
+					unmap(entry.base, min_class_size << i);
+				}
+				m_mapped[i].fetch_sub(classes[i].size(), std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void stack_pool::set_cache_limit(std::size_t bytes) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_cache_limit = bytes;
+	}
+
+	void stack_pool::set_guard_pages(bool enabled) {
+		m_guard_pages.store(enabled, std::memory_order_relaxed);
+	}
+
+	std::size_t stack_pool::mapped_count() const {
+		auto count = m_oversized.load(std::memory_order_relaxed);
+		for (const auto& mapped : m_mapped) {
+			count += mapped.load(std::memory_order_relaxed);
+		}
+		return count;
+	}
+
+	stack_pool::stats stack_pool::get_stats() const {
+		stats result{};
+		result.classes.reserve(class_count);
+		for (std::size_t i = 0; i < class_count; ++i) {
+			auto class_size = min_class_size << i;
+			auto mapped = m_mapped[i].load(std::memory_order_relaxed);
+			auto in_use = std::min(m_in_use[i].load(std::memory_order_relaxed), mapped);
+			result.classes.push_back({ class_size, in_use, mapped - in_use });
+			result.mapped_bytes += mapped * class_size;
+			result.cached_bytes += (mapped - in_use) * class_size;
+		}
+		result.oversized_in_use = m_oversized.load(std::memory_order_relaxed);
+		result.mapped_bytes += m_oversized_bytes.load(std::memory_order_relaxed);
+		result.unguarded = m_unguarded.load(std::memory_order_relaxed);
+		return result;
+	}
+
+	std::optional<std::size_t> stack_pool::high_water(const stack_allocation& stack) {
+#if defined(__linux__)
+		if (!stack.base || !stack.clean) return std::nullopt;
+		auto page = page_size();
+		auto low = reinterpret_cast<std::uintptr_t>(stack.base);
+		auto top = low + stack.size;
+		auto pages = (stack.size + page - 1) / page;
+
+		thread_local std::vector<unsigned char> t_resident;
+		t_resident.resize(pages);
+		if (mincore(stack.base, pages * page, t_resident.data()) != 0) return std::nullopt;
+		for (std::size_t i = 0; i < pages; ++i) {
+			if (t_resident[i] & 1) return top - (low + i * page);
+		}
+		return 0;
+#else
+		(void)stack;
+		return std::nullopt;
+#endif
+	}
+
+	void stack_pool::clean(stack_allocation& stack) {
+		if (!stack.base || stack.clean) return;
+		decommit(stack, stack.size);
+		stack.clean = true;
+	}
+
+	void stack_pool::decommit(const stack_allocation& stack, std::size_t high_water) {
+		auto page = page_size();
+		auto low = reinterpret_cast<std::uintptr_t>(stack.base);
+		auto top = low + stack.size;
+		auto begin = (top - std::min(high_water, stack.size)) & ~(page - 1);
+		auto end = (top - retained_size) & ~(page - 1);
+		if (end <= begin) return;
+#if defined(_WIN32)
+		VirtualAlloc(reinterpret_cast<void*>(begin), end - begin, MEM_RESET, PAGE_READWRITE);
+#else
+		madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+	}
+
+	void* stack_pool::map(std::size_t size) {
+		auto guard = page_size();
+		bool protect = m_guard_pages.load(std::memory_order_relaxed) && mapped_count() < guard_budget();
+#if defined(_WIN32)
+		auto* mapping = static_cast<char*>(VirtualAlloc(nullptr, size + guard, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+		if (!mapping) {
+			throw std::bad_alloc();
+		}
+		DWORD previous;
+		if (!protect || !VirtualProtect(mapping, guard, PAGE_NOACCESS, &previous)) {
+			m_unguarded.fetch_add(1, std::memory_order_relaxed);
+		}
+#else
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+		// Reserve only: the pages are committed on first touch, and with strict overcommit
+		// accounting an unused megabyte of stack should not count against the limit.
+#if defined(MAP_NORESERVE)
+		flags |= MAP_NORESERVE;
+#endif
+#if defined(MAP_STACK)
+		flags |= MAP_STACK;
+#endif
+		auto* mapping = static_cast<char*>(mmap(nullptr, size + guard, PROT_READ | PROT_WRITE, flags, -1, 0));
+		if (mapping == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		if (!protect || mprotect(mapping, guard, PROT_NONE) != 0) {
+			m_unguarded.fetch_add(1, std::memory_order_relaxed);
+		}
+#endif
+		return mapping + guard;
+	}
+
+	void stack_pool::unmap(void* base, std::size_t size) {
+		auto guard = page_size();
+		auto* mapping = static_cast<char*>(base) - guard;
+#if defined(_WIN32)
+		(void)size;
+		VirtualFree(mapping, 0, MEM_RELEASE);
+#else
+		munmap(mapping, size + guard);
+#endif
+	}
+
+	stack_allocation allocate_stack(std::size_t size) {
+		return stack_pool::instance().acquire(size);
+	}
+
+	void release_stack(stack_allocation& stack, std::optional<std::size_t> high_water) {
+		stack_pool::instance().release(stack, high_water);
+	}
+}
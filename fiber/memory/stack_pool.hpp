@@ -0,0 +1,114 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	struct stack_allocation {
+		void* base{};
+		std::size_t size{};
+		// current_numa_node() of the thread that acquired it.
+		std::optional<std::uint32_t> node;
+		// Nothing below the top retained_size bytes is left committed by an earlier fiber.
+		bool clean{};
+	};
+
+	// Fiber stacks are mapped with a guard page below them and recycled by power-of-two
+	// size class, first through a small per-thread cache and then through a shared one.
+	// Requests above the largest class are mapped and unmapped directly. A thread with a
+	// NUMA node gets stacks bound to that node and only recycles stacks from it.
+	//
+	// Stacks only reserve address space, pages are committed as the fiber touches them.
+	// A stack released with its high-water mark gives back everything it used below its
+	// top retained_size bytes, one released without it keeps its pages for the next fiber.
+	class stack_pool {
+	public:
+		static constexpr std::size_t min_class_size = 16 * 1024;
+		static constexpr std::size_t class_count = 10;
+		static constexpr std::size_t max_class_size = min_class_size << (class_count - 1);
+		static constexpr std::size_t retained_size = 8 * 1024;
+
+		struct class_stats {
+			std::size_t stack_size;
+			std::size_t in_use;
+			std::size_t cached;
+		};
+
+		struct stats {
+			std::vector<class_stats> classes;
+			std::size_t oversized_in_use;
+			std::size_t mapped_bytes;
+			std::size_t cached_bytes;
+			// Stacks mapped so far without a working guard page, either because guard pages
+			// were turned off or because the process hit the kernel's mapping limit.
+			std::size_t unguarded;
+		};
+
+		static stack_pool& instance();
+
+		stack_pool(const stack_pool&) = delete;
+		stack_pool& operator=(const stack_pool&) = delete;
+
+		stack_allocation acquire(std::size_t size);
+		// `high_water` is what high_water() measured for the stack, if anything. Without it
+		// the pages stay committed for the next fiber.
+		void release(stack_allocation& stack, std::optional<std::size_t> high_water = std::nullopt);
+
+		// Distance from the top of `stack` to the deepest page it has committed. Counts
+		// resident pages, so it costs one system call and never touches the stack itself.
+		// std::nullopt where the platform cannot tell, or for a stack that is not clean,
+		// whose pages may have been committed by an earlier fiber.
+		static std::optional<std::size_t> high_water(const stack_allocation& stack);
+
+		// Gives back what earlier fibers left committed below retained_size, so high_water()
+		// can measure the stack. Call before the new fiber first runs on it.
+		void clean(stack_allocation& stack);
+
+		// Unmaps every stack held in the shared caches.
+		void trim();
+
+		// Upper bound for the shared cache, stacks released beyond it are unmapped.
+		void set_cache_limit(std::size_t bytes);
+
+		// Only affects stacks mapped from now on.
+		void set_guard_pages(bool enabled);
+
+		stats get_stats() const;
+
+	private:
+		friend struct stack_cache;
+
+		struct cached_stack {
+			void* base;
+			bool clean;
+		};
+
+		stack_pool() = default;
+
+		static std::optional<std::size_t> class_of(std::size_t size);
+		std::size_t mapped_count() const;
+		void* map(std::size_t size);
+		void unmap(void* base, std::size_t size);
+		void decommit(const stack_allocation& stack, std::size_t high_water);
+		void give_back(std::optional<std::uint32_t> node, std::size_t index, std::vector<cached_stack>& stacks, std::size_t keep);
+
+		using class_cache = std::array<std::vector<cached_stack>, class_count>;
+
+		// Expects m_mutex to be held.
+		class_cache& shared_cache(std::optional<std::uint32_t> node);
+
+		mutable std::mutex m_mutex;
+		// Slot 0 holds stacks without a node, slot n + 1 those of node n.
+		std::vector<class_cache> m_cached;
+		// Cached stacks cost address space and the pages they already touched, not the full
+		// stack size in memory.
+		std::size_t m_cache_limit{ sizeof(void*) >= 8 ? std::size_t{ 1 } << 30 : std::size_t{ 64 } << 20 };
+		std::atomic<bool> m_guard_pages{ true };
+		std::array<std::atomic<std::size_t>, class_count> m_mapped{};
+		std::array<std::atomic<std::size_t>, class_count> m_in_use{};
+		std::atomic<std::size_t> m_oversized{ 0 };
+		std::atomic<std::size_t> m_oversized_bytes{ 0 };
+		std::atomic<std::size_t> m_unguarded{ 0 };
+	};
+
+	stack_allocation allocate_stack(std::size_t size);
+	void release_stack(stack_allocation& stack, std::optional<std::size_t> high_water = std::nullopt);
+}
@@ -0,0 +1,74 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	stack_profiler& stack_profiler::instance() {
+		// Never destroyed, fibers owned by other statics may record late.
+		static auto* profiler = new stack_profiler();
+		return *profiler;
+	}
+
+	void stack_profiler::set_sample_interval(std::uint32_t interval) {
+		m_sample_interval.store(interval, std::memory_order_relaxed);
+	}
+
+	bool stack_profiler::take_sample() const {
+		thread_local std::uint32_t t_countdown = 0;
+		auto interval = m_sample_interval.load(std::memory_order_relaxed);
+		if (interval == 0) return false;
+		if (t_countdown == 0 || t_countdown > interval) t_countdown = interval;
+		return --t_countdown == 0;
+	}
+
+	void stack_profiler::set_auto_sizing(bool enabled) {
+		m_auto_sizing.store(enabled, std::memory_order_relaxed);
+	}
+
+	std::string_view stack_profiler::key_of(std::string_view name) {
+		while (!name.empty() && name.back() >= '0' && name.back() <= '9') name.remove_suffix(1);
+		return name;
+	}
+
+	void stack_profiler::record(std::string_view name, std::size_t high_water, std::size_t stack_size) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& profile = m_profiles[std::string(key_of(name))];
+		++profile.samples;
+		profile.max_high_water = std::max(profile.max_high_water, high_water);
+		profile.total_high_water += high_water;
+		profile.stack_size = std::max(profile.stack_size, stack_size);
+	}
+
+	std::size_t stack_profiler::size_for(const entry& profile) {
+		auto wanted = std::bit_ceil(std::max(profile.max_high_water * 2, stack_pool::min_class_size));
+		return std::min(wanted, std::max<std::size_t>(default_stack_size, stack_pool::min_class_size));
+	}
+
+	std::optional<std::size_t> stack_profiler::suggested_size(std::string_view name) const {
+		if (!m_auto_sizing.load(std::memory_order_relaxed)) return std::nullopt;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_profiles.find(std::string(key_of(name)));
+		if (found == m_profiles.end() || found->second.samples < min_samples) return std::nullopt;
+		return size_for(found->second);
+	}
+
+	std::vector<stack_profile> stack_profiler::profiles() const {
+		bool auto_sizing = m_auto_sizing.load(std::memory_order_relaxed);
+		std::vector<stack_profile> result;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			result.reserve(m_profiles.size());
+			for (const auto& [name, profile] : m_profiles) {
+				result.push_back({ name, profile.samples, profile.max_high_water, profile.total_high_water / profile.samples,
+					profile.stack_size, std::nullopt });
+				if (auto_sizing && profile.samples >= min_samples) result.back().suggested_size = size_for(profile);
+			}
+		}
+		std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.name < b.name; });
+		return result;
+	}
+
+	void stack_profiler::reset() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_profiles.clear();
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Stack high-water marks of the fibers destroyed so far, by name.
+	struct stack_profile {
+		std::string name;
+		std::size_t samples;
+		std::size_t max_high_water;
+		std::size_t mean_high_water;
+		// Largest stack any of them was given.
+		std::size_t stack_size;
+		// What a fiber of this name is given without an explicit size once auto-sizing is on.
+		std::optional<std::size_t> suggested_size;
+	};
+
+	// Fibers record their stack's high-water mark here when they are destroyed. Names that
+	// only differ in a trailing number, such as "FiberPool_0" and "FiberPool_7", share one
+	// profile. With auto-sizing on, a fiber created without a stack size gets twice the
+	// deepest use seen under its name, rounded up to a size class.
+	class stack_profiler {
+	public:
+		// Samples needed before a name gets a suggested size.
+		static constexpr std::size_t min_samples = 8;
+
+		static stack_profiler& instance();
+
+		stack_profiler(const stack_profiler&) = delete;
+		stack_profiler& operator=(const stack_profiler&) = delete;
+
+		// Measuring costs a system call, so only every `interval`-th fiber created on a
+		// thread is measured when it is destroyed, 64 by default. 1 measures all of them, 0
+		// none. Only measured stacks give their deep pages back when they are recycled.
+		void set_sample_interval(std::uint32_t interval);
+
+		// Whether the fiber being created on this thread should be measured.
+		bool take_sample() const;
+
+		// Off by default: a fiber that only goes deep on a rare path can overflow a stack
+		// sized from the common one.
+		void set_auto_sizing(bool enabled);
+
+		void record(std::string_view name, std::size_t high_water, std::size_t stack_size);
+
+		// std::nullopt unless auto-sizing is on and the name has min_samples.
+		std::optional<std::size_t> suggested_size(std::string_view name) const;
+
+		std::vector<stack_profile> profiles() const;
+
+		void reset();
+
+		static std::string_view key_of(std::string_view name);
+
+	private:
+		struct entry {
+			std::size_t samples{};
+			std::size_t max_high_water{};
+			std::size_t total_high_water{};
+			std::size_t stack_size{};
+		};
+
+		stack_profiler() = default;
+
+		static std::size_t size_for(const entry& profile);
+
+		mutable std::mutex m_mutex;
+		std::unordered_map<std::string, entry> m_profiles;
+		std::atomic<std::uint32_t> m_sample_interval{ 64 };
+		std::atomic<bool> m_auto_sizing{ false };
+	};
+}
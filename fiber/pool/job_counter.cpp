@@ -0,0 +1,80 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	namespace {
+		constexpr int spin_rounds = 100;
+
+		struct counter_wait : wait_node {
+			std::size_t target{};
+		};
+	}
+
+	job_counter::job_counter(std::size_t initial)
+		: m_value(initial) {}
+
+	void job_counter::increment(std::size_t count) {
+		m_value.fetch_add(count, std::memory_order_seq_cst);
+	}
+
+	void job_counter::decrement(std::size_t count) {
+		auto previous = m_value.fetch_sub(count, std::memory_order_seq_cst);
+		if (previous < count) {
+			throw std::logic_error("Job counter decremented below zero.");
+		}
+
+		// Pairs with the increment of m_waiting in wait_for_counter(): either the waiter sees
+		// the new value or we see the waiter.
+		if (m_waiting.load(std::memory_order_seq_cst) == 0) return;
+
+		wait_node* woken = nullptr;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			auto value = m_value.load(std::memory_order_seq_cst);
+			wait_list remaining;
+			for (auto* node = m_waiters.take_all(); node;) {
+				auto* next = node->next;
+				if (value <= static_cast<counter_wait*>(node)->target) {
+					node->next = woken;
+					woken = node;
+					m_waiting.fetch_sub(1, std::memory_order_relaxed);
+				}
+				else {
+					remaining.push_back(node);
+				}
+				node = next;
+			}
+			m_waiters = remaining;
+		}
+		notify_waiters(woken);
+	}
+
+	std::size_t job_counter::value() const {
+		return m_value.load(std::memory_order_acquire);
+	}
+
+	void wait_for_counter(job_counter& counter, std::size_t target) {
+		if (counter.value() <= target) return;
+
+		if (should_spin()) {
+			for (int i = 0; i < spin_rounds; ++i) {
+				cpu_relax();
+				if (counter.value() <= target) return;
+			}
+		}
+
+		counter_wait node;
+		node.target = target;
+		counter.m_guard.lock();
+		counter.m_waiting.fetch_add(1, std::memory_order_seq_cst);
+		if (counter.m_value.load(std::memory_order_seq_cst) <= target) {
+			counter.m_waiting.fetch_sub(1, std::memory_order_relaxed);
+			counter.m_guard.unlock();
+			return;
+		}
+		prepare_wait(node);
+		counter.m_waiters.push_back(&node);
+		counter.m_guard.unlock();
+
+		wait_for_notify(node);
+	}
+}
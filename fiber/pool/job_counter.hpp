@@ -0,0 +1,33 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Number of unfinished jobs. fiber_pool::add_batch() and add_graph() hand one out that
+	// reaches zero once every job of the batch has run.
+	class job_counter {
+	public:
+		explicit job_counter(std::size_t initial = 0);
+
+		job_counter(const job_counter&) = delete;
+		job_counter& operator=(const job_counter&) = delete;
+
+		void increment(std::size_t count = 1);
+
+		// Wakes every waiter whose target has been reached.
+		void decrement(std::size_t count = 1);
+
+		std::size_t value() const;
+
+	private:
+		friend void wait_for_counter(job_counter& counter, std::size_t target);
+
+		std::atomic<std::size_t> m_value;
+		std::atomic<std::size_t> m_waiting{ 0 };
+		spin_lock m_guard;
+		wait_list m_waiters;
+	};
+
+	// Parks the calling fiber until the counter is at or below `target`. Outside a fiber the
+	// thread yields instead, so never call it from the thread that drives the fibers.
+	void wait_for_counter(job_counter& counter, std::size_t target = 0);
+}
@@ -0,0 +1,49 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	job_graph::node job_graph::add(std::function<void()> func) {
+		if (!func) {
+			throw std::invalid_argument("Job function is empty.");
+		}
+		m_nodes.push_back({ std::move(func), {}, 0 });
+		return static_cast<node>(m_nodes.size() - 1);
+	}
+
+	void job_graph::precede(node before, node after) {
+		if (before >= m_nodes.size() || after >= m_nodes.size()) {
+			throw std::out_of_range("Job graph node does not exist.");
+		}
+		if (before == after) {
+			throw std::invalid_argument("A job cannot precede itself.");
+		}
+		m_nodes[before].successors.push_back(after);
+		++m_nodes[after].predecessors;
+	}
+
+	std::size_t job_graph::size() const {
+		return m_nodes.size();
+	}
+
+	void job_graph::validate() const {
+		std::vector<std::uint32_t> remaining(m_nodes.size());
+		std::vector<node> ready;
+		for (node i = 0; i < m_nodes.size(); ++i) {
+			remaining[i] = m_nodes[i].predecessors;
+			if (remaining[i] == 0) ready.push_back(i);
+		}
+
+		std::size_t visited = 0;
+		while (!ready.empty()) {
+			auto current = ready.back();
+			ready.pop_back();
+			++visited;
+			for (auto successor : m_nodes[current].successors) {
+				if (--remaining[successor] == 0) ready.push_back(successor);
+			}
+		}
+
+		if (visited != m_nodes.size()) {
+			throw std::invalid_argument("Job graph contains a cycle.");
+		}
+	}
+}
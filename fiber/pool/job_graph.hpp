@@ -0,0 +1,39 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Jobs plus "runs before" edges, submitted as a whole with fiber_pool::add_graph(). A job
+	// becomes runnable once all of its predecessors have finished.
+	class job_graph {
+	public:
+		using node = std::uint32_t;
+
+		node add(std::function<void()> func);
+
+		// `after` does not start before `before` has finished.
+		void precede(node before, node after);
+
+		std::size_t size() const;
+
+	private:
+		friend class fiber_pool;
+		friend struct graph_run;
+
+		struct entry {
+			std::function<void()> func;
+			std::vector<node> successors;
+			std::uint32_t predecessors{};
+		};
+
+		// Throws if the edges contain a cycle, which would never finish.
+		void validate() const;
+
+		std::vector<entry> m_nodes;
+	};
+
+	// A submitted graph, shared by its queued jobs.
+	struct graph_run {
+		std::vector<job_graph::entry> nodes;
+		std::unique_ptr<std::atomic<std::uint32_t>[]> remaining;
+	};
+}
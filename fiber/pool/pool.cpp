@@ -1,174 +1,732 @@
-#include "pool.hpp"
-
-namespace ve {
-	std::shared_ptr<fiber_pool> g_fiber_pool = std::make_shared<fiber_pool>();
-
-	fiber_pool::fiber_pool(std::uint32_t max_jobs)
-		: m_max_jobs(max_jobs) {}
-
-	void fiber_pool::initialize(std::uint32_t pool_size) {
-		std::lock_guard<std::mutex> lock(m_mutex);
-		auto manager = get_fiber_manager();
-
-		if (!manager) {
-			throw std::runtime_error("Fiber manager not initialized.");
-		}
-
-		m_running = true;
-		m_executed_jobs = 0;
-
-		for (std::uint32_t i = 0; i < pool_size; ++i) {
-			std::string fiber_name = "FiberPool_" + std::to_string(i);
-			manager->add(std::make_unique<fiber>(fiber_name, [this] {
-				while (m_running) {
-					this->tick();
-					fiber::current()->sleep();
-				}
-				}));
-		}
-
-		std::cout << "[FiberPool] Initialized with " << pool_size << " fibers.\n";
-	}
-
-	void fiber_pool::tick() {
-		std::unique_lock<std::mutex> lock(m_mutex);
-
-		m_cv.wait(lock, [this] { return !m_jobs.empty() || !m_running; });
-
-		if (!m_running) return;
-
-		auto now = std::chrono::steady_clock::now();
-		if (!m_jobs.empty() && m_jobs.top().ready_time <= now) {
-			auto job = std::move(m_jobs.top());
-			m_jobs.pop();
-
-			if (job.expiration_time <= now) {
-				std::cout << "[FiberPool] Skipped expired job with priority " + std::to_string(job.priority);
-				return;
-			}
-
-			lock.unlock();
-
-			try {
-				std::invoke(std::move(job.func));
-				++m_executed_jobs;
-				if (m_job_executed_callback) {
-					m_job_executed_callback(job);
-				}
-				std::cout << "[FiberPool] Executed job with priority " + std::to_string(job.priority);
-			}
-			catch (const std::exception& e) {
-				std::cout << std::string("[FiberPool] Job execution error: ") + e.what();
-			}
-		}
-		else {
-			if (!m_jobs.empty()) {
-				m_cv.wait_until(lock, m_jobs.top().ready_time);
-			}
-		}
-	}
-
-	void fiber_pool::cleanup() {
-		{
-			std::lock_guard<std::mutex> lock(m_mutex);
-			m_running = false;
-		}
-		m_cv.notify_all();
-		std::cout << "[FiberPool] Shutting down...\n";
-	}
-
-	void fiber_pool::resize(std::uint32_t new_size) {
-		std::lock_guard<std::mutex> lock(m_mutex);
-		auto manager = get_fiber_manager();
-
-		if (!manager) {
-			throw std::runtime_error("Fiber manager not initialized.");
-		}
-
-		std::uint32_t current_size = m_fibers.size();
-		if (new_size > current_size) {
-			for (std::uint32_t i = current_size; i < new_size; ++i) {
-				std::string fiber_name = "FiberPool_" + std::to_string(i);
-				manager->add(std::make_unique<fiber>(fiber_name, [this] {
-					while (m_running) {
-						this->tick();
-						fiber::current()->sleep();
-					}
-					}));
-			}
-			std::cout << "[FiberPool] Resized to " << new_size << " fibers.\n";
-		}
-		else if (new_size < current_size) {
-			for (std::uint32_t i = new_size; i < current_size; ++i) {
-				m_fibers[i]->terminate();
-			}
-			m_fibers.resize(new_size);
-			std::cout << "[FiberPool] Reduced to " << new_size << " fibers.\n";
-		}
-	}
-
-	bool fiber_pool::add(std::function<void()> func, int priority, std::chrono::steady_clock::duration delay, std::chrono::steady_clock::duration expiration) {
-		if (func) {
-			std::lock_guard<std::mutex> lock(m_mutex);
-
-			if (m_jobs.size() >= m_max_jobs) {
-				if (m_job_rejected_callback) {
-					job rejected_job{ std::move(func), std::chrono::steady_clock::now() + delay, priority, std::chrono::steady_clock::now() + expiration };
-					m_job_rejected_callback(rejected_job);
-				}
-				std::cout << "[FiberPool] Job rejected: queue full.";
-				return false;
-			}
-
-			job new_job{
-				std::move(func),
-				std::chrono::steady_clock::now() + delay,
-				priority,
-				std::chrono::steady_clock::now() + expiration
-			};
-			m_jobs.push(std::move(new_job));
-
-			if (m_job_added_callback) {
-				m_job_added_callback(new_job);
-			}
-
-			std::cout << "[FiberPool] Added job with priority " + std::to_string(priority) + ".";
-			m_cv.notify_one();
-			return true;
-		}
-		return false;
-	}
-
-	fiber_pool::stats fiber_pool::get_stats() {
-		std::lock_guard<std::mutex> lock(m_mutex);
-		return { m_jobs.size(), m_executed_jobs, m_fibers.size() };
-	}
-
-	std::size_t fiber_pool::get_fiber_count() {
-		std::lock_guard<std::mutex> lock(m_mutex);
-		return m_fibers.size();
-	}
-
-	void fiber_pool::set_max_jobs(std::size_t max_jobs) {
-		std::lock_guard<std::mutex> lock(m_mutex);
-		m_max_jobs = max_jobs;
-	}
-
-	void fiber_pool::set_verbosity(bool verbose) {
-		m_verbose = verbose;
-	}
-
-	void fiber_pool::set_job_added_callback(std::function<void(const job&)> callback) {
-		m_job_added_callback = std::move(callback);
-	}
-
-	void fiber_pool::set_job_executed_callback(std::function<void(const job&)> callback) {
-		m_job_executed_callback = std::move(callback);
-	}
-
-	void fiber_pool::set_job_rejected_callback(std::function<void(const job&)> callback) {
-		m_job_rejected_callback = std::move(callback);
-	}
-
-	std::shared_ptr<fiber_pool> get_fiber_pool() { return g_fiber_pool; }
+#include "pool.hpp"
+
+namespace ve {
+	std::shared_ptr<fiber_pool> g_fiber_pool = std::make_shared<fiber_pool>();
+
+	namespace {
+		// Owns itself: starts eagerly and frees its frame when the body ends.
+		struct detached_task {
+			struct promise_type {
+				detached_task get_return_object() noexcept {
+					return {};
+				}
+
+				std::suspend_never initial_suspend() noexcept {
+					return {};
+				}
+
+				std::suspend_never final_suspend() noexcept {
+					return {};
+				}
+
+				void return_void() noexcept {}
+
+				void unhandled_exception() noexcept {}
+			};
+		};
+
+		detached_task launch(fiber_pool& pool, task<void> work, int priority, bool verbose) {
+			co_await pool.schedule(priority);
+			try {
+				co_await std::move(work);
+			}
+			catch (const std::exception& e) {
+				VE_TRACE(1, trace_type::job_error, 0, static_cast<std::uint32_t>(priority));
+				if (verbose) std::cout << std::string("[FiberPool] Task execution error: ") + e.what();
+			}
+		}
+
+		// Finding expired jobs walks every slot, so a steady trickle of them is swept for at
+		// most this often. Until then execute() still drops any it runs into.
+		constexpr auto reap_interval = std::chrono::milliseconds(1);
+	}
+
+	fiber_pool::fiber_pool(std::uint32_t max_jobs)
+		: m_max_jobs(max_jobs) {
+		m_head.fill(no_slot);
+		m_tail.fill(no_slot);
+	}
+
+	void fiber_pool::initialize(std::uint32_t pool_size) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto manager = get_fiber_manager();
+
+		if (!manager) {
+			throw std::runtime_error("Fiber manager not initialized.");
+		}
+
+		m_running.store(true, std::memory_order_release);
+		m_executed_jobs = 0;
+		if (m_fibers.empty()) m_next_fiber_id = 0;
+		spawn(pool_size);
+
+		if (m_verbose) std::cout << "[FiberPool] Initialized with " << pool_size << " fibers.\n";
+	}
+
+	void fiber_pool::run_worker() {
+		auto* self = fiber::current();
+		while (m_running.load(std::memory_order_acquire)) {
+			tick();
+			if (retire(self)) return;
+			self->sleep();
+		}
+	}
+
+	bool fiber_pool::retire(fiber* self) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		// Only a fiber with nothing ready to run leaves, the queue stays with the others.
+		if (m_retire_requests == 0 || ready_jobs() != 0) return false;
+
+		--m_retire_requests;
+		std::erase(m_fibers, self->handle());
+		return true;
+	}
+
+	void fiber_pool::tick() {
+		if (m_autoscaling.load(std::memory_order_relaxed)) {
+			autoscale(std::chrono::steady_clock::now());
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (!m_running.load(std::memory_order_relaxed)) return;
+
+		// Outside of a fiber there is nothing to park, so tick() only runs a job if one is ready.
+		auto* self = fiber::current();
+
+		if (pending() == 0) {
+			// Leave it to run_worker() to retire instead of parking.
+			if (m_retire_requests > 0) return;
+			if (self && m_autoscale && !m_sample_waiter && workers() > m_autoscale->min_fibers) {
+				m_sample_waiter = true;
+				auto interval = m_autoscale->interval;
+				lock.unlock();
+				self->sleep(interval);
+
+				lock.lock();
+				m_sample_waiter = false;
+				return;
+			}
+			if (self) {
+				self->m_parked.store(true, std::memory_order_seq_cst);
+				m_parked_fibers.push_back(self);
+				lock.unlock();
+				self->park();
+			}
+			return;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		promote(now);
+		std::vector<job> expired;
+		if (now >= m_next_reap) {
+			reap(now, expired);
+		}
+
+		std::optional<job> next;
+		if (m_bitmap != 0) {
+			next = pop();
+			m_window_latency += now - std::min(now, next->ready_time);
+			++m_window_jobs;
+		}
+
+		if (next || !expired.empty()) {
+			lock.unlock();
+
+			// Expired jobs do not run but still release their counters.
+			for (auto& dropped : expired) {
+				for (std::optional<job> current = std::move(dropped); current;) {
+					current = execute(std::move(*current), self);
+				}
+			}
+
+			// A graph successor made ready by this job runs right here, while its inputs are
+			// still warm in this worker's cache.
+			for (std::optional<job> current = std::move(next); current;) {
+				current = execute(std::move(*current), self);
+			}
+		}
+		else if (self) {
+			// One fiber sleeps until the next delayed job is due, the others park so add()
+			// can hand them new work immediately.
+			if (m_timed_waiter) {
+				self->m_parked.store(true, std::memory_order_seq_cst);
+				m_parked_fibers.push_back(self);
+				lock.unlock();
+				self->park();
+				return;
+			}
+
+			m_timed_waiter = true;
+			auto delay = std::min(m_delayed.front().ready_time, m_next_reap) - now;
+			lock.unlock();
+			self->sleep(delay);
+
+			lock.lock();
+			m_timed_waiter = false;
+		}
+	}
+
+	std::optional<job> fiber_pool::execute(job current, fiber* self) {
+		[[maybe_unused]] std::uint64_t trace_subject = self ? self->trace_id() : 0;
+
+		if (current.expiration_time <= std::chrono::steady_clock::now()) {
+			VE_TRACE(1, trace_type::job_expire, trace_subject, static_cast<std::uint32_t>(current.priority));
+		}
+		else {
+			VE_TRACE(2, trace_type::job_begin, trace_subject, static_cast<std::uint32_t>(current.priority));
+			try {
+				if (current.graph) {
+					std::invoke(current.graph->nodes[current.node].func);
+				}
+				else {
+					std::invoke(std::move(current.func));
+				}
+				++m_executed_jobs;
+				if (m_job_executed_callback) {
+					m_job_executed_callback(current);
+				}
+			}
+			catch (const std::exception& e) {
+				VE_TRACE(1, trace_type::job_error, trace_subject, static_cast<std::uint32_t>(current.priority));
+				if (m_verbose) std::cout << std::string("[FiberPool] Job execution error: ") + e.what();
+			}
+			VE_TRACE(2, trace_type::job_end, trace_subject, static_cast<std::uint32_t>(current.priority));
+		}
+
+		// Expired and failed jobs still count as finished, otherwise their successors and
+		// anyone waiting on the counter would hang.
+		std::optional<job> continuation;
+		if (current.graph) {
+			std::vector<job> ready;
+			for (auto successor : current.graph->nodes[current.node].successors) {
+				if (current.graph->remaining[successor].fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+
+				job next{ {}, std::chrono::steady_clock::time_point::max(), std::chrono::steady_clock::now(), current.priority, successor, current.counter, current.graph };
+				if (!continuation) continuation = std::move(next);
+				else ready.push_back(std::move(next));
+			}
+			if (!ready.empty()) enqueue(ready);
+		}
+		if (current.counter) {
+			current.counter->decrement();
+		}
+		return continuation;
+	}
+
+	bool fiber_pool::enqueue(std::vector<job>& jobs, bool bounded) {
+		auto now = std::chrono::steady_clock::now();
+		std::vector<fiber*> idle;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (bounded && pending() + jobs.size() > m_max_jobs) {
+				return false;
+			}
+			for (auto& queued : jobs) {
+				VE_TRACE(2, trace_type::job_enqueue, 0, static_cast<std::uint32_t>(queued.priority));
+				push(std::move(queued), now);
+			}
+			idle = take_parked(jobs.size());
+		}
+		for (auto* script : idle) {
+			script->unpark();
+		}
+		if (m_autoscaling.load(std::memory_order_relaxed)) {
+			autoscale(now);
+		}
+		return true;
+	}
+
+	void fiber_pool::enqueue(job queued) {
+		auto now = std::chrono::steady_clock::now();
+		fiber* idle = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			VE_TRACE(2, trace_type::job_enqueue, 0, static_cast<std::uint32_t>(queued.priority));
+			push(std::move(queued), now);
+			if (!m_parked_fibers.empty()) {
+				idle = m_parked_fibers.back();
+				m_parked_fibers.pop_back();
+			}
+		}
+		if (idle) {
+			idle->unpark();
+		}
+		if (m_autoscaling.load(std::memory_order_relaxed)) {
+			autoscale(now);
+		}
+	}
+
+	std::uint32_t fiber_pool::store(job queued) {
+		m_next_reap = std::min(m_next_reap, queued.expiration_time);
+
+		std::uint32_t slot;
+		if (!m_free_slots.empty()) {
+			slot = m_free_slots.back();
+			m_free_slots.pop_back();
+			m_slots[slot] = std::move(queued);
+		}
+		else {
+			slot = static_cast<std::uint32_t>(m_slots.size());
+			m_slots.push_back(std::move(queued));
+			m_links.emplace_back();
+		}
+		return slot;
+	}
+
+	job& fiber_pool::push(job queued, std::chrono::steady_clock::time_point now) {
+		auto ready_time = queued.ready_time;
+		auto slot = store(std::move(queued));
+		if (ready_time <= now) {
+			link(slot);
+		}
+		else {
+			m_links[slot].state = slot_state::delayed;
+			m_delayed.push_back({ ready_time, slot });
+			std::push_heap(m_delayed.begin(), m_delayed.end(), std::greater<>{});
+		}
+		return m_slots[slot];
+	}
+
+	void fiber_pool::link(std::uint32_t slot) {
+		auto level = ready_queue::level_of(m_slots[slot].priority);
+		m_links[slot] = { m_tail[level], no_slot, level, slot_state::ready };
+
+		if (m_tail[level] != no_slot) m_links[m_tail[level]].next = slot;
+		else m_head[level] = slot;
+		m_tail[level] = slot;
+
+		m_bitmap |= 1u << level;
+	}
+
+	void fiber_pool::unlink(std::uint32_t slot) {
+		auto& entry = m_links[slot];
+		auto level = entry.level;
+
+		if (entry.prev != no_slot) m_links[entry.prev].next = entry.next;
+		else m_head[level] = entry.next;
+		if (entry.next != no_slot) m_links[entry.next].prev = entry.prev;
+		else m_tail[level] = entry.prev;
+
+		if (m_head[level] == no_slot) m_bitmap &= ~(1u << level);
+
+		entry.prev = entry.next = no_slot;
+	}
+
+	job fiber_pool::release(std::uint32_t slot) {
+		m_links[slot].state = slot_state::free;
+		m_free_slots.push_back(slot);
+		return std::move(m_slots[slot]);
+	}
+
+	job fiber_pool::pop() {
+		auto level = static_cast<std::uint32_t>(std::bit_width(m_bitmap) - 1);
+		auto slot = m_head[level];
+		unlink(slot);
+		return release(slot);
+	}
+
+	void fiber_pool::promote(std::chrono::steady_clock::time_point now) {
+		while (!m_delayed.empty() && m_delayed.front().ready_time <= now) {
+			std::pop_heap(m_delayed.begin(), m_delayed.end(), std::greater<>{});
+			auto slot = m_delayed.back().slot;
+			m_delayed.pop_back();
+			link(slot);
+		}
+	}
+
+	void fiber_pool::reap(std::chrono::steady_clock::time_point now, std::vector<job>& expired) {
+		auto next = std::chrono::steady_clock::time_point::max();
+		bool delayed = false;
+		for (std::uint32_t slot = 0; slot < m_slots.size(); ++slot) {
+			auto state = m_links[slot].state;
+			if (state == slot_state::free) continue;
+
+			auto expiration = m_slots[slot].expiration_time;
+			if (expiration > now) {
+				next = std::min(next, expiration);
+				continue;
+			}
+
+			if (state == slot_state::ready) unlink(slot);
+			else delayed = true;
+			expired.push_back(release(slot));
+		}
+
+		if (delayed) {
+			std::erase_if(m_delayed, [this](const delayed_job& entry) { return m_links[entry.slot].state == slot_state::free; });
+			std::make_heap(m_delayed.begin(), m_delayed.end(), std::greater<>{});
+		}
+		m_next_reap = std::max(next, now + reap_interval);
+	}
+
+	std::size_t fiber_pool::pending() const {
+		return m_slots.size() - m_free_slots.size();
+	}
+
+	std::size_t fiber_pool::ready_jobs() const {
+		return pending() - m_delayed.size();
+	}
+
+	std::size_t fiber_pool::workers() const {
+		return m_fibers.size() - m_retire_requests;
+	}
+
+	std::vector<fiber*> fiber_pool::set_size(std::size_t target) {
+		auto size = workers();
+		if (target > size) {
+			// Fibers that were asked to retire but are still here stay instead.
+			auto kept = std::min(m_retire_requests, target - size);
+			m_retire_requests -= kept;
+			spawn(target - size - kept);
+			return {};
+		}
+
+		// Parked fibers are idle, wake them so they can leave.
+		m_retire_requests += size - target;
+		return take_parked(size - target);
+	}
+
+	void fiber_pool::spawn(std::size_t count) {
+		auto manager = get_fiber_manager();
+		if (!manager) {
+			throw std::runtime_error("Fiber manager not initialized.");
+		}
+
+		m_fibers.reserve(m_fibers.size() + count);
+		for (std::size_t i = 0; i < count; ++i) {
+			std::string fiber_name = "FiberPool_" + std::to_string(m_next_fiber_id++);
+			m_fibers.push_back(manager->add(std::make_unique<fiber>(fiber_name, [this] {
+				run_worker();
+				})));
+		}
+	}
+
+	void fiber_pool::autoscale(std::chrono::steady_clock::time_point now) {
+		auto ticks = now.time_since_epoch().count();
+		if (ticks < m_next_sample.load(std::memory_order_relaxed)) return;
+
+		std::optional<scale_event> event;
+		std::vector<fiber*> idle;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_autoscale || !m_running.load(std::memory_order_relaxed) || ticks < m_next_sample.load(std::memory_order_relaxed)) return;
+
+			const auto& policy = *m_autoscale;
+			m_next_sample.store(ticks + policy.interval.count(), std::memory_order_relaxed);
+
+			auto size = workers();
+			auto ready = ready_jobs();
+			auto idle_count = m_parked_fibers.size() + (m_sample_waiter ? 1 : 0);
+			auto idle_ratio = size > 0 ? std::min(1.0, static_cast<double>(idle_count) / size) : 1.0;
+			auto latency = m_window_jobs > 0 ? m_window_latency / static_cast<std::int64_t>(m_window_jobs) : std::chrono::steady_clock::duration::zero();
+			m_window_latency = {};
+			m_window_jobs = 0;
+			m_last_latency = latency;
+			m_last_idle_ratio = idle_ratio;
+
+			bool backlog = static_cast<double>(ready) > policy.grow_queue_depth * size;
+			bool slow = latency > policy.grow_latency;
+			bool quiet = ready == 0 && idle_ratio >= policy.shrink_idle_ratio;
+			m_grow_streak = backlog || slow ? m_grow_streak + 1 : 0;
+			m_shrink_streak = quiet ? m_shrink_streak + 1 : 0;
+
+			auto target = size;
+			auto reason = scale_reason::bounds;
+			if (size < policy.min_fibers || size > policy.max_fibers) {
+				target = std::clamp<std::size_t>(size, policy.min_fibers, policy.max_fibers);
+			}
+			else if (now < m_cooldown_until) {
+				return;
+			}
+			else if (m_grow_streak >= policy.grow_samples && size < policy.max_fibers) {
+				target = std::min<std::size_t>(size + std::max<std::size_t>(size / 4, 1), policy.max_fibers);
+				reason = backlog ? scale_reason::queue_depth : scale_reason::latency;
+			}
+			else if (m_shrink_streak >= policy.shrink_samples && size > policy.min_fibers) {
+				target = std::max<std::size_t>(size - std::max<std::size_t>(idle_count / 2, 1), policy.min_fibers);
+				reason = scale_reason::idle;
+			}
+			if (target == size) return;
+
+			idle = set_size(target);
+			if (target > size) ++m_scale_ups;
+			else ++m_scale_downs;
+			m_grow_streak = m_shrink_streak = 0;
+			m_cooldown_until = now + policy.cooldown;
+			event = scale_event{ size, target, reason, ready, latency, idle_ratio };
+		}
+
+		for (auto* script : idle) {
+			script->unpark();
+		}
+		if (m_scale_callback) {
+			m_scale_callback(*event);
+		}
+	}
+
+	std::vector<fiber*> fiber_pool::take_parked(std::size_t count) {
+		count = std::min(count, m_parked_fibers.size());
+		std::vector<fiber*> idle(m_parked_fibers.end() - count, m_parked_fibers.end());
+		m_parked_fibers.resize(m_parked_fibers.size() - count);
+		return idle;
+	}
+
+	fiber_pool::schedule_awaiter fiber_pool::schedule(int priority, std::chrono::steady_clock::duration delay) {
+		return schedule_awaiter(this, priority, delay);
+	}
+
+	void fiber_pool::resume(std::coroutine_handle<> handle, int priority, std::chrono::steady_clock::duration delay) {
+		auto now = std::chrono::steady_clock::now();
+		enqueue(job{ .func = [handle] { handle.resume(); }, .expiration_time = std::chrono::steady_clock::time_point::max(), .ready_time = now + delay, .priority = priority });
+	}
+
+	void fiber_pool::add_task(task<void> work, int priority) {
+		launch(*this, std::move(work), priority, m_verbose);
+	}
+
+	fiber_pool::bulk_result fiber_pool::add_bulk(std::span<job_function> funcs, int priority, std::chrono::steady_clock::duration delay, std::chrono::steady_clock::duration expiration) {
+		if (std::any_of(funcs.begin(), funcs.end(), [](const auto& func) { return !func; })) {
+			throw std::invalid_argument("Job function is empty.");
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		std::vector<fiber*> idle;
+		std::size_t accepted;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto queued = pending();
+			accepted = std::min(funcs.size(), m_max_jobs > queued ? m_max_jobs - queued : 0);
+
+			auto fresh = accepted > m_free_slots.size() ? accepted - m_free_slots.size() : 0;
+			m_slots.reserve(m_slots.size() + fresh);
+			m_links.reserve(m_links.size() + fresh);
+			m_free_slots.reserve(m_slots.capacity());
+
+			auto ready = delay <= std::chrono::steady_clock::duration::zero();
+			auto delayed = m_delayed.size();
+			if (!ready) m_delayed.reserve(delayed + accepted);
+
+			for (std::size_t i = 0; i < accepted; ++i) {
+				auto slot = store({ .func = std::move(funcs[i]), .expiration_time = now + expiration, .ready_time = now + delay, .priority = priority });
+				if (ready) {
+					link(slot);
+				}
+				else {
+					m_links[slot].state = slot_state::delayed;
+					m_delayed.push_back({ now + delay, slot });
+				}
+				if (m_job_added_callback) {
+					m_job_added_callback(m_slots[slot]);
+				}
+				VE_TRACE(2, trace_type::job_enqueue, 0, static_cast<std::uint32_t>(priority));
+			}
+
+			// Ready jobs are appended to their level. For delayed ones rebuilding the heap is
+			// linear, sifting each new entry up costs log n apiece.
+			if (!ready) {
+				if (accepted > delayed / 2) {
+					std::make_heap(m_delayed.begin(), m_delayed.end(), std::greater<>{});
+				}
+				else {
+					for (auto it = m_delayed.begin() + delayed; it != m_delayed.end(); ++it) {
+						std::push_heap(m_delayed.begin(), it + 1, std::greater<>{});
+					}
+				}
+			}
+			idle = take_parked(accepted);
+		}
+
+		if (accepted < funcs.size()) {
+			VE_TRACE(1, trace_type::job_reject, 0, static_cast<std::uint32_t>(priority));
+		}
+		for (auto* script : idle) {
+			script->unpark();
+		}
+		// Also samples while every fiber is stuck in a long job and none of them ticks.
+		if (m_autoscaling.load(std::memory_order_relaxed)) {
+			autoscale(now);
+		}
+		return { accepted, funcs.size() - accepted };
+	}
+
+	std::shared_ptr<job_counter> fiber_pool::add_batch(std::span<job_function> funcs, int priority) {
+		if (std::any_of(funcs.begin(), funcs.end(), [](const auto& func) { return !func; })) {
+			throw std::invalid_argument("Job function is empty.");
+		}
+
+		// Built before taking the lock, so the capacity check and the push are one step.
+		auto counter = std::make_shared<job_counter>(funcs.size());
+		auto now = std::chrono::steady_clock::now();
+		std::vector<job> jobs;
+		jobs.reserve(funcs.size());
+		for (auto& func : funcs) {
+			jobs.push_back({ .func = std::move(func), .expiration_time = std::chrono::steady_clock::time_point::max(), .ready_time = now, .priority = priority, .counter = counter });
+		}
+		if (!enqueue(jobs, true)) {
+			for (std::size_t i = 0; i < funcs.size(); ++i) {
+				funcs[i] = std::move(jobs[i].func);
+			}
+			VE_TRACE(1, trace_type::job_reject, 0, static_cast<std::uint32_t>(priority));
+			return nullptr;
+		}
+		return counter;
+	}
+
+	std::shared_ptr<job_counter> fiber_pool::add_graph(job_graph graph, int priority) {
+		graph.validate();
+
+		auto run = std::make_shared<graph_run>();
+		run->remaining = std::make_unique<std::atomic<std::uint32_t>[]>(graph.m_nodes.size());
+		std::vector<job_graph::node> roots;
+		for (job_graph::node i = 0; i < graph.m_nodes.size(); ++i) {
+			run->remaining[i].store(graph.m_nodes[i].predecessors, std::memory_order_relaxed);
+			if (graph.m_nodes[i].predecessors == 0) roots.push_back(i);
+		}
+		run->nodes = std::move(graph.m_nodes);
+
+		// Successors are queued regardless of max_jobs, the graph was admitted as a whole.
+		auto counter = std::make_shared<job_counter>(run->nodes.size());
+		auto now = std::chrono::steady_clock::now();
+		std::vector<job> jobs;
+		jobs.reserve(roots.size());
+		for (auto root : roots) {
+			jobs.push_back({ {}, std::chrono::steady_clock::time_point::max(), now, priority, root, counter, run });
+		}
+		if (!enqueue(jobs, true)) {
+			VE_TRACE(1, trace_type::job_reject, 0, static_cast<std::uint32_t>(priority));
+			return nullptr;
+		}
+		return counter;
+	}
+
+	void fiber_pool::cleanup() {
+		std::vector<fiber*> parked;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_running.store(false, std::memory_order_release);
+			parked.swap(m_parked_fibers);
+			// The fibers leave their loops and are reaped by the manager.
+			m_fibers.clear();
+			m_retire_requests = 0;
+		}
+		for (auto* script : parked) {
+			script->unpark();
+		}
+		if (m_verbose) std::cout << "[FiberPool] Shutting down...\n";
+	}
+
+	void fiber_pool::resize(std::uint32_t new_size) {
+		std::vector<fiber*> idle;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::size_t current_size = workers();
+			idle = set_size(new_size);
+
+			if (new_size > current_size) {
+				if (m_verbose) std::cout << "[FiberPool] Resized to " << new_size << " fibers.\n";
+			}
+			else if (new_size < current_size) {
+				if (m_verbose) std::cout << "[FiberPool] Reduced to " << new_size << " fibers.\n";
+			}
+		}
+		for (auto* script : idle) {
+			script->unpark();
+		}
+	}
+
+	void fiber_pool::set_autoscaling(std::optional<autoscale_policy> policy) {
+		if (policy && (policy->min_fibers == 0 || policy->min_fibers > policy->max_fibers || policy->interval <= std::chrono::steady_clock::duration::zero())) {
+			throw std::invalid_argument("Autoscale policy needs 1 <= min_fibers <= max_fibers and a positive interval.");
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_autoscale = policy;
+		m_grow_streak = m_shrink_streak = 0;
+		m_window_latency = {};
+		m_window_jobs = 0;
+		m_last_latency = {};
+		m_last_idle_ratio = 0.0;
+		m_cooldown_until = {};
+		m_next_sample.store(0, std::memory_order_relaxed);
+		m_autoscaling.store(policy.has_value(), std::memory_order_relaxed);
+	}
+
+	void fiber_pool::set_scale_callback(std::function<void(const scale_event&)> callback) {
+		m_scale_callback = std::move(callback);
+	}
+
+	bool fiber_pool::add(job_function func, int priority, std::chrono::steady_clock::duration delay, std::chrono::steady_clock::duration expiration) {
+		if (func) {
+			auto now = std::chrono::steady_clock::now();
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			if (pending() >= m_max_jobs) {
+				if (m_job_rejected_callback) {
+					job rejected_job{ .func = std::move(func), .expiration_time = now + expiration, .ready_time = now + delay, .priority = priority };
+					m_job_rejected_callback(rejected_job);
+				}
+				VE_TRACE(1, trace_type::job_reject, 0, static_cast<std::uint32_t>(priority));
+				return false;
+			}
+
+			auto& new_job = push({ .func = std::move(func), .expiration_time = now + expiration, .ready_time = now + delay, .priority = priority }, now);
+
+			if (m_job_added_callback) {
+				m_job_added_callback(new_job);
+			}
+
+			VE_TRACE(2, trace_type::job_enqueue, 0, static_cast<std::uint32_t>(priority));
+
+			fiber* idle = nullptr;
+			if (!m_parked_fibers.empty()) {
+				idle = m_parked_fibers.back();
+				m_parked_fibers.pop_back();
+			}
+			lock.unlock();
+
+			if (idle) {
+				idle->unpark();
+			}
+			if (m_autoscaling.load(std::memory_order_relaxed)) {
+				autoscale(now);
+			}
+			return true;
+		}
+		return false;
+	}
+
+	fiber_pool::stats fiber_pool::get_stats() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return { pending(), m_executed_jobs, m_fibers.size(), m_parked_fibers.size(), m_retire_requests,
+			m_scale_ups, m_scale_downs, m_last_latency, m_last_idle_ratio };
+	}
+
+	std::size_t fiber_pool::get_fiber_count() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_fibers.size();
+	}
+
+	void fiber_pool::set_max_jobs(std::size_t max_jobs) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_max_jobs = max_jobs;
+	}
+
+	void fiber_pool::set_verbosity(bool verbose) {
+		m_verbose = verbose;
+	}
+
+	void fiber_pool::set_job_added_callback(std::function<void(const job&)> callback) {
+		m_job_added_callback = std::move(callback);
+	}
+
+	void fiber_pool::set_job_executed_callback(std::function<void(const job&)> callback) {
+		m_job_executed_callback = std::move(callback);
+	}
+
+	void fiber_pool::set_job_rejected_callback(std::function<void(const job&)> callback) {
+		m_job_rejected_callback = std::move(callback);
+	}
+
+	std::shared_ptr<fiber_pool> get_fiber_pool() { return g_fiber_pool; }
 }
\ No newline at end of file
@@ -1,64 +1,274 @@
-#pragma once
-#include "../../stdafx.hpp"
-
-namespace ve {
-	struct job {
-		std::function<void()> func;
-		std::chrono::steady_clock::time_point ready_time;
-		int priority;
-		std::chrono::steady_clock::time_point expiration_time;
-
-		bool operator<(const job& other) const {
-			if (priority == other.priority) {
-				return ready_time > other.ready_time;
-			}
-			return priority < other.priority;
-		}
-	};
-	class fiber_pool : public std::enable_shared_from_this<fiber_pool>
-	{
-	public:
-		struct stats {
-			std::size_t pending_jobs;
-			std::size_t executed_jobs;
-			std::size_t active_fibers;
-		};
-
-		explicit fiber_pool(std::uint32_t max_jobs = 1000);
-
-		void initialize(std::uint32_t pool_size);
-
-		void resize(std::uint32_t new_size);
-
-		bool add(std::function<void()> func, int priority, std::chrono::steady_clock::duration delay = std::chrono::milliseconds(0), std::chrono::steady_clock::duration expiration = std::chrono::minutes(5));
-
-		void set_job_added_callback(std::function<void(const job&)> callback);
-		void set_job_executed_callback(std::function<void(const job&)> callback);
-		void set_job_rejected_callback(std::function<void(const job&)> callback);
-
-		void tick();
-
-		void cleanup();
-
-		stats get_stats();
-
-		std::size_t get_fiber_count();
-
-		void set_max_jobs(std::size_t max_jobs);
-		void set_verbosity(bool verbose);
-	private:
-		mutable std::mutex m_mutex;
-		std::condition_variable m_cv;
-		std::priority_queue<job> m_jobs;
-		bool m_running = false;
-		std::atomic<std::size_t> m_max_jobs{ 1000 };
-		bool m_verbose{ true };
-		std::vector<std::unique_ptr<fiber>> m_fibers;
-		std::atomic<std::size_t> m_executed_jobs{ 0 };
-		std::function<void(const job&)> m_job_added_callback;
-		std::function<void(const job&)> m_job_executed_callback;
-		std::function<void(const job&)> m_job_rejected_callback;
-	};
-
-	std::shared_ptr<fiber_pool> get_fiber_pool();
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	using job_function = inplace_function<void()>;
+
+	// 112 bytes, 56 of them the callable, so running a job touches two cache lines either
+	// way. Padding it to 128 with alignas(64) kept bench_suite's pool latencies within
+	// run-to-run noise and add_bulk within 2 ns per job, so jobs are left unpadded.
+	struct job {
+		job_function func;
+		std::chrono::steady_clock::time_point expiration_time;
+		std::chrono::steady_clock::time_point ready_time;
+		int priority{ 0 };
+		job_graph::node node{};
+		std::shared_ptr<job_counter> counter{};
+		std::shared_ptr<graph_run> graph{};
+	};
+	class fiber_pool : public std::enable_shared_from_this<fiber_pool>
+	{
+	public:
+		struct stats {
+			std::size_t pending_jobs;
+			std::size_t executed_jobs;
+			std::size_t active_fibers;
+			std::size_t parked_fibers;
+			// Asked to retire but still busy.
+			std::size_t retiring_fibers;
+			std::size_t scale_ups;
+			std::size_t scale_downs;
+			// Mean submit-to-start latency and share of idle fibers at the last autoscaler
+			// sample, zero while autoscaling is off.
+			std::chrono::steady_clock::duration queue_latency;
+			double idle_ratio;
+		};
+
+		// Autoscaling takes a sample every `interval`. A condition has to hold for several
+		// samples in a row and no change happens within `cooldown` of the last one, so the
+		// pool does not flap. Growing adds a quarter of the fibers, at least one; shrinking
+		// retires half of the idle ones.
+		struct autoscale_policy {
+			std::uint32_t min_fibers = 1;
+			std::uint32_t max_fibers = 64;
+			// Grow while there are more ready jobs than this per fiber, or while jobs wait
+			// longer than grow_latency on average before they start.
+			double grow_queue_depth = 2.0;
+			std::chrono::steady_clock::duration grow_latency = std::chrono::milliseconds(1);
+			std::uint32_t grow_samples = 2;
+			// Shrink while nothing is ready and at least this share of the fibers is idle.
+			double shrink_idle_ratio = 0.5;
+			std::uint32_t shrink_samples = 10;
+			std::chrono::steady_clock::duration interval = std::chrono::milliseconds(10);
+			std::chrono::steady_clock::duration cooldown = std::chrono::milliseconds(100);
+		};
+
+		enum class scale_reason : std::uint8_t {
+			queue_depth,
+			latency,
+			idle,
+			// The fiber count was outside [min_fibers, max_fibers] when autoscaling started.
+			bounds,
+		};
+
+		struct scale_event {
+			std::size_t from;
+			std::size_t to;
+			scale_reason reason;
+			// What the sample that triggered it saw.
+			std::size_t ready_jobs;
+			std::chrono::steady_clock::duration queue_latency;
+			double idle_ratio;
+		};
+
+		struct bulk_result {
+			std::size_t accepted;
+			std::size_t rejected;
+		};
+
+		explicit fiber_pool(std::uint32_t max_jobs = 1000);
+
+		void initialize(std::uint32_t pool_size);
+
+		// Growing starts fibers right away. Shrinking asks fibers to retire, and each one only
+		// leaves once nothing is ready to run, so no queued job is dropped.
+		void resize(std::uint32_t new_size);
+
+		// Grows and shrinks the pool within the policy's bounds from its queue depth, queue
+		// latency and idle fibers. std::nullopt turns it off and keeps the current size.
+		void set_autoscaling(std::optional<autoscale_policy> policy);
+
+		// Called after every autoscaling decision, outside the pool's lock.
+		void set_scale_callback(std::function<void(const scale_event&)> callback);
+
+		// Ready jobs run by priority, highest first, and in submission order within one; like
+		// fibers, priorities are clamped to [0, ready_queue::levels). Delayed jobs join their
+		// level once due. Jobs past their expiration are dropped in batches without running.
+		bool add(job_function func, int priority, std::chrono::steady_clock::duration delay = std::chrono::milliseconds(0), std::chrono::steady_clock::duration expiration = std::chrono::minutes(5));
+
+		// Queues as many of `funcs` as fit under max_jobs, in order, under a single lock, and
+		// wakes one parked fiber per queued job. Accepted functions are moved from, rejected
+		// ones are left as they are so the caller can retry them. The rejected callback is
+		// not called, the result has the count instead.
+		bulk_result add_bulk(std::span<job_function> funcs, int priority = 0, std::chrono::steady_clock::duration delay = std::chrono::milliseconds(0), std::chrono::steady_clock::duration expiration = std::chrono::minutes(5));
+
+		// Queues all of the jobs or, if they do not fit under max_jobs, none of them and returns
+		// nullptr, leaving `funcs` as they were. The counter drops to zero once every job has
+		// run or expired.
+		std::shared_ptr<job_counter> add_batch(std::span<job_function> funcs, int priority = 0);
+
+		// Queues the jobs without predecessors; the others follow as their predecessors finish.
+		// The first successor that becomes ready runs right away on the fiber that finished
+		// its last predecessor, further ones are queued. Returns nullptr if the initial jobs
+		// do not fit under max_jobs, throws if the graph has a cycle.
+		std::shared_ptr<job_counter> add_graph(job_graph graph, int priority = 0);
+
+		class schedule_awaiter {
+		public:
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) const {
+				m_pool->resume(handle, m_priority, m_delay);
+			}
+
+			void await_resume() const noexcept {}
+
+		private:
+			friend class fiber_pool;
+
+			schedule_awaiter(fiber_pool* pool, int priority, std::chrono::steady_clock::duration delay)
+				: m_pool(pool), m_priority(priority), m_delay(delay) {}
+
+			fiber_pool* m_pool;
+			int m_priority;
+			std::chrono::steady_clock::duration m_delay;
+		};
+
+		// `co_await pool.schedule()` continues the coroutine as a job on one of the pool's
+		// fibers, after `delay` if one is given.
+		schedule_awaiter schedule(int priority = 0, std::chrono::steady_clock::duration delay = {});
+
+		// Queues a job that resumes `handle`. Not limited by max_jobs, a suspended coroutine
+		// must not be dropped.
+		void resume(std::coroutine_handle<> handle, int priority = 0, std::chrono::steady_clock::duration delay = {});
+
+		// Starts `work` on one of the pool's fibers and lets it run to completion on its own.
+		void add_task(task<void> work, int priority = 0);
+
+		// Queues `func` as a job and returns a future for its result. If the job is rejected
+		// or expires before it runs, get() throws broken_future.
+		template <typename F>
+		fiber_future<std::invoke_result_t<F&>> submit(F func, int priority = 0, std::chrono::steady_clock::duration delay = std::chrono::milliseconds(0), std::chrono::steady_clock::duration expiration = std::chrono::minutes(5)) {
+			fiber_promise<std::invoke_result_t<F&>> promise;
+			auto future = promise.get_future();
+			add([promise = std::move(promise), func = std::move(func)]() mutable {
+				promise.fulfill(func);
+				}, priority, delay, expiration);
+			return future;
+		}
+
+		void set_job_added_callback(std::function<void(const job&)> callback);
+		void set_job_executed_callback(std::function<void(const job&)> callback);
+		void set_job_rejected_callback(std::function<void(const job&)> callback);
+
+		void tick();
+
+		void cleanup();
+
+		stats get_stats();
+
+		std::size_t get_fiber_count();
+
+		void set_max_jobs(std::size_t max_jobs);
+		void set_verbosity(bool verbose);
+	private:
+		void run_worker();
+		bool retire(fiber* self);
+		void autoscale(std::chrono::steady_clock::time_point now);
+		std::optional<job> execute(job current, fiber* self);
+		// With `bounded`, queues nothing and returns false unless all of them fit under max_jobs.
+		bool enqueue(std::vector<job>& jobs, bool bounded = false);
+		void enqueue(job queued);
+
+		static constexpr std::uint32_t no_slot = std::numeric_limits<std::uint32_t>::max();
+
+		enum class slot_state : std::uint8_t {
+			free,
+			delayed,
+			ready,
+		};
+
+		// Queue links of a slot, kept next to each other rather than in the job so walking a
+		// level does not pull in job lines.
+		struct slot_link {
+			std::uint32_t prev = no_slot;
+			std::uint32_t next = no_slot;
+			std::uint32_t level = 0;
+			slot_state state = slot_state::free;
+		};
+
+		struct delayed_job {
+			std::chrono::steady_clock::time_point ready_time;
+			std::uint32_t slot;
+
+			bool operator>(const delayed_job& other) const {
+				return ready_time > other.ready_time;
+			}
+		};
+
+		// All expect m_mutex to be held. store() only takes a slot, the job is not queued yet.
+		std::uint32_t store(job queued);
+		job& push(job queued, std::chrono::steady_clock::time_point now);
+		void link(std::uint32_t slot);
+		void unlink(std::uint32_t slot);
+		job release(std::uint32_t slot);
+		job pop();
+		void promote(std::chrono::steady_clock::time_point now);
+		void reap(std::chrono::steady_clock::time_point now, std::vector<job>& expired);
+		std::size_t pending() const;
+		std::size_t ready_jobs() const;
+		std::size_t workers() const;
+		std::vector<fiber*> set_size(std::size_t target);
+		void spawn(std::size_t count);
+		std::vector<fiber*> take_parked(std::size_t count);
+
+		mutable std::mutex m_mutex;
+		// A job stays in its slot from add() until it runs or expires. Ready slots sit in a
+		// FIFO per ready_queue level with a bitmap of the non-empty levels, delayed ones in a
+		// min-heap on ready_time until they are due.
+		std::vector<job> m_slots;
+		std::vector<slot_link> m_links;
+		std::vector<std::uint32_t> m_free_slots;
+		std::array<std::uint32_t, ready_queue::levels> m_head;
+		std::array<std::uint32_t, ready_queue::levels> m_tail;
+		std::uint32_t m_bitmap{ 0 };
+		std::vector<delayed_job> m_delayed;
+		// No queued job expires before this, so tick() only sweeps for expired jobs then.
+		std::chrono::steady_clock::time_point m_next_reap = std::chrono::steady_clock::time_point::max();
+		std::vector<fiber*> m_parked_fibers;
+		bool m_timed_waiter = false;
+		// An idle fiber that wakes up every sample interval, so an idle pool still shrinks.
+		bool m_sample_waiter = false;
+		// Read by run_worker() without the lock, written under it.
+		std::atomic<bool> m_running{ false };
+		std::atomic<std::size_t> m_max_jobs{ 1000 };
+		std::atomic<bool> m_verbose{ true };
+		// The manager owns the fibers. A retiring fiber removes its own handle.
+		std::vector<fiber_handle> m_fibers;
+		std::size_t m_retire_requests{ 0 };
+		std::size_t m_next_fiber_id{ 0 };
+		std::optional<autoscale_policy> m_autoscale;
+		std::atomic<bool> m_autoscaling{ false };
+		// steady_clock ticks of the next sample, checked before taking the lock.
+		std::atomic<std::int64_t> m_next_sample{ 0 };
+		std::chrono::steady_clock::time_point m_cooldown_until;
+		std::uint32_t m_grow_streak{ 0 };
+		std::uint32_t m_shrink_streak{ 0 };
+		// Submit-to-start latency of the jobs started since the last sample.
+		std::chrono::steady_clock::duration m_window_latency{};
+		std::size_t m_window_jobs{ 0 };
+		std::chrono::steady_clock::duration m_last_latency{};
+		double m_last_idle_ratio{ 0.0 };
+		std::size_t m_scale_ups{ 0 };
+		std::size_t m_scale_downs{ 0 };
+		std::function<void(const scale_event&)> m_scale_callback;
+		std::atomic<std::size_t> m_executed_jobs{ 0 };
+		std::function<void(const job&)> m_job_added_callback;
+		std::function<void(const job&)> m_job_executed_callback;
+		std::function<void(const job&)> m_job_rejected_callback;
+	};
+
+	std::shared_ptr<fiber_pool> get_fiber_pool();
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Chase-Lev work-stealing deque (Le et al., "Correct and Efficient Work-Stealing for
+	// Weak Memory Models"). The owner pushes and pops at the bottom, thieves take from the top.
+	template <typename T>
+	class work_stealing_deque {
+	public:
+		explicit work_stealing_deque(std::int64_t capacity = 256)
+			: m_array(new array(capacity)) {}
+
+		work_stealing_deque(const work_stealing_deque&) = delete;
+		work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+		~work_stealing_deque() {
+			delete m_array.load(std::memory_order_relaxed);
+		}
+
+		void push(T* item) {
+			auto bottom = m_bottom.load(std::memory_order_relaxed);
+			auto top = m_top.load(std::memory_order_acquire);
+			auto* current = m_array.load(std::memory_order_relaxed);
+
+			if (bottom - top > current->capacity - 1) {
+				current = grow(current, bottom, top);
+			}
+
+			current->put(bottom, item);
+			std::atomic_thread_fence(std::memory_order_release);
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		T* pop() {
+			auto bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+			auto* current = m_array.load(std::memory_order_relaxed);
+			m_bottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto top = m_top.load(std::memory_order_relaxed);
+
+			if (top > bottom) {
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			T* item = current->get(bottom);
+			if (top == bottom) {
+				if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					item = nullptr;
+				}
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+			return item;
+		}
+
+		T* steal() {
+			auto top = m_top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto bottom = m_bottom.load(std::memory_order_acquire);
+
+			if (top >= bottom) {
+				return nullptr;
+			}
+
+			T* item = m_array.load(std::memory_order_acquire)->get(top);
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return nullptr;
+			}
+			return item;
+		}
+
+		std::size_t size() const {
+			auto bottom = m_bottom.load(std::memory_order_relaxed);
+			auto top = m_top.load(std::memory_order_relaxed);
+			return bottom > top ? static_cast<std::size_t>(bottom - top) : 0;
+		}
+
+		bool empty() const {
+			return size() == 0;
+		}
+
+	private:
+		struct array {
+			explicit array(std::int64_t size)
+				: capacity(size), mask(size - 1), buffer(new std::atomic<T*>[static_cast<std::size_t>(size)]) {}
+
+			T* get(std::int64_t index) const {
+				return buffer[index & mask].load(std::memory_order_relaxed);
+			}
+
+			void put(std::int64_t index, T* item) {
+				buffer[index & mask].store(item, std::memory_order_relaxed);
+			}
+
+			std::int64_t capacity;
+			std::int64_t mask;
+			std::unique_ptr<std::atomic<T*>[]> buffer;
+		};
+
+		array* grow(array* current, std::int64_t bottom, std::int64_t top) {
+			auto* bigger = new array(current->capacity * 2);
+			for (auto i = top; i != bottom; ++i) {
+				bigger->put(i, current->get(i));
+			}
+			// Thieves may still be reading the old buffer, keep it alive until the deque dies.
+			m_retired.emplace_back(current);
+			m_array.store(bigger, std::memory_order_release);
+			return bigger;
+		}
+
+		alignas(64) std::atomic<std::int64_t> m_top{ 0 };
+		alignas(64) std::atomic<std::int64_t> m_bottom{ 0 };
+		std::atomic<array*> m_array;
+		std::vector<std::unique_ptr<array>> m_retired;
+	};
+}
@@ -0,0 +1,88 @@
+#include "../../stdafx.hpp"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ve {
+	idle_policy idle_policy::latency() {
+		return { 4096, 4096, std::chrono::milliseconds(1) };
+	}
+
+	idle_policy idle_policy::balanced() {
+		return {};
+	}
+
+	idle_policy idle_policy::power() {
+		return { 0, 2, std::chrono::seconds(1) };
+	}
+
+	void shared_idle_policy::store(const idle_policy& policy) {
+		m_spin_rounds.store(policy.spin_rounds, std::memory_order_relaxed);
+		m_yield_rounds.store(policy.yield_rounds, std::memory_order_relaxed);
+		m_max_park.store(policy.max_park.count(), std::memory_order_relaxed);
+	}
+
+	idle_policy shared_idle_policy::load() const {
+		return {
+			m_spin_rounds.load(std::memory_order_relaxed),
+			m_yield_rounds.load(std::memory_order_relaxed),
+			std::chrono::steady_clock::duration(m_max_park.load(std::memory_order_relaxed)),
+		};
+	}
+
+	std::uint32_t idle_event::prepare() {
+		auto ticket = m_epoch.load(std::memory_order_seq_cst);
+		// Pairs with the load in notify(): either it sees the flag, or the caller's check for
+		// work that follows sees what was queued before notify().
+		m_waiting.store(true, std::memory_order_seq_cst);
+		return ticket;
+	}
+
+	void idle_event::cancel() {
+		m_waiting.store(false, std::memory_order_relaxed);
+	}
+
+	void idle_event::wait(std::uint32_t ticket, std::chrono::steady_clock::time_point deadline) {
+		auto timeout = std::chrono::ceil<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+		if (timeout.count() > 0) {
+			m_in_reactor.store(true, std::memory_order_seq_cst);
+			auto waited = m_epoch.load(std::memory_order_seq_cst) == ticket && wait_reactor(timeout);
+			m_in_reactor.store(false, std::memory_order_relaxed);
+
+			if (!waited) {
+#if defined(__linux__)
+				timespec relative{};
+				relative.tv_sec = timeout.count() / 1'000'000;
+				relative.tv_nsec = (timeout.count() % 1'000'000) * 1'000;
+				// Returns right away if notify() already moved the epoch on.
+				::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_epoch), FUTEX_WAIT_PRIVATE, ticket, &relative, nullptr, 0);
+#else
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_condition.wait_until(lock, deadline, [&] {
+					return m_epoch.load(std::memory_order_relaxed) != ticket;
+					});
+#endif
+			}
+		}
+		m_waiting.store(false, std::memory_order_relaxed);
+	}
+
+	void idle_event::notify() {
+		if (!m_waiting.load(std::memory_order_seq_cst)) return;
+
+		m_epoch.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__linux__)
+		::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&m_epoch), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+		}
+		m_condition.notify_one();
+#endif
+		if (m_in_reactor.load(std::memory_order_seq_cst)) {
+			interrupt_reactor();
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// What a scheduler loop does once it finds nothing to run. It spins with cpu_relax() for
+	// spin_rounds rounds, yields its time slice for yield_rounds more and then parks. A
+	// parked loop wakes on new work, completed I/O or its next timer, or after max_park.
+	struct idle_policy {
+		std::uint32_t spin_rounds = 32;
+		std::uint32_t yield_rounds = 32;
+		std::chrono::steady_clock::duration max_park = std::chrono::milliseconds(100);
+
+		// Picks up new work within microseconds but keeps a core busy for a long while after
+		// the last fiber ran.
+		static idle_policy latency();
+		// The default.
+		static idle_policy balanced();
+		// Parks almost right away. Waking costs a system call and the scheduler's latency.
+		static idle_policy power();
+	};
+
+	// An idle_policy that can be replaced from any thread while run loops read it. The fields
+	// are read one at a time, so a loop may mix the old and the new policy for one round.
+	class shared_idle_policy {
+	public:
+		void store(const idle_policy& policy);
+		idle_policy load() const;
+
+	private:
+		std::atomic<std::uint32_t> m_spin_rounds{ idle_policy{}.spin_rounds };
+		std::atomic<std::uint32_t> m_yield_rounds{ idle_policy{}.yield_rounds };
+		std::atomic<std::chrono::steady_clock::rep> m_max_park{ idle_policy{}.max_park.count() };
+	};
+
+	// Where one idle thread parks: a futex on Linux, a condition variable elsewhere. While
+	// I/O is in flight it waits in the reactor instead, so a completion wakes it as well.
+	class idle_event {
+	public:
+		// Call before the last check for work. Then either wait() with the result, or
+		// cancel() if work turned up.
+		std::uint32_t prepare();
+		void cancel();
+
+		// Returns once notified or at `deadline`, and sometimes earlier.
+		void wait(std::uint32_t ticket, std::chrono::steady_clock::time_point deadline);
+
+		// Wakes the thread if it is between prepare() and the end of wait(). Otherwise it is
+		// a single load, cheap enough for every submission.
+		void notify();
+
+		bool is_waiting() const {
+			return m_waiting.load(std::memory_order_seq_cst);
+		}
+
+	private:
+		std::atomic<std::uint32_t> m_epoch{ 0 };
+		std::atomic<bool> m_waiting{ false };
+		std::atomic<bool> m_in_reactor{ false };
+#if !defined(__linux__)
+		std::mutex m_Mutex;
+		std::condition_variable m_condition;
+#endif
+	};
+}
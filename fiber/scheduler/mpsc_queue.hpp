@@ -0,0 +1,46 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Intrusive lock-free inbox. Producers push with a single CAS; the consumer takes the
+	// whole batch with one exchange, so several consumers can also drain it safely.
+	template <typename T, T* T::* Next>
+	class mpsc_queue {
+	public:
+		void push(T* item) {
+			auto* head = m_head.load(std::memory_order_relaxed);
+			do {
+				item->*Next = head;
+			} while (!m_head.compare_exchange_weak(head, item, std::memory_order_seq_cst, std::memory_order_relaxed));
+		}
+
+		// Pushes a chain linked through Next from `first` (newest) to `last` (oldest) with a
+		// single CAS, as if `last` had been pushed first.
+		void push_chain(T* first, T* last) {
+			auto* head = m_head.load(std::memory_order_relaxed);
+			do {
+				last->*Next = head;
+			} while (!m_head.compare_exchange_weak(head, first, std::memory_order_seq_cst, std::memory_order_relaxed));
+		}
+
+		// Returns the pending items in push order, linked through Next.
+		T* take_all() {
+			auto* head = m_head.exchange(nullptr, std::memory_order_acquire);
+			T* reversed = nullptr;
+			while (head) {
+				auto* next = head->*Next;
+				head->*Next = reversed;
+				reversed = head;
+				head = next;
+			}
+			return reversed;
+		}
+
+		bool empty() const {
+			return m_head.load(std::memory_order_seq_cst) == nullptr;
+		}
+
+	private:
+		std::atomic<T*> m_head{ nullptr };
+	};
+}
@@ -0,0 +1,84 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	std::uint32_t ready_queue::level_of(int priority) {
+		return static_cast<std::uint32_t>(std::clamp(priority, 0, static_cast<int>(levels) - 1));
+	}
+
+	void ready_queue::push(fiber* script) {
+		script->m_ready_hook.since = m_dispatches;
+		link(script, level_of(script->priority()));
+	}
+
+	fiber* ready_queue::pop() {
+		if (m_bitmap == 0) return nullptr;
+
+		auto top = static_cast<std::uint32_t>(std::bit_width(m_bitmap) - 1);
+		if (m_aging_threshold) {
+			age(top);
+		}
+
+		auto* script = m_head[top];
+		unlink(script);
+		++m_dispatches;
+		return script;
+	}
+
+	void ready_queue::remove(fiber* script) {
+		if (script->m_ready_hook.linked) {
+			unlink(script);
+		}
+	}
+
+	void ready_queue::set_aging_threshold(std::optional<std::size_t> dispatches) {
+		m_aging_threshold = dispatches;
+	}
+
+	void ready_queue::link(fiber* script, std::uint32_t level) {
+		auto& hook = script->m_ready_hook;
+		hook.level = level;
+		hook.prev = m_tail[level];
+		hook.next = nullptr;
+		hook.linked = true;
+
+		if (m_tail[level]) m_tail[level]->m_ready_hook.next = script;
+		else m_head[level] = script;
+		m_tail[level] = script;
+
+		m_bitmap |= 1u << level;
+		++m_size;
+	}
+
+	void ready_queue::unlink(fiber* script) {
+		auto& hook = script->m_ready_hook;
+		auto level = hook.level;
+
+		if (hook.prev) hook.prev->m_ready_hook.next = hook.next;
+		else m_head[level] = hook.next;
+		if (hook.next) hook.next->m_ready_hook.prev = hook.prev;
+		else m_tail[level] = hook.prev;
+
+		if (!m_head[level]) m_bitmap &= ~(1u << level);
+
+		hook.prev = hook.next = nullptr;
+		hook.linked = false;
+		--m_size;
+	}
+
+	void ready_queue::age(std::uint32_t top) {
+		// Only the head of each lower level can be the longest waiter there.
+		auto lower = m_bitmap & ((1u << top) - 1);
+		while (lower) {
+			auto level = static_cast<std::uint32_t>(std::bit_width(lower) - 1);
+			lower &= ~(1u << level);
+
+			auto* oldest = m_head[level];
+			if (m_dispatches - oldest->m_ready_hook.since > *m_aging_threshold) {
+				auto since = oldest->m_ready_hook.since;
+				unlink(oldest);
+				link(oldest, level + 1);
+				oldest->m_ready_hook.since = since;
+			}
+		}
+	}
+}
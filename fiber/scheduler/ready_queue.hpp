@@ -0,0 +1,52 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	class fiber;
+
+	struct ready_hook {
+		fiber* prev{};
+		fiber* next{};
+		std::uint32_t level{};
+		std::uint64_t since{};
+		bool linked{};
+	};
+
+	// Intrusive FIFO per priority level with a bitmap of the non-empty levels, so both
+	// enqueue and picking the highest priority are O(1). Fibers whose priority falls
+	// outside [0, levels) are clamped.
+	class ready_queue {
+	public:
+		static constexpr std::size_t levels = 32;
+
+		void push(fiber* script);
+		fiber* pop();
+		void remove(fiber* script);
+
+		// Promotes a waiting fiber one level once it has been passed over for this many
+		// dispatches. std::nullopt turns aging off.
+		void set_aging_threshold(std::optional<std::size_t> dispatches);
+
+		std::size_t size() const {
+			return m_size;
+		}
+
+		bool empty() const {
+			return m_size == 0;
+		}
+
+		static std::uint32_t level_of(int priority);
+
+	private:
+		void link(fiber* script, std::uint32_t level);
+		void unlink(fiber* script);
+		void age(std::uint32_t top);
+
+		std::array<fiber*, levels> m_head{};
+		std::array<fiber*, levels> m_tail{};
+		std::uint32_t m_bitmap{ 0 };
+		std::size_t m_size{ 0 };
+		std::uint64_t m_dispatches{ 0 };
+		std::optional<std::uint64_t> m_aging_threshold{ 32 };
+	};
+}
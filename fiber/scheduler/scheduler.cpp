@@ -0,0 +1,412 @@
+#include "scheduler.hpp"
+
+namespace ve {
+	namespace {
+		// Idle rounds before a worker steals from another node, or fewer if it parks sooner.
+		// Until then its own node's workers get the first chance, and the fiber's stack stays
+		// where it is.
+		constexpr std::size_t remote_steal_rounds = 16;
+
+		thread_local scheduler* t_scheduler = nullptr;
+		thread_local std::size_t t_worker_index = 0;
+
+		bool is_runnable(const fiber* script) {
+			// A fiber in park_until() runs again once its deadline has passed.
+			return !script->is_disabled() && !script->is_suspended() && (!script->is_parked() || script->m_timed_park);
+		}
+
+		std::uint64_t next_random(std::uint64_t& state) {
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			return state;
+		}
+	}
+
+	scheduler::scheduler(std::size_t worker_count, std::optional<worker_placement> placement) {
+		if (worker_count == 0) {
+			throw std::invalid_argument("Scheduler needs at least one worker.");
+		}
+		if (placement && placement->topology.cpus.empty()) {
+			throw std::invalid_argument("Topology has no CPUs.");
+		}
+
+		std::vector<cpu_topology::cpu> cpus;
+		if (placement) {
+			cpus = placement->topology.placement(worker_count);
+			m_pin_threads = placement->pin_threads;
+			m_multi_node = placement->topology.node_count() > 1;
+		}
+
+		m_workers.reserve(worker_count);
+		for (std::size_t i = 0; i < worker_count; ++i) {
+			auto w = std::make_unique<worker>();
+			w->index = i;
+			if (!cpus.empty()) {
+				w->cpu = cpus[i].id;
+				w->node = cpus[i].node;
+			}
+			// Every queued fiber runs once per round, so nothing can starve.
+			w->next_round.set_aging_threshold(std::nullopt);
+			w->rng = 0x9E3779B97F4A7C15ull * (i + 1);
+			m_workers.push_back(std::move(w));
+		}
+	}
+
+	scheduler::~scheduler() {
+		stop();
+	}
+
+	void scheduler::start() {
+		if (m_running.exchange(true)) return;
+
+		for (auto& w : m_workers) {
+			w->thread = std::thread([this, self = w.get()] { worker_loop(*self); });
+		}
+	}
+
+	std::vector<fiber*> scheduler::stop() {
+		std::vector<fiber*> queued;
+		if (!m_running.exchange(false)) return queued;
+
+		for (auto& w : m_workers) {
+			wake(*w);
+		}
+		for (auto& w : m_workers) {
+			if (w->thread.joinable()) w->thread.join();
+		}
+
+		for (auto* script = m_injector.take_all(); script; script = script->m_next_ready) {
+			queued.push_back(script);
+		}
+		for (auto& w : m_workers) {
+			for (auto* script = w->inbox.take_all(); script; script = script->m_next_ready) {
+				if (script->take_park_claim()) w->timers.cancel(script->m_timer);
+				queued.push_back(script);
+			}
+			while (auto* script = w->deque.pop()) queued.push_back(script);
+			queued.insert(queued.end(), w->pinned.begin(), w->pinned.end());
+			while (auto* script = w->next_round.pop()) queued.push_back(script);
+			w->timers.clear([&](timer_node& node) {
+				auto* script = static_cast<fiber*>(node.data);
+				if (script->expire_park_timer()) queued.push_back(script);
+				});
+			w->pinned.clear();
+		}
+		return queued;
+	}
+
+	void scheduler::submit(fiber* script) {
+		auto affinity = script->pinned_worker();
+
+		if (t_scheduler == this && (!affinity || *affinity == t_worker_index)) {
+			enqueue_local(*m_workers[t_worker_index], script);
+			return;
+		}
+
+		if (affinity && *affinity < m_workers.size()) {
+			auto& target = *m_workers[*affinity];
+			target.inbox.push(script);
+			wake(target);
+			return;
+		}
+
+		m_injector.push(script);
+		wake_one();
+	}
+
+	void scheduler::submit(std::span<fiber* const> scripts) {
+		fiber* newest = nullptr;
+		fiber* oldest = nullptr;
+		std::size_t injected = 0;
+		for (auto* script : scripts) {
+			auto affinity = script->pinned_worker();
+			if (affinity || t_scheduler == this) {
+				submit(script);
+				continue;
+			}
+			script->m_next_ready = newest;
+			newest = script;
+			if (!oldest) oldest = script;
+			++injected;
+		}
+
+		if (newest) {
+			m_injector.push_chain(newest, oldest);
+			wake_some(injected);
+		}
+	}
+
+	void scheduler::submit_claimed(fiber* script) {
+		auto owner = static_cast<std::size_t>(script->park_timer_owner());
+		auto& target = *m_workers[owner < m_workers.size() ? owner : 0];
+		target.inbox.push(script);
+		wake(target);
+	}
+
+	void scheduler::set_idle_policy(const idle_policy& policy) {
+		m_idle_policy.store(policy);
+		// Parked workers pick up a shorter max_park now rather than at their next wakeup.
+		for (auto& w : m_workers) {
+			wake(*w);
+		}
+	}
+
+	idle_policy scheduler::get_idle_policy() const {
+		return m_idle_policy.load();
+	}
+
+	std::size_t scheduler::worker_count() const {
+		return m_workers.size();
+	}
+
+	std::vector<worker_stats> scheduler::get_stats() const {
+		std::vector<worker_stats> result;
+		result.reserve(m_workers.size());
+		for (const auto& w : m_workers) {
+			std::optional<std::uint32_t> cpu;
+			if (w->cpu_pinned.load(std::memory_order_relaxed)) cpu = w->cpu;
+			result.push_back({ w->executed_slices.load(std::memory_order_relaxed), w->stolen.load(std::memory_order_relaxed), w->deque.size(),
+				cpu, w->node, w->stolen_remote.load(std::memory_order_relaxed) });
+		}
+		return result;
+	}
+
+	std::optional<std::size_t> scheduler::current_worker() {
+		if (!t_scheduler) return std::nullopt;
+		return t_worker_index;
+	}
+
+	void scheduler::worker_loop(worker& self) {
+		t_scheduler = this;
+		t_worker_index = self.index;
+		if constexpr (VE_TRACE_LEVEL > 0) {
+			trace_thread_name("worker " + std::to_string(self.index));
+		}
+		if (self.cpu) {
+			set_current_numa_node(self.node);
+			if (m_pin_threads && pin_current_thread(*self.cpu)) {
+				self.cpu_pinned.store(true, std::memory_order_relaxed);
+			}
+		}
+
+		while (m_running.load(std::memory_order_acquire)) {
+			if (!self.timers.empty()) {
+				self.timers.advance(std::chrono::steady_clock::now(), [&](timer_node& node) {
+					auto* script = static_cast<fiber*>(node.data);
+					if (!script->expire_park_timer()) return;
+					VE_TRACE(2, trace_type::wake, script->trace_id(), 0);
+					enqueue_local(self, script);
+					});
+			}
+			poll_reactor();
+
+			if (auto* script = find_work(self)) {
+				run(self, script);
+				self.idle_rounds = 0;
+				continue;
+			}
+
+			auto policy = m_idle_policy.load();
+			self.park_rounds = std::size_t{ policy.spin_rounds } + policy.yield_rounds;
+			if (self.idle_rounds < policy.spin_rounds) {
+				++self.idle_rounds;
+				cpu_relax();
+				continue;
+			}
+			if (self.idle_rounds < self.park_rounds) {
+				++self.idle_rounds;
+				std::this_thread::yield();
+				continue;
+			}
+
+			// Work that showed up meanwhile keeps the count, so remote stealing stays allowed.
+			if (idle(self, policy)) self.idle_rounds = 0;
+		}
+
+		set_current_numa_node(std::nullopt);
+		t_scheduler = nullptr;
+	}
+
+	fiber* scheduler::find_work(worker& self) {
+		for (auto* script = self.inbox.take_all(); script;) {
+			auto* next = script->m_next_ready;
+			if (script->take_park_claim()) self.timers.cancel(script->m_timer);
+			enqueue_local(self, script);
+			script = next;
+		}
+
+		if (!self.pinned.empty()) {
+			auto* script = self.pinned.back();
+			self.pinned.pop_back();
+			return script;
+		}
+
+		if (auto* script = self.deque.pop()) {
+			return script;
+		}
+
+		if (auto* script = m_injector.take_all()) {
+			while (script) {
+				auto* next = script->m_next_ready;
+				enqueue_local(self, script);
+				script = next;
+			}
+			if (auto* local = self.deque.pop()) {
+				return local;
+			}
+		}
+
+		if (!self.next_round.empty()) {
+			// The deque pops LIFO, so push the lowest priority first; thieves take from the
+			// other end and get the least urgent work.
+			while (auto* script = self.next_round.pop()) {
+				self.flush.push_back(script);
+			}
+			for (auto it = self.flush.rbegin(); it != self.flush.rend(); ++it) {
+				enqueue_local(self, *it);
+			}
+			self.flush.clear();
+			if (self.deque.size() > 1) {
+				wake_one();
+			}
+			return find_work(self);
+		}
+
+		return steal(self);
+	}
+
+	fiber* scheduler::steal(worker& self) {
+		auto count = m_workers.size();
+		if (count < 2) return nullptr;
+
+		// The first pass covers the worker's own node, the second the others.
+		auto start = next_random(self.rng) % count;
+		for (int pass = 0; pass < 2; ++pass) {
+			bool remote = pass == 1;
+			if (remote && (!m_multi_node || self.idle_rounds < std::min(remote_steal_rounds, self.park_rounds))) break;
+
+			for (std::size_t i = 0; i < count; ++i) {
+				auto& victim = *m_workers[(start + i) % count];
+				if (&victim == &self || (victim.node != self.node) != remote) continue;
+
+				if (auto* script = victim.deque.steal()) {
+					self.stolen.fetch_add(1, std::memory_order_relaxed);
+					if (remote) self.stolen_remote.fetch_add(1, std::memory_order_relaxed);
+					return script;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	void scheduler::run(worker& self, fiber* script) {
+		auto affinity = script->pinned_worker();
+		if (affinity && *affinity != self.index && *affinity < m_workers.size()) {
+			auto& target = *m_workers[*affinity];
+			target.inbox.push(script);
+			wake(target);
+			return;
+		}
+
+		script->tick();
+		self.executed_slices.fetch_add(1, std::memory_order_relaxed);
+
+		if (script->is_finished()) {
+			// Stays marked as scheduled, so nothing queues it again. The manager may destroy
+			// it right away.
+			if (script->m_manager) script->m_manager->reap(script);
+			return;
+		}
+
+		if (!script->is_disabled() && script->is_sleeping(std::chrono::steady_clock::now())) {
+			self.timers.schedule(script->m_timer, *script->m_time);
+			if (script->m_timed_park && !script->arm_park_timer(static_cast<std::int32_t>(self.index))) {
+				self.timers.cancel(script->m_timer);
+				script->m_time.reset();
+				self.next_round.push(script);
+			}
+			return;
+		}
+
+		if (is_runnable(script)) {
+			self.next_round.push(script);
+			return;
+		}
+
+		script->m_scheduled.store(false, std::memory_order_seq_cst);
+		// A resume() or unpark() that raced with the check above saw the flag still set and
+		// left the fiber to us, so take it back.
+		if (is_runnable(script) && !script->m_scheduled.exchange(true, std::memory_order_acq_rel)) {
+			self.next_round.push(script);
+		}
+	}
+
+	void scheduler::enqueue_local(worker& self, fiber* script) {
+		auto affinity = script->pinned_worker();
+		if (affinity && *affinity == self.index) {
+			self.pinned.push_back(script);
+		}
+		else {
+			self.deque.push(script);
+		}
+	}
+
+	bool scheduler::has_work(const worker& self) const {
+		if (!self.inbox.empty() || !m_injector.empty()) return true;
+		for (const auto& w : m_workers) {
+			if (!w->deque.empty()) return true;
+		}
+		return false;
+	}
+
+	bool scheduler::idle(worker& self, const idle_policy& policy) {
+		if (!self.pinned.empty() || !self.next_round.empty()) return false;
+
+		// The worker's own timers can only fire on it, so they bound the wait.
+		auto deadline = std::chrono::steady_clock::now() + policy.max_park;
+		if (auto next = self.timers.next_deadline()) deadline = std::min(deadline, *next);
+
+		auto ticket = self.event.prepare();
+		if (has_work(self) || !m_running.load(std::memory_order_seq_cst)) {
+			self.event.cancel();
+			return false;
+		}
+
+		self.event.wait(ticket, deadline);
+		return true;
+	}
+
+	void scheduler::wake(worker& target) {
+		target.event.notify();
+	}
+
+	void scheduler::wake_some(std::size_t count) {
+		for (auto& w : m_workers) {
+			if (count == 0) return;
+			if (w->event.is_waiting()) {
+				wake(*w);
+				--count;
+			}
+		}
+	}
+
+	void scheduler::wake_one() {
+		// A sleeper on the waker's node can steal the work without crossing nodes.
+		if (m_multi_node && t_scheduler == this) {
+			auto node = m_workers[t_worker_index]->node;
+			for (auto& w : m_workers) {
+				if (w->node == node && w->event.is_waiting()) {
+					wake(*w);
+					return;
+				}
+			}
+		}
+		for (auto& w : m_workers) {
+			if (w->event.is_waiting()) {
+				wake(*w);
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	class scheduler {
+	public:
+		struct worker_placement {
+			cpu_topology topology;
+			// Off leaves the threads floating but keeps their node assignment.
+			bool pin_threads = true;
+		};
+
+		// Without a placement the threads float and all count as one node. With one, worker
+		// i gets CPU placement(worker_count)[i], allocates stacks on its node and steals from
+		// its own node first.
+		explicit scheduler(std::size_t worker_count, std::optional<worker_placement> placement = std::nullopt);
+		~scheduler();
+
+		scheduler(const scheduler&) = delete;
+		scheduler& operator=(const scheduler&) = delete;
+
+		void start();
+
+		// Joins the workers and returns every fiber that was still queued or sleeping. Their
+		// scheduled flag is left set, ownership passes to the caller.
+		std::vector<fiber*> stop();
+
+		// Makes a fiber runnable. The caller must own the fiber's scheduled flag.
+		void submit(fiber* script);
+
+		// Same for many fibers at once: unpinned ones go to the injector in one push, and as
+		// many sleeping workers are woken as there are fibers.
+		void submit(std::span<fiber* const> scripts);
+
+		// Returns a fiber claimed out of a park_until() to the worker whose timer holds it.
+		void submit_claimed(fiber* script);
+
+		// Takes effect at each worker's next idle round.
+		void set_idle_policy(const idle_policy& policy);
+		idle_policy get_idle_policy() const;
+
+		std::size_t worker_count() const;
+		std::vector<worker_stats> get_stats() const;
+
+		static std::optional<std::size_t> current_worker();
+
+	private:
+		struct worker {
+			std::size_t index{};
+			std::thread thread;
+			work_stealing_deque<fiber> deque;
+			mpsc_queue<fiber, &fiber::m_next_ready> inbox;
+			std::vector<fiber*> pinned;
+			ready_queue next_round;
+			std::vector<fiber*> flush;
+			timer_wheel timers;
+			std::uint64_t rng{};
+			std::optional<std::uint32_t> cpu;
+			std::uint32_t node{};
+			std::size_t idle_rounds{};
+			// Idle rounds before it parks, from the policy.
+			std::size_t park_rounds{};
+			std::atomic<bool> cpu_pinned{ false };
+			idle_event event;
+			std::atomic<std::size_t> executed_slices{ 0 };
+			std::atomic<std::size_t> stolen{ 0 };
+			std::atomic<std::size_t> stolen_remote{ 0 };
+		};
+
+		void worker_loop(worker& self);
+		fiber* find_work(worker& self);
+		fiber* steal(worker& self);
+		void run(worker& self, fiber* script);
+		void enqueue_local(worker& self, fiber* script);
+		bool has_work(const worker& self) const;
+		bool idle(worker& self, const idle_policy& policy);
+		void wake(worker& target);
+		void wake_one();
+		void wake_some(std::size_t count);
+
+		std::vector<std::unique_ptr<worker>> m_workers;
+		mpsc_queue<fiber, &fiber::m_next_ready> m_injector;
+		std::atomic<bool> m_running{ false };
+		shared_idle_policy m_idle_policy;
+		bool m_pin_threads = false;
+		bool m_multi_node = false;
+	};
+}
@@ -0,0 +1,186 @@
+#include "../../stdafx.hpp"
+
+#include <cctype>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace ve {
+	namespace {
+		thread_local std::optional<std::uint32_t> t_numa_node;
+
+		std::optional<std::string> read_line(const std::filesystem::path& file) {
+			std::ifstream in(file);
+			std::string line;
+			if (!in || !std::getline(in, line)) return std::nullopt;
+			return line;
+		}
+
+		std::uint32_t parse_number(std::string_view text) {
+			if (text.empty() || text.size() > 9 || !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+				throw std::invalid_argument("Malformed CPU list: '" + std::string(text) + "'.");
+			}
+			std::uint32_t value = 0;
+			for (char c : text) value = value * 10 + static_cast<std::uint32_t>(c - '0');
+			return value;
+		}
+
+		std::string_view trim(std::string_view text) {
+			while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+			while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+			return text;
+		}
+	}
+
+	std::vector<std::uint32_t> parse_cpu_list(std::string_view list) {
+		std::vector<std::uint32_t> cpus;
+		list = trim(list);
+		while (!list.empty()) {
+			auto comma = list.find(',');
+			auto range = trim(list.substr(0, comma));
+			list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+
+			auto dash = range.find('-');
+			auto first = parse_number(trim(range.substr(0, dash)));
+			auto last = dash == std::string_view::npos ? first : parse_number(trim(range.substr(dash + 1)));
+			if (last < first) {
+				throw std::invalid_argument("Malformed CPU list: '" + std::string(range) + "'.");
+			}
+			for (auto id = first; id <= last; ++id) cpus.push_back(id);
+		}
+		return cpus;
+	}
+
+	cpu_topology cpu_topology::detect(const std::filesystem::path& root) {
+		cpu_topology result;
+		std::vector<std::uint32_t> online;
+		try {
+			if (auto line = read_line(root / "cpu" / "online")) online = parse_cpu_list(*line);
+		}
+		catch (const std::invalid_argument&) {
+			online.clear();
+		}
+		if (online.empty()) {
+			auto count = std::max(std::thread::hardware_concurrency(), 1u);
+			for (std::uint32_t id = 0; id < count; ++id) online.push_back(id);
+		}
+
+		std::unordered_map<std::uint32_t, std::uint32_t> node_of;
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(root / "node", error)) {
+			auto name = entry.path().filename().string();
+			if (name.size() <= 4 || name.compare(0, 4, "node") != 0) continue;
+			try {
+				auto node = parse_number(std::string_view(name).substr(4));
+				if (auto line = read_line(entry.path() / "cpulist")) {
+					for (auto id : parse_cpu_list(*line)) node_of[id] = node;
+				}
+			}
+			catch (const std::invalid_argument&) {
+				continue;
+			}
+		}
+
+		for (auto id : online) {
+			auto found = node_of.find(id);
+			result.cpus.push_back({ id, found != node_of.end() ? found->second : 0 });
+		}
+		return result;
+	}
+
+	cpu_topology cpu_topology::simulated(std::string_view config) {
+		cpu_topology result;
+		std::uint32_t node = 0;
+		while (true) {
+			auto semicolon = config.find(';');
+			for (auto id : parse_cpu_list(config.substr(0, semicolon))) {
+				result.cpus.push_back({ id, node });
+			}
+			if (semicolon == std::string_view::npos) break;
+			config.remove_prefix(semicolon + 1);
+			++node;
+		}
+		if (result.cpus.empty()) {
+			throw std::invalid_argument("Topology has no CPUs.");
+		}
+		return result;
+	}
+
+	std::size_t cpu_topology::node_count() const {
+		std::vector<std::uint32_t> nodes;
+		for (const auto& c : cpus) {
+			if (std::find(nodes.begin(), nodes.end(), c.node) == nodes.end()) nodes.push_back(c.node);
+		}
+		return nodes.size();
+	}
+
+	std::vector<cpu_topology::cpu> cpu_topology::placement(std::size_t workers) const {
+		std::vector<std::vector<cpu>> by_node;
+		std::vector<std::uint32_t> nodes;
+		for (const auto& c : cpus) {
+			auto it = std::find(nodes.begin(), nodes.end(), c.node);
+			if (it == nodes.end()) {
+				nodes.push_back(c.node);
+				by_node.emplace_back();
+				it = nodes.end() - 1;
+			}
+			by_node[it - nodes.begin()].push_back(c);
+		}
+
+		std::vector<cpu> order;
+		order.reserve(cpus.size());
+		for (std::size_t round = 0; order.size() < cpus.size(); ++round) {
+			for (const auto& group : by_node) {
+				if (round < group.size()) order.push_back(group[round]);
+			}
+		}
+
+		std::vector<cpu> result;
+		result.reserve(workers);
+		for (std::size_t i = 0; i < workers && !order.empty(); ++i) {
+			result.push_back(order[i % order.size()]);
+		}
+		return result;
+	}
+
+	bool pin_current_thread(std::uint32_t cpu) {
+#if defined(__linux__)
+		if (cpu >= CPU_SETSIZE) return false;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+		if (cpu >= sizeof(DWORD_PTR) * 8) return false;
+		return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{ 1 } << cpu) != 0;
+#else
+		(void)cpu;
+		return false;
+#endif
+	}
+
+	std::optional<std::uint32_t> current_numa_node() {
+		return t_numa_node;
+	}
+
+	void set_current_numa_node(std::optional<std::uint32_t> node) {
+		t_numa_node = node;
+	}
+
+	void bind_to_numa_node(void* base, std::size_t size, std::uint32_t node) {
+#if defined(__linux__) && defined(SYS_mbind)
+		// MPOL_PREFERRED: falls back to other nodes rather than failing when this one is full.
+		constexpr int preferred = 1;
+		constexpr std::size_t bits = sizeof(unsigned long) * 8;
+		std::vector<unsigned long> mask(node / bits + 1, 0);
+		mask[node / bits] |= 1ul << (node % bits);
+		syscall(SYS_mbind, base, size, preferred, mask.data(), mask.size() * bits + 1, 0u);
+#else
+		(void)base;
+		(void)size;
+		(void)node;
+#endif
+	}
+}
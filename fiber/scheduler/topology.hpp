@@ -0,0 +1,57 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Logical CPUs and the NUMA node each belongs to.
+	struct cpu_topology {
+		struct cpu {
+			std::uint32_t id;
+			std::uint32_t node;
+		};
+
+		std::vector<cpu> cpus;
+
+		// Reads the online CPUs from `root`/cpu and their nodes from `root`/node. Without
+		// node information every CPU is on node 0, without CPU information there is one per
+		// hardware thread.
+		static cpu_topology detect(const std::filesystem::path& root = "/sys/devices/system");
+
+		// One CPU list per node, separated by ';', in the sysfs list format: "0-3;4-7" is
+		// two nodes of four CPUs. Runs the multi-node paths on a single-node machine.
+		static cpu_topology simulated(std::string_view config);
+
+		std::size_t node_count() const;
+
+		// The CPU for each of `workers` workers, alternating between nodes so every node
+		// gets its share. Wraps around when there are more workers than CPUs.
+		std::vector<cpu> placement(std::size_t workers) const;
+	};
+
+	// Per scheduler worker.
+	struct worker_stats {
+		std::size_t executed_slices;
+		std::size_t stolen;
+		std::size_t queued;
+		// Set once the thread is pinned.
+		std::optional<std::uint32_t> cpu;
+		std::uint32_t node;
+		// Part of `stolen` taken from a worker on another node.
+		std::size_t stolen_remote;
+	};
+
+	// Parses a sysfs CPU list such as "0-3,8,10-11". Throws std::invalid_argument.
+	std::vector<std::uint32_t> parse_cpu_list(std::string_view list);
+
+	// Restricts the calling thread to one CPU. Returns false if the system refuses, e.g.
+	// for a CPU that only exists in a simulated topology.
+	bool pin_current_thread(std::uint32_t cpu);
+
+	// The node the calling thread allocates fiber stacks for. Scheduler workers started
+	// with a topology set it, other threads have none.
+	std::optional<std::uint32_t> current_numa_node();
+	void set_current_numa_node(std::optional<std::uint32_t> node);
+
+	// Asks the kernel to back [base, base + size) with memory from `node`. Best effort:
+	// failures, and platforms without a way to ask, leave it to first-touch placement.
+	void bind_to_numa_node(void* base, std::size_t size, std::uint32_t node);
+}
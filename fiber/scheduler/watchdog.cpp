@@ -0,0 +1,177 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	namespace {
+		// What a thread is running right now. The watchdog only dereferences `running` while
+		// `inspecting` is set, and leave() waits for it to clear, so the fiber stays alive.
+		struct run_slot {
+			std::atomic<fiber*> running{ nullptr };
+			std::atomic<std::uint64_t> slice{ 0 };
+			std::atomic<std::uint64_t> begin{ 0 };
+			std::atomic<bool> inspecting{ false };
+
+			// Watchdog thread only.
+			std::uint64_t checked_slice = 0;
+			bool reported = false;
+		};
+
+		struct slot_registry {
+			std::mutex mutex;
+			std::vector<run_slot*> slots;
+		};
+
+		slot_registry& registry() {
+			static slot_registry instance;
+			return instance;
+		}
+
+		struct thread_slot {
+			run_slot slot;
+
+			thread_slot() {
+				auto& shared = registry();
+				std::lock_guard<std::mutex> lock(shared.mutex);
+				shared.slots.push_back(&slot);
+			}
+
+			~thread_slot() {
+				auto& shared = registry();
+				std::lock_guard<std::mutex> lock(shared.mutex);
+				shared.slots.erase(std::remove(shared.slots.begin(), shared.slots.end(), &slot), shared.slots.end());
+			}
+		};
+
+		run_slot& this_thread_slot() {
+			thread_local thread_slot local;
+			return local.slot;
+		}
+	}
+
+	watchdog& watchdog::instance() {
+		// The registry must outlive the watchdog thread, which is joined on exit.
+		registry();
+		static watchdog instance;
+		return instance;
+	}
+
+	watchdog::~watchdog() {
+		stop();
+	}
+
+	void watchdog::start(std::chrono::nanoseconds slice_budget) {
+		if (slice_budget <= std::chrono::nanoseconds::zero()) {
+			throw std::invalid_argument("Slice budget must be positive.");
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_budget = slice_budget;
+		if (m_running) {
+			m_wake.notify_all();
+			return;
+		}
+		m_running = true;
+		s_enabled.store(true, std::memory_order_relaxed);
+		m_thread = std::thread([this] { run(); });
+	}
+
+	void watchdog::stop() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_running) return;
+			m_running = false;
+			s_enabled.store(false, std::memory_order_relaxed);
+		}
+		m_wake.notify_all();
+		m_thread.join();
+	}
+
+	bool watchdog::is_running() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_running;
+	}
+
+	void watchdog::set_overrun_callback(overrun_callback callback) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_callback = std::move(callback);
+	}
+
+	std::size_t watchdog::overruns() const {
+		return m_overruns.load(std::memory_order_relaxed);
+	}
+
+	void watchdog::enter(fiber* script, std::uint64_t begin) noexcept {
+		auto& slot = this_thread_slot();
+		slot.begin.store(begin, std::memory_order_relaxed);
+		slot.slice.fetch_add(1, std::memory_order_relaxed);
+		slot.running.store(script, std::memory_order_release);
+	}
+
+	void watchdog::leave() noexcept {
+		auto& slot = this_thread_slot();
+		slot.running.store(nullptr, std::memory_order_seq_cst);
+		while (slot.inspecting.load(std::memory_order_seq_cst)) {
+			std::this_thread::yield();
+		}
+	}
+
+	void watchdog::run() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (m_running) {
+			auto budget = m_budget;
+			m_wake.wait_for(lock, std::max<std::chrono::nanoseconds>(budget / 4, std::chrono::microseconds(50)));
+			if (!m_running) break;
+			auto callback = m_callback;
+			lock.unlock();
+
+			auto& shared = registry();
+			{
+				std::lock_guard<std::mutex> slots(shared.mutex);
+				for (auto* slot : shared.slots) {
+					auto slice = slot->slice.load(std::memory_order_acquire);
+					if (slice != slot->checked_slice) {
+						slot->checked_slice = slice;
+						slot->reported = false;
+					}
+					if (!slot->running.load(std::memory_order_acquire)) continue;
+
+					auto elapsed = std::chrono::nanoseconds(cycle_clock::to_ns(cycle_clock::now() - slot->begin.load(std::memory_order_relaxed)));
+					if (elapsed < budget) continue;
+
+					// Pins the fiber: leave() cannot return while `inspecting` is set.
+					slot->inspecting.store(true, std::memory_order_seq_cst);
+					auto* script = slot->running.load(std::memory_order_seq_cst);
+					if (script && slot->slice.load(std::memory_order_relaxed) == slice) {
+						auto timeout = script->termination_timeout();
+						if (timeout && elapsed >= *timeout && !script->is_disabled()) {
+							VE_TRACE(1, trace_type::fiber_terminate, script->trace_id(), 0);
+							script->terminate();
+						}
+						if (!slot->reported) {
+							slot->reported = true;
+							script->interrupt();
+							m_overruns.fetch_add(1, std::memory_order_relaxed);
+							if (callback) {
+								try {
+									callback(*script, elapsed, script->runtime());
+								}
+								catch (const std::exception& e) {
+									std::cerr << std::string("[Watchdog] Overrun callback error: ") + e.what() + "\n";
+								}
+							}
+						}
+					}
+					slot->inspecting.store(false, std::memory_order_seq_cst);
+				}
+			}
+			lock.lock();
+		}
+	}
+
+	bool yield_if_needed() {
+		auto* self = fiber::current();
+		if (!self || !self->m_interrupted.load(std::memory_order_relaxed)) return false;
+		self->m_interrupted.store(false, std::memory_order_relaxed);
+		self->sleep();
+		return true;
+	}
+}
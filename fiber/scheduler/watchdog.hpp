@@ -0,0 +1,54 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	class fiber;
+
+	// Watches the fiber slice running on every thread. A slice longer than the budget gets
+	// its fiber interrupted, so the next yield_if_needed() switches out, and is reported to
+	// the overrun callback. A slice longer than the fiber's termination timeout also gets
+	// the fiber terminated: it is not resumed once it switches out.
+	class watchdog {
+	public:
+		// Runs on the watchdog thread while the offending slice is still running, and that
+		// thread's next switch waits for it to return. Keep it short.
+		using overrun_callback = std::function<void(fiber& script, std::chrono::nanoseconds slice, const fiber_runtime& stats)>;
+
+		static watchdog& instance();
+
+		// Samples every quarter of the budget. Calling it again changes the budget.
+		void start(std::chrono::nanoseconds slice_budget);
+		void stop();
+		bool is_running() const;
+
+		void set_overrun_callback(overrun_callback callback);
+		std::size_t overruns() const;
+
+		// Called by fiber::tick() around each slice while the watchdog runs.
+		static bool enabled() noexcept {
+			return s_enabled.load(std::memory_order_relaxed);
+		}
+		static void enter(fiber* script, std::uint64_t begin) noexcept;
+		static void leave() noexcept;
+
+		~watchdog();
+
+	private:
+		watchdog() = default;
+		void run();
+
+		inline static std::atomic<bool> s_enabled{ false };
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::thread m_thread;
+		bool m_running = false;
+		std::chrono::nanoseconds m_budget{};
+		overrun_callback m_callback;
+		std::atomic<std::size_t> m_overruns{ 0 };
+	};
+
+	// Preemption point for long loops. Switches out if the fiber was interrupted, by the
+	// watchdog or by interrupt(), and returns true once it runs again. A no-op outside a fiber.
+	bool yield_if_needed();
+}
@@ -0,0 +1,179 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	namespace {
+		constexpr int spin_rounds = 100;
+		// select() over more channels than this allocates its waits.
+		constexpr std::size_t inline_waits = 4;
+
+		std::optional<std::size_t> attempt_all(std::span<select_case* const> cases) {
+			for (std::size_t i = 0; i < cases.size(); ++i) {
+				if (cases[i]->attempt() != channel_core::result::blocked) return i;
+			}
+			return std::nullopt;
+		}
+	}
+
+	void channel_core::enlist(channel_wait& wait, bool sender) {
+		std::lock_guard<spin_lock> guard(m_guard);
+		auto& queue = side(sender);
+		wait.next = nullptr;
+		wait.prev = queue.tail;
+		if (queue.tail) queue.tail->next = &wait;
+		else queue.head = &wait;
+		queue.tail = &wait;
+		wait.linked = true;
+		// Ordered against the counter stores of a single channel, see send_once().
+		m_waiting.fetch_add(1, std::memory_order_seq_cst);
+	}
+
+	void channel_core::delist(channel_wait& wait, bool sender) {
+		std::lock_guard<spin_lock> guard(m_guard);
+		if (wait.linked) unlink(side(sender), wait);
+	}
+
+	void channel_core::pass_on(bool sender) {
+		wait_node* woken;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			woken = claim_one(sender);
+		}
+		if (woken) notify_waiter(woken);
+	}
+
+	wait_node* channel_core::claim_one(bool sender) {
+		auto& queue = side(sender);
+		while (auto* wait = queue.head) {
+			unlink(queue, *wait);
+			// Loses to another channel that got there first, or to a waiter that gave up.
+			int expected = -1;
+			if (wait->waiter->woken_by.compare_exchange_strong(expected, wait->index, std::memory_order_acq_rel)) {
+				return &wait->waiter->node;
+			}
+		}
+		return nullptr;
+	}
+
+	wait_node* channel_core::claim_all() {
+		wait_node* chain = nullptr;
+		for (bool sender : { false, true }) {
+			while (auto* node = claim_one(sender)) {
+				node->next = chain;
+				chain = node;
+			}
+		}
+		return chain;
+	}
+
+	void channel_core::close_core() {
+		wait_node* woken;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			m_closed.store(true, std::memory_order_seq_cst);
+			woken = claim_all();
+		}
+		notify_waiters(woken);
+	}
+
+	void channel_core::unlink(wait_queue& queue, channel_wait& wait) {
+		if (wait.prev) wait.prev->next = wait.next;
+		else queue.head = wait.next;
+		if (wait.next) wait.next->prev = wait.prev;
+		else queue.tail = wait.prev;
+		wait.prev = wait.next = nullptr;
+		wait.linked = false;
+		m_waiting.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	std::optional<std::size_t> select_until(std::span<select_case* const> cases, std::optional<std::chrono::steady_clock::time_point> deadline) {
+		if (cases.empty()) {
+			throw std::invalid_argument("select() needs at least one case.");
+		}
+
+		if (auto done = attempt_all(cases)) return done;
+		if (should_spin()) {
+			for (int i = 0; i < spin_rounds; ++i) {
+				cpu_relax();
+				if (auto done = attempt_all(cases)) return done;
+			}
+		}
+
+		std::array<channel_wait, inline_waits> inline_storage;
+		std::vector<channel_wait> heap_storage;
+		if (cases.size() > inline_waits) heap_storage.resize(cases.size());
+		std::span<channel_wait> waits = heap_storage.empty()
+			? std::span<channel_wait>(inline_storage.data(), cases.size())
+			: std::span<channel_wait>(heap_storage);
+
+		channel_waiter waiter;
+		// Withdraws from every channel. Returns the case whose channel claimed the waiter,
+		// which then owes a wakeup to someone else if that case does not complete.
+		auto settle = [&](bool notified) -> std::optional<std::size_t> {
+			int expected = -1;
+			if (waiter.woken_by.compare_exchange_strong(expected, channel_waiter::withdrawn, std::memory_order_acq_rel)) {
+				cancel_wait(waiter.node);
+			}
+			else if (!notified) {
+				// The claimer notifies once it drops its lock, and the node lives on our stack.
+				wait_for_notify(waiter.node);
+			}
+			for (std::size_t i = 0; i < cases.size(); ++i) {
+				cases[i]->target().delist(waits[i], cases[i]->is_send());
+			}
+			return expected >= 0 ? std::optional<std::size_t>(static_cast<std::size_t>(expected)) : std::nullopt;
+		};
+		auto owe = [&](std::optional<std::size_t> claimed, std::optional<std::size_t> done) {
+			if (claimed && claimed != done) {
+				cases[*claimed]->target().pass_on(cases[*claimed]->is_send());
+			}
+		};
+
+		std::optional<std::size_t> claimed;
+		while (true) {
+			if (deadline && std::chrono::steady_clock::now() >= *deadline) {
+				owe(claimed, std::nullopt);
+				return std::nullopt;
+			}
+
+			waiter.woken_by.store(-1, std::memory_order_relaxed);
+			prepare_wait(waiter.node);
+			for (std::size_t i = 0; i < cases.size(); ++i) {
+				waits[i] = channel_wait{ &waiter, static_cast<int>(i) };
+				cases[i]->target().enlist(waits[i], cases[i]->is_send());
+			}
+
+			// A claim carried over from the last round is settled by this retry: whatever
+			// woke us is either taken now or was taken by someone else.
+			claimed.reset();
+			std::optional<std::size_t> done;
+			try {
+				done = attempt_all(cases);
+			}
+			catch (...) {
+				owe(settle(false), std::nullopt);
+				throw;
+			}
+			if (done) {
+				owe(settle(false), done);
+				return done;
+			}
+
+			bool notified = true;
+			if (deadline) notified = wait_for_notify_until(waiter.node, *deadline);
+			else wait_for_notify(waiter.node);
+			claimed = settle(notified);
+
+			try {
+				done = attempt_all(cases);
+			}
+			catch (...) {
+				owe(claimed, std::nullopt);
+				throw;
+			}
+			if (done) {
+				owe(claimed, done);
+				return done;
+			}
+		}
+	}
+}
@@ -0,0 +1,354 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	class channel_closed : public std::runtime_error {
+	public:
+		channel_closed()
+			: std::runtime_error("Channel is closed.") {}
+	};
+
+	enum class channel_mode {
+		// Any number of senders and receivers. Every operation takes the channel's lock.
+		multi,
+		// One sender and one receiver at a time. Sends and receives only take the lock
+		// when the other side is waiting. Bounded channels only.
+		single,
+	};
+
+	// One blocked send, receive or select. It waits on each channel involved through a
+	// channel_wait, and the first channel to claim it decides which case woke it.
+	struct channel_waiter {
+		static constexpr int withdrawn = std::numeric_limits<int>::max();
+
+		wait_node node;
+		std::atomic<int> woken_by{ -1 };
+	};
+
+	struct channel_wait {
+		channel_waiter* waiter{};
+		int index{};
+		channel_wait* prev{};
+		channel_wait* next{};
+		bool linked{};
+	};
+
+	// Everything about a channel that does not depend on its value type.
+	class channel_core {
+	public:
+		enum class result {
+			done,
+			blocked,
+			closed,
+		};
+
+		channel_core(const channel_core&) = delete;
+		channel_core& operator=(const channel_core&) = delete;
+
+		bool is_closed() const {
+			return m_closed.load(std::memory_order_acquire);
+		}
+
+		// For select(). pass_on() wakes another waiter on the same side, for a waiter that
+		// was claimed by this channel but completed a different case.
+		void enlist(channel_wait& wait, bool sender);
+		void delist(channel_wait& wait, bool sender);
+		void pass_on(bool sender);
+
+	protected:
+		channel_core() = default;
+		~channel_core() = default;
+
+		struct wait_queue {
+			channel_wait* head{};
+			channel_wait* tail{};
+		};
+
+		// Both expect m_guard to be held and return what to notify once it is released.
+		wait_node* claim_one(bool sender);
+		wait_node* claim_all();
+
+		void close_core();
+
+		spin_lock m_guard;
+		std::atomic<bool> m_closed{ false };
+		// Waits linked on either side.
+		std::atomic<std::uint32_t> m_waiting{ 0 };
+
+	private:
+		wait_queue& side(bool sender) {
+			return sender ? m_senders : m_receivers;
+		}
+
+		void unlink(wait_queue& queue, channel_wait& wait);
+
+		wait_queue m_senders;
+		wait_queue m_receivers;
+	};
+
+	// One operation in a select(). attempt() completes it if it can proceed right away.
+	class select_case {
+	public:
+		virtual channel_core::result attempt() = 0;
+
+		channel_core& target() const {
+			return *m_target;
+		}
+
+		bool is_send() const {
+			return m_send;
+		}
+
+	protected:
+		select_case(channel_core& target, bool send)
+			: m_target(&target), m_send(send) {}
+		~select_case() = default;
+
+	private:
+		channel_core* m_target;
+		bool m_send;
+	};
+
+	// Waits until one of `cases` completes and returns its index, or std::nullopt once
+	// `deadline` has passed. Earlier cases win when several are ready. Fibers park, and
+	// the deadline uses the same timers as fiber::sleep().
+	std::optional<std::size_t> select_until(std::span<select_case* const> cases, std::optional<std::chrono::steady_clock::time_point> deadline);
+
+	// Go-style channel. Values are moved in and out, never copied. Receivers wait while
+	// it is empty, senders while a bounded one is full, and a closed channel still hands
+	// out what was sent before close().
+	template <typename T>
+	class channel : public channel_core {
+	public:
+		static constexpr std::size_t unbounded = std::numeric_limits<std::size_t>::max();
+
+		explicit channel(std::size_t capacity = unbounded, channel_mode mode = channel_mode::multi)
+			: m_capacity(capacity), m_single(mode == channel_mode::single) {
+			if (capacity == 0) {
+				throw std::invalid_argument("Channel capacity must be at least 1.");
+			}
+			if (m_single && capacity == unbounded) {
+				throw std::invalid_argument("Single producer/consumer channels must be bounded.");
+			}
+			m_slots.resize(std::bit_ceil(capacity == unbounded ? initial_slots : capacity));
+			m_mask = m_slots.size() - 1;
+		}
+
+		// Throws channel_closed if the channel is or gets closed.
+		void send(T&& value);
+
+		void send(const T& value) {
+			T copy(value);
+			send(std::move(copy));
+		}
+
+		// Only moves from `value` when it returns true. Throws channel_closed.
+		bool try_send(T&& value) {
+			auto outcome = send_once(value);
+			if (outcome == result::closed) throw channel_closed();
+			return outcome == result::done;
+		}
+
+		// Returns std::nullopt once the channel is closed and drained.
+		std::optional<T> receive();
+
+		// std::nullopt if nothing is queued right now.
+		std::optional<T> try_receive() {
+			std::optional<T> value;
+			receive_once(value);
+			return value;
+		}
+
+		// Wakes every waiter. Later sends throw, receives still drain what is queued.
+		void close();
+
+		std::size_t size() const {
+			return static_cast<std::size_t>(m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire));
+		}
+
+		std::size_t capacity() const {
+			return m_capacity;
+		}
+
+		// The building blocks of send_case and receive_case.
+		result send_once(T& value);
+		result receive_once(std::optional<T>& value);
+
+	private:
+		static constexpr std::size_t initial_slots = 16;
+
+		// Both expect m_guard to be held unless the channel is single.
+		result push(T& value);
+		result pop(std::optional<T>& value);
+		void grow();
+
+		bool bounded() const {
+			return m_capacity != unbounded;
+		}
+
+		std::vector<std::optional<T>> m_slots;
+		std::size_t m_mask{};
+		std::size_t m_capacity;
+		bool m_single;
+		alignas(64) std::atomic<std::uint64_t> m_head{ 0 };
+		alignas(64) std::atomic<std::uint64_t> m_tail{ 0 };
+	};
+
+	template <typename T>
+	class receive_case final : public select_case {
+	public:
+		// Completes with std::nullopt in `value` if the channel is closed and drained.
+		receive_case(channel<T>& source, std::optional<T>& value)
+			: select_case(source, false), m_source(&source), m_value(&value) {}
+
+		channel_core::result attempt() override {
+			return m_source->receive_once(*m_value);
+		}
+
+	private:
+		channel<T>* m_source;
+		std::optional<T>* m_value;
+	};
+
+	template <typename T>
+	class send_case final : public select_case {
+	public:
+		// `value` is moved from only if this case is the one that completes.
+		send_case(channel<T>& target, T& value)
+			: select_case(target, true), m_target(&target), m_value(&value) {}
+
+		channel_core::result attempt() override {
+			auto outcome = m_target->send_once(*m_value);
+			if (outcome == channel_core::result::closed) throw channel_closed();
+			return outcome;
+		}
+
+	private:
+		channel<T>* m_target;
+		T* m_value;
+	};
+
+	template <typename... Cases>
+	std::size_t select(Cases&&... cases) {
+		std::array<select_case*, sizeof...(Cases)> all{ &cases... };
+		return *select_until(all, std::nullopt);
+	}
+
+	template <typename... Cases>
+	std::optional<std::size_t> select_for(std::chrono::steady_clock::duration timeout, Cases&&... cases) {
+		std::array<select_case*, sizeof...(Cases)> all{ &cases... };
+		return select_until(all, std::chrono::steady_clock::now() + timeout);
+	}
+
+	template <typename T>
+	void channel<T>::send(T&& value) {
+		auto outcome = send_once(value);
+		if (outcome == result::closed) throw channel_closed();
+		if (outcome == result::done) return;
+
+		send_case<T> single_case(*this, value);
+		select_case* cases[] = { &single_case };
+		select_until(cases, std::nullopt);
+	}
+
+	template <typename T>
+	std::optional<T> channel<T>::receive() {
+		std::optional<T> value;
+		if (receive_once(value) != result::blocked) return value;
+
+		receive_case<T> single_case(*this, value);
+		select_case* cases[] = { &single_case };
+		select_until(cases, std::nullopt);
+		return value;
+	}
+
+	template <typename T>
+	void channel<T>::close() {
+		close_core();
+	}
+
+	template <typename T>
+	channel_core::result channel<T>::send_once(T& value) {
+		if (m_single) {
+			auto outcome = push(value);
+			if (outcome == result::done && m_waiting.load(std::memory_order_seq_cst) != 0) {
+				pass_on(false);
+			}
+			return outcome;
+		}
+
+		wait_node* woken = nullptr;
+		result outcome;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			outcome = push(value);
+			if (outcome == result::done) woken = claim_one(false);
+		}
+		if (woken) notify_waiter(woken);
+		return outcome;
+	}
+
+	template <typename T>
+	channel_core::result channel<T>::receive_once(std::optional<T>& value) {
+		if (m_single) {
+			auto outcome = pop(value);
+			if (outcome == result::done && m_waiting.load(std::memory_order_seq_cst) != 0) {
+				pass_on(true);
+			}
+			return outcome;
+		}
+
+		wait_node* woken = nullptr;
+		result outcome;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			outcome = pop(value);
+			if (outcome == result::done && bounded()) woken = claim_one(true);
+		}
+		if (woken) notify_waiter(woken);
+		return outcome;
+	}
+
+	template <typename T>
+	channel_core::result channel<T>::push(T& value) {
+		if (m_closed.load(std::memory_order_acquire)) return result::closed;
+
+		auto tail = m_tail.load(std::memory_order_relaxed);
+		auto head = m_head.load(std::memory_order_seq_cst);
+		if (tail - head >= m_capacity) return result::blocked;
+		if (tail - head == m_slots.size()) grow();
+
+		m_slots[tail & m_mask].emplace(std::move(value));
+		// Ordered against the m_waiting check in send_once() for single channels.
+		m_tail.store(tail + 1, m_single ? std::memory_order_seq_cst : std::memory_order_release);
+		return result::done;
+	}
+
+	template <typename T>
+	channel_core::result channel<T>::pop(std::optional<T>& value) {
+		auto head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_seq_cst)) {
+			if (!m_closed.load(std::memory_order_seq_cst)) return result::blocked;
+			// Whatever was sent before close() is still handed out.
+			if (head == m_tail.load(std::memory_order_seq_cst)) return result::closed;
+		}
+
+		auto& slot = m_slots[head & m_mask];
+		value.emplace(std::move(*slot));
+		slot.reset();
+		m_head.store(head + 1, m_single ? std::memory_order_seq_cst : std::memory_order_release);
+		return result::done;
+	}
+
+	template <typename T>
+	void channel<T>::grow() {
+		std::vector<std::optional<T>> slots(m_slots.size() * 2);
+		auto mask = slots.size() - 1;
+		auto tail = m_tail.load(std::memory_order_relaxed);
+		for (auto i = m_head.load(std::memory_order_relaxed); i != tail; ++i) {
+			slots[i & mask] = std::move(m_slots[i & m_mask]);
+		}
+		m_slots.swap(slots);
+		m_mask = mask;
+	}
+}
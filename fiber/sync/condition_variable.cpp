@@ -0,0 +1,29 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	void fiber_condition_variable::notify_one() {
+		wait_node* next;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			next = m_waiters.pop_front();
+		}
+		if (next) {
+			notify_waiter(next);
+		}
+	}
+
+	void fiber_condition_variable::notify_all() {
+		wait_node* chain;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			chain = m_waiters.take_all();
+		}
+		notify_waiters(chain);
+	}
+
+	void fiber_condition_variable::enqueue(wait_node& node) {
+		std::lock_guard<spin_lock> guard(m_guard);
+		prepare_wait(node);
+		m_waiters.push_back(&node);
+	}
+}
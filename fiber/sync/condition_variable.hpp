@@ -0,0 +1,41 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Like std::condition_variable_any, but waiting suspends the fiber rather than the
+	// thread. Works with any lock that has lock()/unlock(), typically
+	// std::unique_lock<fiber_mutex>.
+	class fiber_condition_variable {
+	public:
+		fiber_condition_variable() = default;
+		fiber_condition_variable(const fiber_condition_variable&) = delete;
+		fiber_condition_variable& operator=(const fiber_condition_variable&) = delete;
+
+		void notify_one();
+		void notify_all();
+
+		template <typename Lock>
+		void wait(Lock& lock) {
+			wait_node node;
+			// Queued before the lock is released, so a notify issued right after the
+			// caller's unlock cannot be lost.
+			enqueue(node);
+			lock.unlock();
+			wait_for_notify(node);
+			lock.lock();
+		}
+
+		template <typename Lock, typename Predicate>
+		void wait(Lock& lock, Predicate pred) {
+			while (!pred()) {
+				wait(lock);
+			}
+		}
+
+	private:
+		void enqueue(wait_node& node);
+
+		spin_lock m_guard;
+		wait_list m_waiters;
+	};
+}
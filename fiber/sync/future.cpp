@@ -0,0 +1,35 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	void future_core::wait() {
+		if (is_ready()) return;
+
+		wait_node node;
+		m_guard.lock();
+		// complete() sets m_ready under the guard, so it cannot slip in between.
+		if (is_ready()) {
+			m_guard.unlock();
+			return;
+		}
+		prepare_wait(node);
+		m_waiters.push_back(&node);
+		m_guard.unlock();
+
+		wait_for_notify(node);
+	}
+
+	void future_core::fail(std::exception_ptr error) {
+		m_error = std::move(error);
+		complete();
+	}
+
+	void future_core::complete() {
+		wait_node* woken;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			m_ready.store(true, std::memory_order_release);
+			woken = m_waiters.take_all();
+		}
+		notify_waiters(woken);
+	}
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// What get() throws when the fiber or job was destroyed, dropped or rejected before it
+	// produced a result.
+	class broken_future : public std::runtime_error {
+	public:
+		broken_future()
+			: std::runtime_error("Fiber future abandoned: its fiber or job ended without a result.") {}
+	};
+
+	// Everything about a future's shared state that does not depend on the value type.
+	class future_core {
+	public:
+		future_core() = default;
+		future_core(const future_core&) = delete;
+		future_core& operator=(const future_core&) = delete;
+
+		bool is_ready() const {
+			return m_ready.load(std::memory_order_acquire);
+		}
+
+		// Parks the calling fiber until the result is in. A plain thread yields instead.
+		void wait();
+
+		void fail(std::exception_ptr error);
+
+	protected:
+		~future_core() = default;
+
+		// Call once the result is stored. Wakes every waiter.
+		void complete();
+
+		std::exception_ptr m_error;
+
+	private:
+		spin_lock m_guard;
+		wait_list m_waiters;
+		std::atomic<bool> m_ready{ false };
+	};
+
+	template <typename T>
+	class future_state final : public future_core {
+	public:
+		using stored_type = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+		template <typename... Args>
+		void set_value(Args&&... args) {
+			m_value.emplace(std::forward<Args>(args)...);
+			complete();
+		}
+
+		// Expects is_ready().
+		T take() {
+			if (m_error) std::rethrow_exception(m_error);
+			if constexpr (!std::is_void_v<T>) return std::move(*m_value);
+		}
+
+	private:
+		std::optional<stored_type> m_value;
+	};
+
+	// Result of spawn() and fiber_pool::submit(). Move-only, get() hands the value out once.
+	template <typename T>
+	class fiber_future {
+	public:
+		fiber_future() = default;
+
+		explicit fiber_future(std::shared_ptr<future_state<T>> state)
+			: m_state(std::move(state)) {}
+
+		bool valid() const {
+			return m_state != nullptr;
+		}
+
+		bool is_ready() const {
+			return check().is_ready();
+		}
+
+		// Parks until the fiber or job is done, without taking the result.
+		void join() const {
+			check().wait();
+		}
+
+		// Joins, then returns the value or rethrows what the function threw. Leaves the
+		// future invalid.
+		T get() {
+			join();
+			auto state = std::move(m_state);
+			return state->take();
+		}
+
+	private:
+		future_state<T>& check() const {
+			if (!m_state) throw std::logic_error("Fiber future has no state.");
+			return *m_state;
+		}
+
+		std::shared_ptr<future_state<T>> m_state;
+	};
+
+	// The producing side. Destroying it before it is fulfilled breaks the future, so a job
+	// that expires or a fiber destroyed mid-run never leaves a waiter hanging.
+	template <typename T>
+	class fiber_promise {
+	public:
+		fiber_promise()
+			: m_state(std::make_shared<future_state<T>>()) {}
+
+		fiber_promise(fiber_promise&&) noexcept = default;
+		fiber_promise& operator=(fiber_promise&&) = delete;
+
+		~fiber_promise() {
+			if (m_state && !m_done) m_state->fail(std::make_exception_ptr(broken_future()));
+		}
+
+		fiber_future<T> get_future() const {
+			return fiber_future<T>(m_state);
+		}
+
+		// Runs `func` and stores what it returns or throws. Only counts as done once that is
+		// stored: a fiber destroyed while parked inside `func` still breaks the future.
+		template <typename F>
+		void fulfill(F& func) {
+			try {
+				if constexpr (std::is_void_v<T>) {
+					func();
+					m_state->set_value();
+				}
+				else {
+					m_state->set_value(func());
+				}
+			}
+			catch (...) {
+				m_state->fail(std::current_exception());
+			}
+			m_done = true;
+		}
+
+	private:
+		std::shared_ptr<future_state<T>> m_state;
+		bool m_done{ false };
+	};
+}
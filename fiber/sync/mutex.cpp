@@ -0,0 +1,184 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	namespace {
+		constexpr int spin_rounds = 100;
+
+		enum : std::uint32_t {
+			reader_tag = 0,
+			writer_tag = 1,
+		};
+	}
+
+	void fiber_mutex::lock() {
+		if (try_lock()) return;
+
+		if (should_spin()) {
+			for (int i = 0; i < spin_rounds; ++i) {
+				cpu_relax();
+				if (m_state.load(std::memory_order_relaxed) == 0 && try_lock()) return;
+			}
+		}
+
+		wait_node node;
+		m_guard.lock();
+		// Mark the mutex contended while holding the guard, so unlock() cannot take the fast
+		// path and miss the node queued below.
+		auto state = m_state.load(std::memory_order_relaxed);
+		while (true) {
+			if (state == 0) {
+				if (m_state.compare_exchange_weak(state, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+					m_guard.unlock();
+					return;
+				}
+				continue;
+			}
+			if (state == 2 || m_state.compare_exchange_weak(state, 2, std::memory_order_relaxed, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		prepare_wait(node);
+		m_waiters.push_back(&node);
+		m_guard.unlock();
+
+		// The unlocker keeps the mutex locked on our behalf.
+		wait_for_notify(node);
+	}
+
+	bool fiber_mutex::try_lock() {
+		std::uint32_t expected = 0;
+		return m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+	}
+
+	void fiber_mutex::unlock() {
+		std::uint32_t expected = 1;
+		if (m_state.compare_exchange_strong(expected, 0, std::memory_order_release, std::memory_order_relaxed)) {
+			return;
+		}
+
+		m_guard.lock();
+		auto* next = m_waiters.pop_front();
+		if (!next) {
+			m_state.store(0, std::memory_order_release);
+		}
+		else if (m_waiters.empty()) {
+			m_state.store(1, std::memory_order_relaxed);
+		}
+		m_guard.unlock();
+
+		if (next) {
+			notify_waiter(next);
+		}
+	}
+
+	bool fiber_shared_mutex::can_read() const {
+		return !m_writer && m_waiting_writers == 0;
+	}
+
+	void fiber_shared_mutex::lock() {
+		if (should_spin()) {
+			for (int i = 0; i < spin_rounds; ++i) {
+				if (try_lock()) return;
+				cpu_relax();
+			}
+		}
+
+		wait_node node;
+		m_guard.lock();
+		if (!m_writer && m_readers == 0) {
+			m_writer = true;
+			m_guard.unlock();
+			return;
+		}
+		prepare_wait(node);
+		node.tag = writer_tag;
+		++m_waiting_writers;
+		m_waiters.push_back(&node);
+		m_guard.unlock();
+
+		wait_for_notify(node);
+	}
+
+	bool fiber_shared_mutex::try_lock() {
+		std::lock_guard<spin_lock> guard(m_guard);
+		if (m_writer || m_readers != 0) return false;
+		m_writer = true;
+		return true;
+	}
+
+	void fiber_shared_mutex::unlock() {
+		wait_node* woken = nullptr;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			m_writer = false;
+			wake_next(woken);
+		}
+		notify_waiters(woken);
+	}
+
+	void fiber_shared_mutex::lock_shared() {
+		if (should_spin()) {
+			for (int i = 0; i < spin_rounds; ++i) {
+				if (try_lock_shared()) return;
+				cpu_relax();
+			}
+		}
+
+		wait_node node;
+		m_guard.lock();
+		if (can_read()) {
+			++m_readers;
+			m_guard.unlock();
+			return;
+		}
+		prepare_wait(node);
+		node.tag = reader_tag;
+		m_waiters.push_back(&node);
+		m_guard.unlock();
+
+		wait_for_notify(node);
+	}
+
+	bool fiber_shared_mutex::try_lock_shared() {
+		std::lock_guard<spin_lock> guard(m_guard);
+		if (!can_read()) return false;
+		++m_readers;
+		return true;
+	}
+
+	void fiber_shared_mutex::unlock_shared() {
+		wait_node* woken = nullptr;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			--m_readers;
+			if (m_readers == 0) {
+				wake_next(woken);
+			}
+		}
+		notify_waiters(woken);
+	}
+
+	// Hands the lock to the front writer, or to every reader queued ahead of the next
+	// writer. The woken nodes are chained for notification once the guard is released.
+	void fiber_shared_mutex::wake_next(wait_node*& woken) {
+		auto* front = m_waiters.front();
+		if (!front) return;
+
+		if (front->tag == writer_tag) {
+			m_waiters.pop_front();
+			--m_waiting_writers;
+			m_writer = true;
+			woken = front;
+			return;
+		}
+
+		wait_node* tail = nullptr;
+		while (m_waiters.front() && m_waiters.front()->tag == reader_tag) {
+			auto* reader = m_waiters.pop_front();
+			++m_readers;
+			if (tail) tail->next = reader;
+			else woken = reader;
+			tail = reader;
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Suspends only the waiting fiber. Ownership is handed straight to the oldest waiter
+	// on unlock, so waiters are served in FIFO order. Meets Lockable, so it works with
+	// std::lock_guard and std::unique_lock.
+	class fiber_mutex {
+	public:
+		fiber_mutex() = default;
+		fiber_mutex(const fiber_mutex&) = delete;
+		fiber_mutex& operator=(const fiber_mutex&) = delete;
+
+		void lock();
+		bool try_lock();
+		void unlock();
+
+	private:
+		// 0 unlocked, 1 locked, 2 locked with waiters.
+		std::atomic<std::uint32_t> m_state{ 0 };
+		spin_lock m_guard;
+		wait_list m_waiters;
+	};
+
+	// Writers are preferred: once a writer waits, new readers queue behind it. Meets
+	// SharedLockable, so it works with std::shared_lock.
+	class fiber_shared_mutex {
+	public:
+		fiber_shared_mutex() = default;
+		fiber_shared_mutex(const fiber_shared_mutex&) = delete;
+		fiber_shared_mutex& operator=(const fiber_shared_mutex&) = delete;
+
+		void lock();
+		bool try_lock();
+		void unlock();
+
+		void lock_shared();
+		bool try_lock_shared();
+		void unlock_shared();
+
+	private:
+		bool can_read() const;
+		void wake_next(wait_node*& woken);
+
+		spin_lock m_guard;
+		wait_list m_waiters;
+		std::size_t m_readers{ 0 };
+		std::size_t m_waiting_writers{ 0 };
+		bool m_writer{ false };
+	};
+}
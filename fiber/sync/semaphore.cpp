@@ -0,0 +1,110 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	namespace {
+		constexpr int spin_rounds = 100;
+	}
+
+	fiber_semaphore::fiber_semaphore(std::ptrdiff_t initial)
+		: m_count(initial) {
+		if (initial < 0) {
+			throw std::invalid_argument("Semaphore count cannot be negative.");
+		}
+	}
+
+	void fiber_semaphore::acquire() {
+		if (try_acquire()) return;
+
+		if (should_spin()) {
+			for (int i = 0; i < spin_rounds; ++i) {
+				cpu_relax();
+				if (try_acquire()) return;
+			}
+		}
+
+		wait_node node;
+		m_guard.lock();
+		// Permits only become available under the guard and only while nobody waits, so
+		// a count of zero seen here stays zero until our node is visible to release().
+		if (try_acquire()) {
+			m_guard.unlock();
+			return;
+		}
+		prepare_wait(node);
+		m_waiters.push_back(&node);
+		m_guard.unlock();
+
+		wait_for_notify(node);
+	}
+
+	bool fiber_semaphore::try_acquire() {
+		auto count = m_count.load(std::memory_order_relaxed);
+		while (count > 0) {
+			if (m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void fiber_semaphore::release(std::ptrdiff_t update) {
+		if (update < 0) {
+			throw std::invalid_argument("Semaphore release count cannot be negative.");
+		}
+
+		wait_node* woken = nullptr;
+		wait_node* tail = nullptr;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			while (update > 0 && !m_waiters.empty()) {
+				auto* node = m_waiters.pop_front();
+				if (tail) tail->next = node;
+				else woken = node;
+				tail = node;
+				--update;
+			}
+			if (update > 0) {
+				m_count.fetch_add(update, std::memory_order_release);
+			}
+		}
+		notify_waiters(woken);
+	}
+
+	fiber_barrier::fiber_barrier(std::size_t expected)
+		: m_expected(expected) {
+		if (expected == 0) {
+			throw std::invalid_argument("Barrier needs at least one participant.");
+		}
+	}
+
+	void fiber_barrier::arrive_and_wait() {
+		wait_node node;
+		m_guard.lock();
+		if (m_arrived + 1 == m_expected) {
+			m_arrived = 0;
+			auto* chain = m_waiters.take_all();
+			m_guard.unlock();
+			notify_waiters(chain);
+			return;
+		}
+		++m_arrived;
+		prepare_wait(node);
+		m_waiters.push_back(&node);
+		m_guard.unlock();
+
+		wait_for_notify(node);
+	}
+
+	void fiber_barrier::arrive_and_drop() {
+		wait_node* chain = nullptr;
+		{
+			std::lock_guard<spin_lock> guard(m_guard);
+			--m_expected;
+			if (m_expected != 0 && m_arrived == m_expected) {
+				m_arrived = 0;
+				chain = m_waiters.take_all();
+			}
+		}
+		notify_waiters(chain);
+	}
+}
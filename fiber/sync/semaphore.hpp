@@ -0,0 +1,45 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	// Counting semaphore. release() hands permits straight to queued fibers before it
+	// makes any available to the fast path, so waiters cannot be overtaken indefinitely.
+	class fiber_semaphore {
+	public:
+		explicit fiber_semaphore(std::ptrdiff_t initial = 0);
+		fiber_semaphore(const fiber_semaphore&) = delete;
+		fiber_semaphore& operator=(const fiber_semaphore&) = delete;
+
+		void acquire();
+		bool try_acquire();
+		void release(std::ptrdiff_t update = 1);
+
+		std::ptrdiff_t available() const {
+			return m_count.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<std::ptrdiff_t> m_count;
+		spin_lock m_guard;
+		wait_list m_waiters;
+	};
+
+	// Reusable barrier for a fixed number of fibers per phase.
+	class fiber_barrier {
+	public:
+		explicit fiber_barrier(std::size_t expected);
+		fiber_barrier(const fiber_barrier&) = delete;
+		fiber_barrier& operator=(const fiber_barrier&) = delete;
+
+		void arrive_and_wait();
+
+		// Arrives for the current phase and leaves the barrier for every later one.
+		void arrive_and_drop();
+
+	private:
+		spin_lock m_guard;
+		wait_list m_waiters;
+		std::size_t m_expected;
+		std::size_t m_arrived{ 0 };
+	};
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace ve {
+	inline void cpu_relax() {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__)
+		asm volatile("yield");
+#endif
+	}
+
+	// Guards the wait lists of the fiber primitives. Fibers are never switched out while
+	// holding it, so it is only ever contended by other worker threads, and only briefly.
+	class spin_lock {
+	public:
+		void lock() {
+			while (m_locked.exchange(true, std::memory_order_acquire)) {
+				while (m_locked.load(std::memory_order_relaxed)) {
+					cpu_relax();
+				}
+			}
+		}
+
+		bool try_lock() {
+			return !m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire);
+		}
+
+		void unlock() {
+			m_locked.store(false, std::memory_order_release);
+		}
+
+	private:
+		std::atomic<bool> m_locked{ false };
+	};
+}
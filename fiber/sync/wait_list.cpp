@@ -0,0 +1,62 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	void prepare_wait(wait_node& node) {
+		node.script = fiber::current();
+		node.next = nullptr;
+		node.ready.store(false, std::memory_order_relaxed);
+		if (node.script) {
+			node.script->m_parked.store(true, std::memory_order_seq_cst);
+		}
+	}
+
+	void wait_for_notify(wait_node& node) {
+		if (node.script) {
+			node.script->park();
+			return;
+		}
+
+		while (!node.ready.load(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+	}
+
+	bool wait_for_notify_until(wait_node& node, std::chrono::steady_clock::time_point deadline) {
+		if (node.script) {
+			return node.script->park_until(deadline);
+		}
+
+		while (!node.ready.load(std::memory_order_acquire)) {
+			if (std::chrono::steady_clock::now() >= deadline) return false;
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	void cancel_wait(wait_node& node) {
+		if (node.script) {
+			node.script->m_parked.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	void notify_waiter(wait_node* node) {
+		if (auto* script = node->script) {
+			script->unpark();
+		}
+		else {
+			node->ready.store(true, std::memory_order_release);
+		}
+	}
+
+	void notify_waiters(wait_node* chain) {
+		while (chain) {
+			auto* next = chain->next;
+			notify_waiter(chain);
+			chain = next;
+		}
+	}
+
+	bool should_spin() {
+		return !fiber::current() || scheduler::current_worker().has_value();
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	class fiber;
+
+	// Lives on the waiter's stack for as long as it is queued.
+	struct wait_node {
+		fiber* script{};
+		wait_node* next{};
+		std::atomic<bool> ready{ false };
+		std::uint32_t tag{ 0 };
+	};
+
+	class wait_list {
+	public:
+		void push_back(wait_node* node) {
+			node->next = nullptr;
+			if (m_tail) m_tail->next = node;
+			else m_head = node;
+			m_tail = node;
+		}
+
+		wait_node* pop_front() {
+			auto* node = m_head;
+			if (node) {
+				m_head = node->next;
+				if (!m_head) m_tail = nullptr;
+				node->next = nullptr;
+			}
+			return node;
+		}
+
+		// Detaches every waiter; walk the chain through wait_node::next.
+		wait_node* take_all() {
+			auto* head = m_head;
+			m_head = m_tail = nullptr;
+			return head;
+		}
+
+		// Unlinks `node` if it is still queued. Walks the list, for waiters that give up.
+		bool remove(wait_node* node) {
+			wait_node* previous = nullptr;
+			for (auto* current = m_head; current; previous = current, current = current->next) {
+				if (current != node) continue;
+				if (previous) previous->next = node->next;
+				else m_head = node->next;
+				if (m_tail == node) m_tail = previous;
+				node->next = nullptr;
+				return true;
+			}
+			return false;
+		}
+
+		wait_node* front() const {
+			return m_head;
+		}
+
+		bool empty() const {
+			return m_head == nullptr;
+		}
+
+	private:
+		wait_node* m_head{};
+		wait_node* m_tail{};
+	};
+
+	// Fills in the node for the calling fiber (or thread) before it is published.
+	void prepare_wait(wait_node& node);
+
+	// Suspends until notify_waiter(). Fibers park; a plain thread yields until woken, so
+	// never block the thread that drives the fibers this way.
+	void wait_for_notify(wait_node& node);
+
+	// Same, but gives up at `deadline` and returns false. The node may still be notified
+	// after that; the caller has to settle with its notifiers before it can reuse it.
+	bool wait_for_notify_until(wait_node& node, std::chrono::steady_clock::time_point deadline);
+
+	// Undoes prepare_wait() for a node that will never be notified.
+	void cancel_wait(wait_node& node);
+
+	// Call after the node has been unlinked and every lock released. The node must not be
+	// touched afterwards, its owner may already have returned.
+	void notify_waiter(wait_node* node);
+
+	// Notifies a chain linked through wait_node::next, e.g. from wait_list::take_all().
+	void notify_waiters(wait_node* chain);
+
+	// Spinning only helps when the holder can run in parallel, i.e. on a worker thread.
+	bool should_spin();
+}
@@ -0,0 +1,109 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	timer_wheel::timer_wheel(clock::duration resolution)
+		: m_origin(clock::now()), m_resolution(resolution) {
+		if (m_resolution <= clock::duration::zero()) {
+			throw std::invalid_argument("Timer wheel resolution must be positive.");
+		}
+	}
+
+	void timer_wheel::schedule(timer_node& node, clock::time_point deadline) {
+		if (node.is_linked()) {
+			unlink(node);
+		}
+
+		// Round up so a timer never fires before its deadline.
+		auto offset = deadline - m_origin;
+		if (offset <= clock::duration::zero()) {
+			node.expires = 0;
+		}
+		else {
+			node.expires = static_cast<std::uint64_t>((offset + m_resolution - clock::duration(1)) / m_resolution);
+		}
+		insert(node);
+	}
+
+	void timer_wheel::cancel(timer_node& node) {
+		if (node.is_linked()) {
+			unlink(node);
+		}
+	}
+
+	std::optional<timer_wheel::clock::time_point> timer_wheel::next_deadline() const {
+		if (m_count == 0) return std::nullopt;
+		if (m_due) return m_origin + m_resolution * static_cast<std::int64_t>(m_current);
+
+		// A level only holds timers past the current slot, up to a full turn ahead.
+		auto next = std::numeric_limits<std::uint64_t>::max();
+		for (std::size_t level = 0; level < levels; ++level) {
+			auto shift = slot_bits * level;
+			auto base = m_current >> shift;
+			for (std::uint64_t i = 1; i <= slots; ++i) {
+				if (m_slots[level][(base + i) & (slots - 1)]) {
+					next = std::min(next, (base + i) << shift);
+					break;
+				}
+			}
+		}
+		return m_origin + m_resolution * static_cast<std::int64_t>(next);
+	}
+
+	std::uint64_t timer_wheel::to_tick(clock::time_point time) const {
+		auto offset = time - m_origin;
+		if (offset <= clock::duration::zero()) return 0;
+		return static_cast<std::uint64_t>(offset / m_resolution);
+	}
+
+	void timer_wheel::insert(timer_node& node) {
+		timer_node** head = &m_due;
+
+		if (node.expires > m_current) {
+			constexpr std::uint64_t span = std::uint64_t{ 1 } << (slot_bits * levels);
+			auto expires = std::min(node.expires, m_current + span - 1);
+			auto delta = expires - m_current;
+
+			std::size_t level = 0;
+			while (delta >= (std::uint64_t{ 1 } << (slot_bits * (level + 1)))) {
+				++level;
+			}
+			head = &m_slots[level][(expires >> (slot_bits * level)) & (slots - 1)];
+		}
+
+		node.prev = nullptr;
+		node.next = *head;
+		if (*head) (*head)->prev = &node;
+		*head = &node;
+		node.slot = head;
+		++m_count;
+	}
+
+	void timer_wheel::unlink(timer_node& node) {
+		if (node.prev) node.prev->next = node.next;
+		else *node.slot = node.next;
+		if (node.next) node.next->prev = node.prev;
+
+		node.prev = node.next = nullptr;
+		node.slot = nullptr;
+		--m_count;
+	}
+
+	void timer_wheel::cascade() {
+		for (std::size_t level = 1; level < levels; ++level) {
+			if ((m_current & ((std::uint64_t{ 1 } << (slot_bits * level)) - 1)) != 0) {
+				break;
+			}
+
+			auto& head = m_slots[level][(m_current >> (slot_bits * level)) & (slots - 1)];
+			auto* node = head;
+			head = nullptr;
+			while (node) {
+				auto* next = node->next;
+				node->slot = nullptr;
+				--m_count;
+				insert(*node);
+				node = next;
+			}
+		}
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+namespace ve {
+	struct timer_node {
+		timer_node* prev{};
+		timer_node* next{};
+		timer_node** slot{};
+		std::uint64_t expires{};
+		void* data{};
+
+		bool is_linked() const {
+			return slot != nullptr;
+		}
+	};
+
+	// Hierarchical timing wheel: 4 levels of 64 slots. Insert and cancel are O(1); advancing
+	// only touches the slots that expire plus the occasional cascade of a higher level.
+	class timer_wheel {
+	public:
+		using clock = std::chrono::steady_clock;
+
+		static constexpr std::size_t levels = 4;
+		static constexpr std::size_t slot_bits = 6;
+		static constexpr std::size_t slots = std::size_t{ 1 } << slot_bits;
+
+		explicit timer_wheel(clock::duration resolution = std::chrono::milliseconds(1));
+
+		timer_wheel(const timer_wheel&) = delete;
+		timer_wheel& operator=(const timer_wheel&) = delete;
+
+		void schedule(timer_node& node, clock::time_point deadline);
+		void cancel(timer_node& node);
+
+		template <typename Callback>
+		std::size_t advance(clock::time_point now, Callback&& on_expired) {
+			std::size_t expired = 0;
+			// Detach the slot first so callbacks can safely re-arm the node they are handed.
+			auto drain = [&](timer_node*& head) {
+				auto* node = head;
+				head = nullptr;
+				while (node) {
+					auto* next = node->next;
+					node->prev = node->next = nullptr;
+					node->slot = nullptr;
+					--m_count;
+					on_expired(*node);
+					++expired;
+					node = next;
+				}
+			};
+
+			auto target = to_tick(now);
+			drain(m_due);
+
+			while (m_current < target) {
+				if (m_count == 0) {
+					m_current = target;
+					break;
+				}
+
+				++m_current;
+				cascade();
+				drain(m_due);
+				drain(m_slots[0][m_current & (slots - 1)]);
+			}
+			return expired;
+		}
+
+		template <typename Callback>
+		void clear(Callback&& on_removed) {
+			while (m_due) {
+				auto* node = m_due;
+				unlink(*node);
+				on_removed(*node);
+			}
+			for (auto& level : m_slots) {
+				for (auto& head : level) {
+					while (head) {
+						auto* node = head;
+						unlink(*node);
+						on_removed(*node);
+					}
+				}
+			}
+		}
+
+		std::size_t size() const {
+			return m_count;
+		}
+
+		bool empty() const {
+			return m_count == 0;
+		}
+
+		// No later than the earliest deadline armed, exact for the next 64 ticks and otherwise
+		// the tick at which that timer's slot cascades. std::nullopt when nothing is armed.
+		std::optional<clock::time_point> next_deadline() const;
+
+	private:
+		std::uint64_t to_tick(clock::time_point time) const;
+		void insert(timer_node& node);
+		void unlink(timer_node& node);
+		void cascade();
+
+		std::array<std::array<timer_node*, slots>, levels> m_slots{};
+		timer_node* m_due{};
+		clock::time_point m_origin;
+		clock::duration m_resolution;
+		std::uint64_t m_current{ 0 };
+		std::size_t m_count{ 0 };
+	};
+}
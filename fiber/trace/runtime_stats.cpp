@@ -0,0 +1,44 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	double cycle_clock::ns_per_tick() noexcept {
+#if defined(__x86_64__) || defined(_M_X64)
+		// A couple of milliseconds are enough with a constant-rate TSC.
+		static const double ratio = [] {
+			auto start = std::chrono::steady_clock::now();
+			auto first = now();
+			while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(2)) {}
+			auto end = std::chrono::steady_clock::now();
+			auto last = now();
+			auto ns = std::chrono::duration<double, std::nano>(end - start).count();
+			return last > first ? ns / static_cast<double>(last - first) : 1.0;
+		}();
+		return ratio;
+#else
+		return 1.0;
+#endif
+	}
+
+	fiber_runtime& fiber_runtime::operator+=(const fiber_runtime& other) {
+		fibers += other.fibers;
+		on_cpu_ns += other.on_cpu_ns;
+		slices += other.slices;
+		longest_slice_ns = std::max(longest_slice_ns, other.longest_slice_ns);
+		waiting_ns += other.waiting_ns;
+		for (std::size_t i = 0; i < slice_buckets; ++i) {
+			slice_histogram[i] += other.slice_histogram[i];
+		}
+		return *this;
+	}
+
+	void runtime_counters::read(fiber_runtime& out) const {
+		out.fibers = 1;
+		out.on_cpu_ns = m_on_cpu_ns.load(std::memory_order_relaxed);
+		out.slices = m_slices.load(std::memory_order_relaxed);
+		out.longest_slice_ns = m_longest_slice_ns.load(std::memory_order_relaxed);
+		out.waiting_ns = m_waiting_ns.load(std::memory_order_relaxed);
+		for (std::size_t i = 0; i < slice_buckets; ++i) {
+			out.slice_histogram[i] = m_histogram[i].load(std::memory_order_relaxed);
+		}
+	}
+}
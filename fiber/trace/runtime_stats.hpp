@@ -0,0 +1,106 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+// 1 timestamps every fiber switch for the runtime accounting below, 0 leaves the counters
+// at zero and the switch path untouched.
+#ifndef VE_RUNTIME_STATS
+#define VE_RUNTIME_STATS 1
+#endif
+
+namespace ve {
+	inline constexpr bool runtime_stats_enabled = VE_RUNTIME_STATS != 0;
+
+	// Timestamps for per-switch accounting. Reads the TSC on x86-64, a fraction of the cost
+	// of steady_clock, and steady_clock nanoseconds elsewhere.
+	class cycle_clock {
+	public:
+		static std::uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(_M_X64)
+			return __rdtsc();
+#else
+			return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+		}
+
+		static std::uint64_t to_ns(std::uint64_t ticks) noexcept {
+			return static_cast<std::uint64_t>(static_cast<double>(ticks) * ns_per_tick());
+		}
+
+		// Measured against steady_clock on first use.
+		static double ns_per_tick() noexcept;
+	};
+
+	// Bucket 0 counts empty slices, bucket i slices of [2^(i-1), 2^i) ns and the last one
+	// everything from about a second up.
+	inline constexpr std::size_t slice_buckets = 32;
+
+	struct fiber_runtime {
+		std::string name;
+		// Invalid for aggregates.
+		fiber_handle handle;
+		std::size_t fibers = 0;
+		std::uint64_t on_cpu_ns = 0;
+		std::uint64_t slices = 0;
+		std::uint64_t longest_slice_ns = 0;
+		// Time spent runnable but not running: queued after a yield or wakeup, or past the
+		// deadline of a timed sleep.
+		std::uint64_t waiting_ns = 0;
+		std::array<std::uint64_t, slice_buckets> slice_histogram{};
+
+		fiber_runtime& operator+=(const fiber_runtime& other);
+	};
+
+	// Updated by the thread running the fiber, one slice at a time, and readable from any
+	// thread while it runs.
+	class runtime_counters {
+	public:
+		// `late_ns` is how far past its sleep deadline a timed sleeper starts; other slices
+		// measure the wait from the last time the fiber became runnable.
+		void begin_slice(std::uint64_t begin, std::optional<std::uint64_t> late_ns) noexcept {
+			std::uint64_t waited = 0;
+			if (late_ns) {
+				waited = *late_ns;
+			}
+			else if (auto since = m_runnable_since.load(std::memory_order_relaxed); since && since < begin) {
+				waited = cycle_clock::to_ns(begin - since);
+			}
+			bump(m_waiting_ns, waited);
+		}
+
+		void end_slice(std::uint64_t begin, std::uint64_t end, bool runnable) noexcept {
+			auto ns = cycle_clock::to_ns(end - begin);
+			bump(m_on_cpu_ns, ns);
+			bump(m_slices, 1);
+			if (ns > m_longest_slice_ns.load(std::memory_order_relaxed)) {
+				m_longest_slice_ns.store(ns, std::memory_order_relaxed);
+			}
+			auto bucket = std::min<std::size_t>(std::bit_width(ns), slice_buckets - 1);
+			bump(m_histogram[bucket], 1);
+			if (runnable) mark_runnable(end);
+		}
+
+		void mark_runnable(std::uint64_t now) noexcept {
+			m_runnable_since.store(now, std::memory_order_relaxed);
+		}
+
+		std::uint64_t on_cpu_ns() const noexcept {
+			return m_on_cpu_ns.load(std::memory_order_relaxed);
+		}
+
+		void read(fiber_runtime& out) const;
+
+	private:
+		// Single writer, so no read-modify-write is needed.
+		static void bump(std::atomic<std::uint64_t>& counter, std::uint64_t amount) noexcept {
+			counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+		}
+
+		std::atomic<std::uint64_t> m_on_cpu_ns{ 0 };
+		std::atomic<std::uint64_t> m_slices{ 0 };
+		std::atomic<std::uint64_t> m_longest_slice_ns{ 0 };
+		std::atomic<std::uint64_t> m_waiting_ns{ 0 };
+		std::atomic<std::uint64_t> m_runnable_since{ 0 };
+		std::array<std::atomic<std::uint64_t>, slice_buckets> m_histogram{};
+	};
+}
@@ -0,0 +1,249 @@
+#include "../../stdafx.hpp"
+
+namespace ve {
+	namespace {
+		struct trace_ring {
+			trace_ring(std::size_t capacity, std::uint32_t id)
+				: events(capacity), mask(capacity - 1), id(id) {}
+
+			std::vector<trace_event> events;
+			std::size_t mask;
+			std::uint32_t id;
+			std::atomic<std::uint64_t> head{ 0 };
+			// Set by clear_trace() instead of resetting head, so the owner can keep writing.
+			std::atomic<std::uint64_t> tail{ 0 };
+			std::atomic<bool> retired{ false };
+			std::string name;
+		};
+
+		struct trace_registry {
+			std::mutex mutex;
+			std::vector<std::unique_ptr<trace_ring>> rings;
+			std::unordered_map<std::uint64_t, std::string> names;
+			std::size_t capacity{ std::size_t{ 1 } << 16 };
+			std::uint32_t next_id{ 0 };
+		};
+
+		trace_registry& registry() {
+			// Never destroyed, threads may still emit while statics are torn down.
+			static auto* instance = new trace_registry();
+			return *instance;
+		}
+
+		struct ring_owner {
+			trace_ring* ring{};
+
+			~ring_owner() {
+				if (ring) ring->retired.store(true, std::memory_order_release);
+			}
+		};
+
+		thread_local ring_owner t_ring;
+
+		trace_ring& this_thread_ring() {
+			if (!t_ring.ring) {
+				auto& r = registry();
+				std::lock_guard<std::mutex> lock(r.mutex);
+				auto ring = std::make_unique<trace_ring>(r.capacity, r.next_id++);
+				ring->name = "thread " + std::to_string(ring->id);
+				t_ring.ring = ring.get();
+				r.rings.push_back(std::move(ring));
+			}
+			return *t_ring.ring;
+		}
+
+		const char* type_name(trace_type type) {
+			switch (type) {
+			case trace_type::fiber_add: return "add";
+			case trace_type::fiber_suspend: return "suspend";
+			case trace_type::fiber_resume: return "resume";
+			case trace_type::fiber_terminate: return "terminate";
+			case trace_type::switch_in: return "switch_in";
+			case trace_type::switch_out: return "switch_out";
+			case trace_type::sleep: return "sleep";
+			case trace_type::wake: return "wake";
+			case trace_type::job_enqueue: return "job_enqueue";
+			case trace_type::job_begin: return "job_begin";
+			case trace_type::job_end: return "job_end";
+			case trace_type::job_expire: return "job_expire";
+			case trace_type::job_reject: return "job_reject";
+			case trace_type::job_error: return "job_error";
+			}
+			return "unknown";
+		}
+
+		void write_string(std::ostream& out, const std::string& value) {
+			out << '"';
+			for (char c : value) {
+				switch (c) {
+				case '"': out << "\\\""; break;
+				case '\\': out << "\\\\"; break;
+				case '\n': out << "\\n"; break;
+				case '\t': out << "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20) {
+						constexpr const char* digits = "0123456789abcdef";
+						out << "\\u00" << digits[(c >> 4) & 0xF] << digits[c & 0xF];
+					}
+					else {
+						out << c;
+					}
+				}
+			}
+			out << '"';
+		}
+	}
+
+	void trace_emit(trace_type type, std::uint64_t subject, std::uint32_t arg) {
+		auto& ring = this_thread_ring();
+		auto head = ring.head.load(std::memory_order_relaxed);
+		auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		ring.events[head & ring.mask] = { static_cast<std::uint64_t>(now), subject, arg, type, 0 };
+		ring.head.store(head + 1, std::memory_order_release);
+	}
+
+	void trace_name(std::uint64_t subject, const std::string& name) {
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.names[subject] = name;
+	}
+
+	void trace_thread_name(const std::string& name) {
+		auto& ring = this_thread_ring();
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		ring.name = name;
+	}
+
+	void set_trace_capacity(std::size_t events) {
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.capacity = std::bit_ceil(std::max<std::size_t>(events, 1024));
+	}
+
+	void write_chrome_trace(std::ostream& out) {
+		struct lane {
+			std::uint32_t id;
+			std::string name;
+			std::vector<trace_event> events;
+		};
+
+		std::vector<lane> lanes;
+		std::unordered_map<std::uint64_t, std::string> names;
+		{
+			auto& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			names = r.names;
+			for (const auto& ring : r.rings) {
+				auto head = ring->head.load(std::memory_order_acquire);
+				auto tail = std::min(ring->tail.load(std::memory_order_relaxed), head);
+				auto count = std::min<std::uint64_t>(head - tail, ring->events.size());
+				lane l{ ring->id, ring->name, {} };
+				l.events.reserve(count);
+				for (auto i = head - count; i < head; ++i) {
+					l.events.push_back(ring->events[i & ring->mask]);
+				}
+				lanes.push_back(std::move(l));
+			}
+		}
+
+		std::uint64_t origin = std::numeric_limits<std::uint64_t>::max();
+		for (const auto& l : lanes) {
+			if (!l.events.empty()) origin = std::min(origin, l.events.front().timestamp);
+		}
+
+		auto subject_name = [&](std::uint64_t subject) {
+			auto it = names.find(subject);
+			if (it != names.end()) return it->second;
+			std::ostringstream fallback;
+			fallback << "fiber 0x" << std::hex << subject;
+			return fallback.str();
+		};
+		auto micros = [&](std::uint64_t timestamp) {
+			return static_cast<double>(timestamp - origin) / 1000.0;
+		};
+
+		auto flags = out.flags();
+		auto precision = out.precision();
+		out << std::fixed << std::setprecision(3);
+		out << "{\"traceEvents\":[";
+
+		bool first = true;
+		auto begin_event = [&] {
+			out << (first ? "\n" : ",\n");
+			first = false;
+		};
+
+		for (const auto& l : lanes) {
+			begin_event();
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << l.id << ",\"args\":{\"name\":";
+			write_string(out, l.name);
+			out << "}}";
+
+			// Switches and jobs on one thread nest, so a stack per kind pairs them up. An
+			// end whose begin was already overwritten is dropped.
+			std::vector<const trace_event*> fibers;
+			std::vector<const trace_event*> jobs;
+			auto complete = [&](const trace_event& start, const trace_event& end, const std::string& name, const char* category) {
+				begin_event();
+				out << "{\"name\":";
+				write_string(out, name);
+				out << ",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << l.id
+					<< ",\"ts\":" << micros(start.timestamp) << ",\"dur\":" << micros(end.timestamp) - micros(start.timestamp)
+					<< ",\"args\":{\"arg\":" << start.arg << "}}";
+			};
+
+			for (const auto& e : l.events) {
+				switch (e.type) {
+				case trace_type::switch_in:
+					fibers.push_back(&e);
+					break;
+				case trace_type::job_begin:
+					jobs.push_back(&e);
+					break;
+				case trace_type::switch_out:
+					if (!fibers.empty() && fibers.back()->subject == e.subject) {
+						complete(*fibers.back(), e, subject_name(e.subject), "fiber");
+						fibers.pop_back();
+					}
+					break;
+				case trace_type::job_end:
+					if (!jobs.empty() && jobs.back()->subject == e.subject) {
+						complete(*jobs.back(), e, "job", "job");
+						jobs.pop_back();
+					}
+					break;
+				default:
+					begin_event();
+					out << "{\"name\":\"" << type_name(e.type) << "\",\"cat\":\"event\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" << l.id
+						<< ",\"ts\":" << micros(e.timestamp) << ",\"args\":{\"subject\":";
+					write_string(out, e.subject ? subject_name(e.subject) : std::string());
+					out << ",\"arg\":" << e.arg << "}}";
+					break;
+				}
+			}
+		}
+
+		out << "\n]}\n";
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	bool export_chrome_trace(const std::filesystem::path& path) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file) return false;
+		write_chrome_trace(file);
+		return static_cast<bool>(file);
+	}
+
+	void clear_trace() {
+		auto& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		std::erase_if(r.rings, [](const std::unique_ptr<trace_ring>& ring) {
+			return ring->retired.load(std::memory_order_acquire);
+			});
+		for (auto& ring : r.rings) {
+			ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+		}
+		r.names.clear();
+	}
+}
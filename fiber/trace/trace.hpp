@@ -0,0 +1,62 @@
+#pragma once
+#include "../../stdafx.hpp"
+
+// 0 compiles every trace point out, 1 keeps fiber and job control events (add, suspend,
+// resume, terminate, reject, expire, errors), 2 adds job execution, sleep and wake, and
+// 3 adds every fiber switch.
+#ifndef VE_TRACE_LEVEL
+#define VE_TRACE_LEVEL 0
+#endif
+
+// The arguments are not evaluated at all when the level is compiled out.
+#define VE_TRACE(level, type, subject, arg) \
+	do { if constexpr ((level) <= VE_TRACE_LEVEL) ::ve::trace_emit((type), (subject), (arg)); } while (false)
+
+#define VE_TRACE_NAME(level, subject, name) \
+	do { if constexpr ((level) <= VE_TRACE_LEVEL) ::ve::trace_name((subject), (name)); } while (false)
+
+namespace ve {
+	enum class trace_type : std::uint16_t {
+		fiber_add,
+		fiber_suspend,
+		fiber_resume,
+		fiber_terminate,
+		switch_in,
+		switch_out,
+		sleep,
+		wake,
+		job_enqueue,
+		job_begin,
+		job_end,
+		job_expire,
+		job_reject,
+		job_error,
+	};
+
+	struct trace_event {
+		std::uint64_t timestamp;
+		std::uint64_t subject;
+		std::uint32_t arg;
+		trace_type type;
+		std::uint16_t reserved;
+	};
+	static_assert(sizeof(trace_event) == 24);
+
+	// Appends to the calling thread's ring buffer. Only the owning thread writes, and
+	// once the ring is full the oldest events are overwritten.
+	void trace_emit(trace_type type, std::uint64_t subject, std::uint32_t arg);
+
+	// Labels a subject (usually a fiber's trace id) for the exporter.
+	void trace_name(std::uint64_t subject, const std::string& name);
+	void trace_thread_name(const std::string& name);
+
+	// Ring size for threads that emit their first event after this call.
+	void set_trace_capacity(std::size_t events);
+
+	// Writes every buffered event as Chrome trace_event JSON (chrome://tracing, Perfetto).
+	// Meant for after the traced work: events being written concurrently may come out torn.
+	void write_chrome_trace(std::ostream& out);
+	bool export_chrome_trace(const std::filesystem::path& path);
+
+	void clear_trace();
+}
@@ -1,21 +1,88 @@
-#pragma once
-
-#include <iostream>
-#include <filesystem>
-
-#include <functional>
-#include <string>
-#include <chrono>
-#include <optional>
-#include <windows.h>
-#include <minwindef.h>
-#include <queue>
-#include <condition_variable>
-#include <memory>
-
-#include <mutex>
-#include <stack>
-
-#include "fiber/fiber.hpp"
-#include "fiber/manager/manager.hpp"
-#include "fiber/pool/pool.hpp"
\ No newline at end of file
+#pragma once
+
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <variant>
+#include <optional>
+#include <span>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#if defined(_WIN32)
+#include <windows.h>
+#include <minwindef.h>
+#else
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+#include <queue>
+#include <deque>
+#include <unordered_map>
+#include <condition_variable>
+#include <memory>
+
+#include <mutex>
+#include <shared_mutex>
+#include <stack>
+
+#include "fiber/scheduler/topology.hpp"
+#include "fiber/memory/stack_pool.hpp"
+#include "fiber/memory/stack_profiler.hpp"
+#include "fiber/memory/object_pool.hpp"
+#include "fiber/memory/inplace_function.hpp"
+#include "fiber/memory/epoch.hpp"
+#include "fiber/sync/spin_lock.hpp"
+#include "fiber/context/context.hpp"
+#include "fiber/trace/trace.hpp"
+#include "fiber/scheduler/deque.hpp"
+#include "fiber/scheduler/mpsc_queue.hpp"
+#include "fiber/timer/timer_wheel.hpp"
+#include "fiber/scheduler/idle_policy.hpp"
+#include "fiber/scheduler/ready_queue.hpp"
+#include "fiber/manager/fiber_handle.hpp"
+#include "fiber/trace/runtime_stats.hpp"
+#include "fiber/scheduler/watchdog.hpp"
+#include "fiber/fiber.hpp"
+#include "fiber/scheduler/scheduler.hpp"
+#include "fiber/manager/manager.hpp"
+#include "fiber/sync/wait_list.hpp"
+#include "fiber/sync/mutex.hpp"
+#include "fiber/sync/condition_variable.hpp"
+#include "fiber/sync/semaphore.hpp"
+#include "fiber/sync/channel.hpp"
+#include "fiber/sync/future.hpp"
+#include "fiber/pool/job_counter.hpp"
+#include "fiber/pool/job_graph.hpp"
+#include "fiber/coro/task.hpp"
+#include "fiber/pool/pool.hpp"
+#include "fiber/coro/awaitables.hpp"
+#include "fiber/io/reactor.hpp"
\ No newline at end of file